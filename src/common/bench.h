@@ -0,0 +1,25 @@
+#pragma once
+
+#include <iostream>
+#include "util.h"
+
+/**
+ * Runs a statement a number of times, and prints the average time per iteration.
+ */
+#define benchmark(name, iterations, ...) do {\
+    size_t benchStartNS = getTimeNanoseconds();\
+    for (size_t benchIter = 0; benchIter < (size_t)(iterations); ++benchIter) {\
+        __VA_ARGS__;\
+    }\
+    size_t benchEndNS = getTimeNanoseconds();\
+    std::cout << name << ": " << (double)(benchEndNS - benchStartNS) / (iterations) << " ns/iter" << std::endl;\
+} while (0)
+
+/**
+ * Keeps the compiler from optimizing away a benchmarked result.
+ */
+template<typename T>
+void benchKeep(const T& value) {
+    static volatile T sink;
+    sink = value;
+}
@@ -1,17 +1,31 @@
 #pragma once
 
 #include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
+#include <string>
 #include <vector>
 
 #define BITS_TO_BYTES(bits) (((bits) + 7) / 8)
 
+// Keeps rarely taken paths (such as growing the buffer) from bloating the inlined read/write paths
+#ifdef _MSC_VER
+#define BITSTREAM_NOINLINE __declspec(noinline)
+#else
+#define BITSTREAM_NOINLINE __attribute__((noinline))
+#endif
+
 /**
  * A stream serializer that reads/writes to an external buffer.
+ * The buffer is either a vector, which grows as data is written past its end,
+ * or a non-owning view over raw memory (such as a socket receive buffer), which never grows.
  *
  * Serialization of bits starts at the MSB toward LSB, and all data is serialized in memory byte-order.
  *
- * The stream bit pos IS allowed to be at buf.size() * 8 (technically past the end of the buffer range),
+ * The stream bit pos IS allowed to be at the buffer size * 8 (technically past the end of the buffer range),
  * but should never be beyond that, and should not be able to actually read/write at that point without
  * additional buffer allocation.
  */
@@ -20,21 +34,52 @@ public:
     enum class Error {
         NONE,
         INVALID_STREAM_POS,
-        READ_TOO_MUCH
+        READ_TOO_MUCH,
+        WRITE_TOO_MUCH,
+        INVALID_VALUE
     };
 
     BitStream(std::vector<uint8_t>& exisitingBuf) :
-        buf(exisitingBuf),
+        vec(&exisitingBuf),
+        data(exisitingBuf.data()),
+        size(exisitingBuf.size()),
         streamBitPos(0),
         lastError(Error::NONE) {
 
     }
 
+    /**
+     * Creates a stream over a non-owning view of existing memory.
+     * Writing past the end of the view is an error rather than a resize.
+     */
+    BitStream(uint8_t* existingData, size_t existingSize) :
+        vec(nullptr),
+        data(existingData),
+        size(existingSize),
+        streamBitPos(0),
+        lastError(Error::NONE) {
+
+    }
+
+    /**
+     * @return A pointer to the start of the buffer
+     */
+    uint8_t* getData() const {
+        return data;
+    }
+
+    /**
+     * @return The total number of bytes in the buffer
+     */
+    size_t getSizeBytes() const {
+        return size;
+    }
+
     /**
      * @return The total number of bits in the buffer
      */
     size_t getSizeBits() const {
-        return buf.size() * 8;
+        return size * 8;
     }
 
     /**
@@ -54,10 +99,10 @@ public:
      */
     size_t getRemainingBytes() const {
         size_t usedBytes = BITS_TO_BYTES(streamBitPos);
-        if (usedBytes >= buf.size()) {
+        if (usedBytes >= size) {
             return 0;
         } else {
-            return buf.size() - usedBytes;
+            return size - usedBytes;
         }
     }
 
@@ -65,21 +110,21 @@ public:
      * @return A pointer to the byte holding the stream pos
      */
     uint8_t* getHeadBytePtr() const {
-        return buf.data() + (streamBitPos / 8);
+        return data + (streamBitPos / 8);
     }
 
     /**
-     * @return An iterator to the byte holding the stream pos
+     * @return A pointer to the byte holding the given bit pos
      */
-    std::vector<uint8_t>::iterator getHeadIterator() const {
-        return buf.begin() + (streamBitPos / 8);
+    uint8_t* getPosBytePtr(size_t bitPos) const {
+        return data + (bitPos / 8);
     }
 
     /**
-     * @return A pointer to the byte holding the given bit pos
+     * @return A pointer one past the last byte of the buffer
      */
-    uint8_t* getPosBytePtr(size_t bitPos) const {
-        return buf.data() + (bitPos / 8);
+    uint8_t* getEndBytePtr() const {
+        return data + size;
     }
 
     /**
@@ -93,7 +138,7 @@ public:
      * Sets the current stream pos.
      */
     void setPos(size_t pos) {
-        if (pos > buf.size() * 8) {
+        if (pos > size * 8) {
             lastError = Error::INVALID_STREAM_POS;
             return;
         }
@@ -108,7 +153,7 @@ public:
         // TODO: Signedness is funky here. Figure out a better way.
         int32_t newPos = (int32_t)streamBitPos + delta;
 
-        if (newPos < 0 || newPos > buf.size() * 8) {
+        if (newPos < 0 || newPos > size * 8) {
             lastError = Error::INVALID_STREAM_POS;
             return;
         }
@@ -126,6 +171,41 @@ public:
         }
     }
 
+    /**
+     * Aligns the stream pos like alignPos, but writes zeros over the bits it skips, so that padding doesn't send
+     * whatever a reused buffer held before.
+     */
+    void alignWritePos() {
+        size_t bitsIn = (streamBitPos % 8);
+        if (bitsIn != 0) {
+            writeBitField(0, 8 - bitsIn);
+        }
+    }
+
+    /**
+     * Makes room for numBits more bits after the stream pos with a single resize, so the writes that follow
+     * don't resize the buffer field by field. Call trimToPos once done to drop any room that went unused.
+     * @return Whether the buffer is now large enough
+     */
+    bool reserve(size_t numBits) {
+        size_t remainingBits = getRemainingBits();
+        return remainingBits >= numBits || grow(BITS_TO_BYTES(streamBitPos + numBits));
+    }
+
+    /**
+     * Shrinks the buffer to end at the byte holding the stream pos, dropping room left over from reserve.
+     * Views keep their size, since the memory isn't theirs to shrink.
+     */
+    void trimToPos() {
+        size_t usedSize = BITS_TO_BYTES(streamBitPos);
+        if (vec == nullptr || usedSize >= size) {
+            return;
+        }
+
+        vec->resize(usedSize);
+        size = usedSize;
+    }
+
     /**
      * @return The error type if the stream has encountered a serialization error.
      */
@@ -133,6 +213,13 @@ public:
         return lastError;
     }
 
+    /**
+     * Flags a decoding error that the stream can't see for itself, such as a field with a value that isn't allowed.
+     */
+    void setError(Error error) {
+        lastError = error;
+    }
+
     /**
      * Reads a number of bytes.
      */
@@ -160,6 +247,27 @@ public:
         }
     }
 
+    /**
+     * Skips over a number of bytes without copying them.
+     * The stream pos must be byte aligned.
+     * @return A pointer to the first skipped byte, which stays valid for as long as the underlying buffer, or nullptr on error
+     */
+    uint8_t* readView(size_t numBytes) {
+        if ((streamBitPos & 0x7) != 0) {
+            lastError = Error::INVALID_STREAM_POS;
+            return nullptr;
+        }
+
+        if (getRemainingBytes() < numBytes) {
+            lastError = Error::READ_TOO_MUCH;
+            return nullptr;
+        }
+
+        uint8_t* view = getHeadBytePtr();
+        streamBitPos += numBytes * 8;
+        return view;
+    }
+
     /**
      * @return The boolean value of the next bit in the stream
      */
@@ -200,42 +308,24 @@ public:
         
         size_t prevStreamBitPos = streamBitPos;
 
-        unsigned char* srcPtr = buf.data();
-
+        // Whole bytes come first, and any leftover bits go in the low bits of the last byte.
+        // Each chunk is a single field read, so an odd-width field takes one load
         size_t bitsToRead = numBits;
-
-        while (true) {
-            size_t byteOffset = streamBitPos / 8;
-            size_t bitOffset = (streamBitPos & 0x7);
-            size_t bitsLeft = 8 - bitOffset;
-
-            if (bitsLeft >= bitsToRead) {
-                // We have enough bits remaining in the current source byte to finish the read, so read them all into the current destination byte
-                // Shift the remaining bits right to be flush with the start of the current destination byte, and mask out the bits to the left
-                size_t bitGap = (bitsLeft - bitsToRead);
-                *outBuf = ((srcPtr[byteOffset] >> bitGap) & ((1 << bitsToRead) - 1));
-                streamBitPos += bitsToRead;
-                break;
-            } else {
-                // We don't have enough bits remaining in the current byte to finish the read, so read as much as we need into the current destination byte
-                // Shift the current source byte left to reserve a number of bits on the right to read from the next byte, and mask out the bits to the left
-                size_t bitsToWriteToSrc = std::min(bitsToRead, (size_t)8);
-                size_t bitsToReserve = bitsToWriteToSrc - bitsLeft;
-
-                *outBuf = ((srcPtr[byteOffset] & ((1 << bitsLeft) - 1)) << bitsToReserve);
-
-                // Read the rest of the bits we reserved room for in the destination byte from the next source byte
-                *outBuf |= (srcPtr[byteOffset + 1] >> (8 - bitsToReserve));
-
-                streamBitPos += bitsToWriteToSrc;
-                bitsToRead -= bitsToWriteToSrc;
-
-                if (bitsToRead == 0) {
-                    break;
-                }
-
-                outBuf++;
+        while (bitsToRead > 0) {
+            size_t chunkBits = std::min(bitsToRead, (size_t)MAX_CHUNK_BITS);
+            uint64_t value = readFieldUnchecked(chunkBits);
+
+            size_t chunkBytes = chunkBits / 8;
+            size_t chunkExtraBits = chunkBits & 0x7;
+            for (size_t i = 0; i < chunkBytes; ++i) {
+                outBuf[i] = (uint8_t)(value >> (chunkExtraBits + 8 * (chunkBytes - 1 - i)));
+            }
+            if (chunkExtraBits != 0) {
+                outBuf[chunkBytes] = (uint8_t)(value & ((1 << chunkExtraBits) - 1));
             }
+
+            outBuf += chunkBytes;
+            bitsToRead -= chunkBits;
         }
 
         if (peek) {
@@ -246,24 +336,24 @@ public:
     /**
      * Writes a number of bytes.
      */
-    void writeBytes(const uint8_t* data, size_t numBytes) {
+    void writeBytes(const uint8_t* srcData, size_t numBytes) {
         if (numBytes == 0) {
             return;
         }
 
         // If the stream position is not aligned on a byte boundary, need to do bit writing
         if ((streamBitPos & 0x7) != 0) {
-            writeBits(data, numBytes * 8);
+            writeBits(srcData, numBytes * 8);
             return;
         }
 
         // Reserve space for the number of bytes we're going to write
         size_t remainingBytes = getRemainingBytes();
-        if (remainingBytes < numBytes) {
-            buf.resize(buf.size() + numBytes - remainingBytes);
+        if (remainingBytes < numBytes && !grow(size + numBytes - remainingBytes)) {
+            return;
         }
 
-        memcpy(getHeadBytePtr(), data, numBytes);
+        memcpy(getHeadBytePtr(), srcData, numBytes);
 
         streamBitPos += numBytes * 8;
     }
@@ -273,8 +363,8 @@ public:
      */
     void writeBit(bool value) {
         size_t remainingBits = getRemainingBits();
-        if (remainingBits < 1) {
-            buf.resize(buf.size() + 1);
+        if (remainingBits < 1 && !grow(size + 1)) {
+            return;
         }
 
         if (value) {
@@ -289,60 +379,56 @@ public:
     /**
      * Writes a number of bits.
      */
-    void writeBits(const uint8_t* data, size_t numBits) {
-        if (numBits == 0) {
+    void writeBits(const uint8_t* srcData, size_t numBits) {
+        // Odd-width fields that fit in a single chunk (nearly all of them) take a short path that's cheap to inline
+        if (numBits == 0 || numBits > MAX_CHUNK_BITS || ((streamBitPos & 0x7) == 0 && (numBits & 0x7) == 0) || getRemainingBits() < numBits) {
+            writeBitsLong(srcData, numBits);
             return;
         }
 
-        // If the stream position is aligned on a byte boundary and we are writing a quantity of bits divisble by 8, we can use faster byte writing
-        if ((streamBitPos & 0x7) == 0 && (numBits & 0x7) == 0) {
-            writeBytes(data, numBits / 8);
-            return;
+        writeFieldUnchecked(packChunk(srcData, numBits), numBits);
+    }
+
+    /**
+     * Reads a field of up to MAX_FIELD_BITS bits, first bit most significant, with a single 64-bit load.
+     * @return The field value, or 0 if there aren't enough bits left
+     */
+    uint64_t readBitField(size_t numBits, bool peek = false) {
+        if (numBits == 0 || numBits > MAX_FIELD_BITS) {
+            lastError = Error::READ_TOO_MUCH;
+            return 0;
         }
 
-        // Reserve space for the number of bits we're going to write
-        size_t remainingBits = getRemainingBits();
-        if (remainingBits < numBits) {
-            buf.resize(BITS_TO_BYTES(buf.size() * 8 + numBits - remainingBits));
+        if (getRemainingBits() < numBits) {
+            lastError = Error::READ_TOO_MUCH;
+            return 0;
         }
 
-        unsigned char* dstPtr = buf.data();
+        uint64_t value = readFieldUnchecked(numBits);
 
-        size_t bitsToWrite = numBits;
+        if (peek) {
+            streamBitPos -= numBits;
+        }
 
-        while (true) {
-            size_t byteOffset = streamBitPos / 8;
-            size_t bitOffset = (streamBitPos & 0x7);
-            size_t bitsLeft = 8 - bitOffset;
-
-            if (bitsLeft >= bitsToWrite) {
-                // We have enough room in the current byte to fit all of the rest of the bits, so write them all from the current source byte
-                // Shift the remaining bits left to close the gap and be flush with the end of the stream
-                size_t bitGap = (bitsLeft - bitsToWrite);
-                dstPtr[byteOffset] |= (*data << bitGap);
-                streamBitPos += bitsToWrite;
-                break;
-            } else {
-                // We don't have enough room for all of the remaining bits, so write as much as we need to from the current source byte
-                // Shift the current byte right to un-overlap the bits and be flush with the end of the stream
-                size_t bitsToWriteFromSrc = std::min(bitsToWrite, (size_t)8);
-                size_t bitsOverlapped = bitsToWriteFromSrc - bitsLeft;
-
-                dstPtr[byteOffset] |= (*data >> bitsOverlapped);
-
-                // Now write the rest of the bits remaining in the current source byte to the next destination byte
-                dstPtr[byteOffset + 1] |= (*data << (8 - bitsOverlapped));
-
-                streamBitPos += bitsToWriteFromSrc;
-                bitsToWrite -= bitsToWriteFromSrc;
-
-                if (bitsToWrite == 0) {
-                    break;
-                }
-
-                data++;
-            }
+        return value;
+    }
+
+    /**
+     * Writes the low numBits bits of a value (up to MAX_FIELD_BITS), first bit most significant, with a single masked 64-bit store.
+     * Unlike writeBits into a fresh buffer, the bits being written over are replaced rather than ORed into.
+     */
+    void writeBitField(uint64_t value, size_t numBits) {
+        if (numBits == 0 || numBits > MAX_FIELD_BITS) {
+            lastError = Error::WRITE_TOO_MUCH;
+            return;
+        }
+
+        size_t remainingBits = getRemainingBits();
+        if (remainingBits < numBits && !grow(BITS_TO_BYTES(size * 8 + numBits - remainingBits))) {
+            return;
         }
+
+        writeFieldUnchecked(value, numBits);
     }
 
     /**
@@ -433,7 +519,7 @@ public:
         const uint16_t strLen = (uint16_t)str.length();
         writeStringLength(strLen);
 
-        alignPos();
+        alignWritePos();
 
         writeBytes((uint8_t*)str.data(), strLen);
     }
@@ -442,14 +528,248 @@ public:
         const uint16_t strLen = (uint16_t)str.length();
         writeStringLength(strLen);
 
-        alignPos();
+        alignWritePos();
 
         writeBytes((uint8_t*)str.data(), strLen * 2);
     }
 
-    std::vector<uint8_t>& buf;
+    /**
+     * Upper bounds on the number of bits the matching write functions take, for sizing a buffer up front with reserve.
+     */
+    template<typename T, size_t arraySize>
+    static size_t maxEncodedBits(const std::array<T, arraySize>& data) {
+        return sizeof(T) * arraySize * 8;
+    }
+
+    template<typename T>
+    static size_t maxEncodedBits(const std::vector<T>& data) {
+        return sizeof(T) * data.size() * 8;
+    }
+
+    template<typename T>
+    static size_t maxEncodedBits(const T& object) {
+        return sizeof(T) * 8;
+    }
+
+    static size_t maxEncodedBits(const std::string& str) {
+        return maxStringLengthBits(str.length()) + str.length() * 8;
+    }
+
+    static size_t maxEncodedBits(const std::wstring& str) {
+        return maxStringLengthBits(str.length()) + str.length() * 2 * 8;
+    }
+
+    /**
+     * Unchecked forms of readBytes/writeBytes/readBitField/writeBitField, for callers that check (or reserve) room
+     * for a whole run of fields at once, such as PacketSchema. There MUST be room for the bits being read/written.
+     */
+    void readBytesUnchecked(uint8_t* outBuf, size_t numBytes) {
+        if ((streamBitPos & 0x7) == 0) {
+            memcpy(outBuf, getHeadBytePtr(), numBytes);
+            streamBitPos += numBytes * 8;
+            return;
+        }
+
+        while (numBytes > 0) {
+            size_t chunkBytes = std::min(numBytes, (size_t)MAX_CHUNK_BITS / 8);
+            uint64_t value = readFieldUnchecked(chunkBytes * 8);
+            for (size_t i = 0; i < chunkBytes; ++i) {
+                outBuf[i] = (uint8_t)(value >> (8 * (chunkBytes - 1 - i)));
+            }
+
+            outBuf += chunkBytes;
+            numBytes -= chunkBytes;
+        }
+    }
+
+    void writeBytesUnchecked(const uint8_t* srcData, size_t numBytes) {
+        if ((streamBitPos & 0x7) == 0) {
+            memcpy(getHeadBytePtr(), srcData, numBytes);
+            streamBitPos += numBytes * 8;
+            return;
+        }
+
+        while (numBytes > 0) {
+            size_t chunkBytes = std::min(numBytes, (size_t)MAX_CHUNK_BITS / 8);
+            writeFieldUnchecked(packChunk(srcData, chunkBytes * 8), chunkBytes * 8);
+
+            srcData += chunkBytes;
+            numBytes -= chunkBytes;
+        }
+    }
+
+    uint64_t readBitFieldUnchecked(size_t numBits) {
+        return readFieldUnchecked(numBits);
+    }
+
+    void writeBitFieldUnchecked(uint64_t value, size_t numBits) {
+        writeFieldUnchecked(value, numBits);
+    }
+
+    // A field can start at any bit in a byte, so a 64-bit word always holds 57 bits from the stream pos
+    static const size_t MAX_FIELD_BITS = 57;
 
 private:
+    // Chunks of whole bytes for readBits/writeBits, the largest that fits in a field
+    static const size_t MAX_CHUNK_BITS = 56;
+
+    /**
+     * Loads the 8 bytes at byteOffset as a big-endian word, so stream bit order matches value bit order.
+     * Bytes past the end of the buffer read as 0.
+     */
+    uint64_t loadWord(size_t byteOffset) const {
+        uint64_t word = 0;
+        if (byteOffset + 8 <= size) {
+            // Fixed size, so this compiles down to a single load
+            memcpy(&word, data + byteOffset, 8);
+        } else {
+            memcpy(&word, data + byteOffset, size - byteOffset);
+        }
+        return byteSwap64(word);
+    }
+
+    /**
+     * Stores a big-endian word at byteOffset, dropping any bytes that fall past the end of the buffer.
+     */
+    void storeWord(size_t byteOffset, uint64_t word) {
+        word = byteSwap64(word);
+        if (byteOffset + 8 <= size) {
+            memcpy(data + byteOffset, &word, 8);
+        } else {
+            memcpy(data + byteOffset, &word, size - byteOffset);
+        }
+    }
+
+    static uint64_t byteSwap64(uint64_t value) {
+        // NOTE: Assumes a little endian host
+#ifdef _MSC_VER
+        return _byteswap_uint64(value);
+#else
+        return __builtin_bswap64(value);
+#endif
+    }
+
+    /**
+     * Reads a 1 to MAX_FIELD_BITS bit field that's known to be in bounds.
+     */
+    uint64_t readFieldUnchecked(size_t numBits) {
+        uint64_t word = loadWord(streamBitPos / 8);
+        uint64_t value = (word << (streamBitPos & 0x7)) >> (64 - numBits);
+
+        streamBitPos += numBits;
+
+        return value;
+    }
+
+    /**
+     * Writes a 1 to MAX_FIELD_BITS bit field that's known to be in bounds, leaving the surrounding bits alone.
+     * Works on 8-byte aligned words (relative to the start of the buffer), so that back to back field writes
+     * load exactly the word the previous write stored, rather than stalling on a partially overlapping one.
+     */
+    void writeFieldUnchecked(uint64_t value, size_t numBits) {
+        size_t wordOffset = (streamBitPos / 64) * 8;
+        size_t bitInWord = streamBitPos & 0x3F;
+
+        if (bitInWord + numBits <= 64) {
+            writeWordBits(wordOffset, value, numBits, 64 - bitInWord - numBits);
+        } else {
+            // Straddles two words, so split it
+            size_t firstBits = 64 - bitInWord;
+            size_t secondBits = numBits - firstBits;
+            writeWordBits(wordOffset, value >> secondBits, firstBits, 0);
+            writeWordBits(wordOffset + 8, value, secondBits, 64 - secondBits);
+        }
+
+        streamBitPos += numBits;
+    }
+
+    /**
+     * Replaces numBits bits of the word at wordOffset, starting shift bits up from its least significant bit, with the low bits of value.
+     */
+    void writeWordBits(size_t wordOffset, uint64_t value, size_t numBits, size_t shift) {
+        uint64_t mask = ((~(uint64_t)0) >> (64 - numBits)) << shift;
+
+        uint64_t word = loadWord(wordOffset);
+        word = (word & ~mask) | ((value << shift) & mask);
+        storeWord(wordOffset, word);
+    }
+
+    /**
+     * @return The bits taken by a string length, including the worst case padding to align the string after it
+     */
+    static size_t maxStringLengthBits(size_t length) {
+        return (length < 128 ? 8 : 16) + 7;
+    }
+
+    /**
+     * Packs the bytes of a chunk of up to MAX_CHUNK_BITS bits into a field value.
+     * Whole bytes come first, and any leftover bits are the low bits of the last byte, as with readBits.
+     */
+    static uint64_t packChunk(const uint8_t* srcData, size_t numBits) {
+        size_t numBytes = numBits / 8;
+        size_t extraBits = numBits & 0x7;
+
+        uint64_t value = 0;
+        for (size_t i = 0; i < numBytes; ++i) {
+            value = (value << 8) | srcData[i];
+        }
+        if (extraBits != 0) {
+            value = (value << extraBits) | (srcData[numBytes] & ((1 << extraBits) - 1));
+        }
+
+        return value;
+    }
+
+    /**
+     * The rest of writeBits: byte aligned writes, growing the buffer, and writes longer than a chunk.
+     */
+    BITSTREAM_NOINLINE void writeBitsLong(const uint8_t* srcData, size_t numBits) {
+        if (numBits == 0) {
+            return;
+        }
+
+        // If the stream position is aligned on a byte boundary and we are writing a quantity of bits divisble by 8, we can use faster byte writing
+        if ((streamBitPos & 0x7) == 0 && (numBits & 0x7) == 0) {
+            writeBytes(srcData, numBits / 8);
+            return;
+        }
+
+        // Reserve space for the number of bits we're going to write
+        size_t remainingBits = getRemainingBits();
+        if (remainingBits < numBits && !grow(BITS_TO_BYTES(size * 8 + numBits - remainingBits))) {
+            return;
+        }
+
+        // Each chunk is written as a single masked field write
+        size_t bitsToWrite = numBits;
+        while (bitsToWrite > 0) {
+            size_t chunkBits = std::min(bitsToWrite, (size_t)MAX_CHUNK_BITS);
+            writeFieldUnchecked(packChunk(srcData, chunkBits), chunkBits);
+
+            srcData += chunkBits / 8;
+            bitsToWrite -= chunkBits;
+        }
+    }
+
+    /**
+     * Grows the buffer to the given number of bytes. Only vector-backed streams can grow.
+     * @return Whether the buffer is now large enough
+     */
+    bool grow(size_t newSize) {
+        if (vec == nullptr) {
+            lastError = Error::WRITE_TOO_MUCH;
+            return false;
+        }
+
+        vec->resize(newSize);
+        data = vec->data();
+        size = newSize;
+        return true;
+    }
+
+    std::vector<uint8_t>* vec;
+    uint8_t* data;
+    size_t size;
     size_t streamBitPos;
     Error lastError;
 };
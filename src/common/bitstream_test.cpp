@@ -1,4 +1,8 @@
+#include <random>
+#include <vector>
+#include "bench.h"
 #include "bitstream.h"
+#include "bitstream_test.h"
 #include "log.h"
 #include "test.h"
 
@@ -119,13 +123,298 @@ void testBitstreamReadBits() {
     }
 }
 
+void testBitstreamView() {
+    static std::vector<uint8_t> expectedBuf = std::vector<uint8_t>({
+        0x12, 0x34, 0x56, 0x00
+    });
+
+    std::array<uint8_t, 4> viewBuf = { 0x00, 0x00, 0x00, 0x00 };
+    BitStream bitstream(viewBuf.data(), viewBuf.size());
+
+    uint16_t first = 0x3412;
+    bitstream.write(first);
+    uint8_t second = 0x56;
+    bitstream.write(second);
+    assertEqual((int)bitstream.getLastError(), (int)BitStream::Error::NONE);
+
+    // Views never grow
+    uint16_t tooMuch = 0xFFFF;
+    bitstream.write(tooMuch);
+    assertEqual((int)bitstream.getLastError(), (int)BitStream::Error::WRITE_TOO_MUCH);
+    assertBuffersEqual(std::vector<uint8_t>(viewBuf.begin(), viewBuf.end()), expectedBuf);
+
+    BitStream readStream(viewBuf.data(), viewBuf.size());
+    readStream.deltaPos(8);
+    uint8_t* view = readStream.readView(2);
+    assertEqual((void*)view, (void*)(viewBuf.data() + 1));
+    assertEqual(readStream.getRemainingBytes(), 1);
+}
+
+/**
+ * The old byte-at-a-time BitStream::readBits loop, to check and benchmark against.
+ */
+void readBitsBytewise(const uint8_t* srcPtr, size_t& streamBitPos, uint8_t* outBuf, size_t numBits) {
+    size_t bitsToRead = numBits;
+
+    while (true) {
+        size_t byteOffset = streamBitPos / 8;
+        size_t bitOffset = (streamBitPos & 0x7);
+        size_t bitsLeft = 8 - bitOffset;
+
+        if (bitsLeft >= bitsToRead) {
+            size_t bitGap = (bitsLeft - bitsToRead);
+            *outBuf = ((srcPtr[byteOffset] >> bitGap) & ((1 << bitsToRead) - 1));
+            streamBitPos += bitsToRead;
+            break;
+        } else {
+            size_t bitsToWriteToSrc = std::min(bitsToRead, (size_t)8);
+            size_t bitsToReserve = bitsToWriteToSrc - bitsLeft;
+
+            *outBuf = ((srcPtr[byteOffset] & ((1 << bitsLeft) - 1)) << bitsToReserve);
+            *outBuf |= (srcPtr[byteOffset + 1] >> (8 - bitsToReserve));
+
+            streamBitPos += bitsToWriteToSrc;
+            bitsToRead -= bitsToWriteToSrc;
+
+            if (bitsToRead == 0) {
+                break;
+            }
+
+            outBuf++;
+        }
+    }
+}
+
+/**
+ * The old byte-at-a-time BitStream::writeBits loop, to check and benchmark against. ORs into the destination.
+ */
+void writeBitsBytewise(uint8_t* dstPtr, size_t& streamBitPos, const uint8_t* srcData, size_t numBits) {
+    size_t bitsToWrite = numBits;
+
+    while (true) {
+        size_t byteOffset = streamBitPos / 8;
+        size_t bitOffset = (streamBitPos & 0x7);
+        size_t bitsLeft = 8 - bitOffset;
+
+        if (bitsLeft >= bitsToWrite) {
+            size_t bitGap = (bitsLeft - bitsToWrite);
+            dstPtr[byteOffset] |= (*srcData << bitGap);
+            streamBitPos += bitsToWrite;
+            break;
+        } else {
+            size_t bitsToWriteFromSrc = std::min(bitsToWrite, (size_t)8);
+            size_t bitsOverlapped = bitsToWriteFromSrc - bitsLeft;
+
+            dstPtr[byteOffset] |= (*srcData >> bitsOverlapped);
+            dstPtr[byteOffset + 1] |= (*srcData << (8 - bitsOverlapped));
+
+            streamBitPos += bitsToWriteFromSrc;
+            bitsToWrite -= bitsToWriteFromSrc;
+
+            if (bitsToWrite == 0) {
+                break;
+            }
+
+            srcData++;
+        }
+    }
+}
+
+void testBitstreamBitsMatchBytewise() {
+    std::mt19937 generator(1234);
+
+    for (size_t i = 0; i < 1000; ++i) {
+        size_t pos = generator() % 64;
+        size_t numBits = 1 + generator() % 120;
+
+        // The old loops expect the bits past the end of the last source byte to be clear
+        std::vector<uint8_t> src(BITS_TO_BYTES(numBits));
+        for (auto& srcByte : src) {
+            srcByte = (uint8_t)generator();
+        }
+        if ((numBits & 0x7) != 0) {
+            src.back() &= (1 << (numBits & 0x7)) - 1;
+        }
+
+        std::vector<uint8_t> expectedBuf(32);
+        size_t expectedPos = pos;
+        writeBitsBytewise(expectedBuf.data(), expectedPos, src.data(), numBits);
+
+        std::vector<uint8_t> buf(32);
+        BitStream bitstream(buf);
+        bitstream.setPos(pos);
+        bitstream.writeBits(src.data(), numBits);
+        assertBuffersEqual(buf, expectedBuf);
+        assertEqual(bitstream.getPos(), expectedPos);
+
+        std::vector<uint8_t> expectedRead(src.size());
+        size_t expectedReadPos = pos;
+        readBitsBytewise(buf.data(), expectedReadPos, expectedRead.data(), numBits);
+
+        std::vector<uint8_t> read(src.size());
+        bitstream.setPos(pos);
+        bitstream.readBits(read.data(), numBits);
+        assertBuffersEqual(read, expectedRead);
+        assertBuffersEqual(read, src);
+    }
+}
+
+void testBitstreamBitField() {
+    std::vector<uint8_t> buf;
+    BitStream bitstream(buf);
+
+    bitstream.writeBitField(0x1, 3);
+    bitstream.writeBitField(0x5A3, 11);
+    bitstream.writeBitField(0x2, 2);
+    bitstream.writeBitField(0x123456789ABCDEF, 57);
+    assertEqual(buf.size(), (size_t)10);
+
+    bitstream.setPos(0);
+    assertEqual(bitstream.readBitField(3), (uint64_t)0x1);
+    assertEqual(bitstream.readBitField(11, true), (uint64_t)0x5A3);
+    assertEqual(bitstream.readBitField(11), (uint64_t)0x5A3);
+    assertEqual(bitstream.readBitField(2), (uint64_t)0x2);
+    assertEqual(bitstream.readBitField(57), (uint64_t)0x123456789ABCDEF);
+    assertEqual((int)bitstream.getLastError(), (int)BitStream::Error::NONE);
+
+    // Writes replace the bits they cover, and leave their neighbours alone
+    static std::vector<uint8_t> expectedMasked = std::vector<uint8_t>({
+        0xFC, 0x1F, 0xFF
+    });
+    std::array<uint8_t, 3> viewBuf = { 0xFF, 0xFF, 0xFF };
+    BitStream viewStream(viewBuf.data(), viewBuf.size());
+    viewStream.setPos(6);
+    viewStream.writeBitField(0, 5);
+    assertBuffersEqual(std::vector<uint8_t>(viewBuf.begin(), viewBuf.end()), expectedMasked);
+
+    // Fields at the very end of a view never touch memory past it
+    viewStream.setPos(20);
+    assertEqual(viewStream.readBitField(4), (uint64_t)0xF);
+    viewStream.readBitField(1);
+    assertEqual((int)viewStream.getLastError(), (int)BitStream::Error::READ_TOO_MUCH);
+}
+
+void testBitstreamReserve() {
+    std::vector<uint8_t> buf;
+    BitStream bitstream(buf);
+
+    // Room for the whole write up front, then no more resizing until it's trimmed
+    assertEqual(bitstream.reserve(100), true);
+    assertEqual(buf.size(), 13);
+    uint8_t* reservedData = buf.data();
+    uint32_t value = 0x12345678;
+    bitstream.write(value);
+    bitstream.writeBit(true);
+    uint8_t bits = 0x5;
+    bitstream.writeBits(&bits, 3);
+    assertEqual(buf.size(), 13);
+    assertEqual((buf.data() == reservedData), true);
+
+    bitstream.trimToPos();
+    static std::vector<uint8_t> expectedBuf = { 0x78, 0x56, 0x34, 0x12, 0xD0 };
+    assertBuffersEqual(buf, expectedBuf);
+    assertEqual(bitstream.getSizeBytes(), 5);
+
+    // Views can't make room
+    uint8_t viewBuf[4] = {};
+    BitStream viewStream(viewBuf, sizeof(viewBuf));
+    assertEqual(viewStream.reserve(32), true);
+    assertEqual(viewStream.reserve(33), false);
+    assertEqual((int)viewStream.getLastError(), (int)BitStream::Error::WRITE_TOO_MUCH);
+    viewStream.trimToPos();
+    assertEqual(viewStream.getSizeBytes(), 4);
+}
+
 void testBitstream() {
     testBitstreamWriteBitsBasic();
     testBitstreamWriteBits();
     testBitstreamReadBits();
+    testBitstreamView();
+    testBitstreamBitsMatchBytewise();
+    testBitstreamBitField();
+    testBitstreamReserve();
 
     // TODO: Test byte write/read
     // TODO: Test mixed bits and bytes write/read
     // TODO: Test primitive write/read
     // TODO: Test string write/read
 }
+
+void benchBitstream() {
+    // About the size of the ObjectCreateMessage, read back as odd-width fields like its 11-bit objectClass
+    std::vector<uint8_t> buf(608);
+    for (size_t i = 0; i < buf.size(); ++i) {
+        buf[i] = (uint8_t)(i * 37 + 11);
+    }
+    BitStream bitstream(buf);
+
+    size_t numFields = (buf.size() * 8) / 11 - 1;
+    size_t numIters = 10000;
+    uint16_t field = 0;
+
+    std::cout << "Bitstream, " << numFields << " 11-bit fields" << std::endl;
+    benchmark("  readBitField", numIters, {
+        bitstream.setPos(0);
+        for (size_t i = 0; i < numFields; ++i) {
+            field += (uint16_t)bitstream.readBitField(11);
+        }
+    });
+    benchmark("  readBits", numIters, {
+        bitstream.setPos(0);
+        for (size_t i = 0; i < numFields; ++i) {
+            bitstream.readBits((uint8_t*)&field, 11);
+        }
+    });
+    benchmark("  readBits bytewise (old)", numIters, {
+        size_t pos = 0;
+        for (size_t i = 0; i < numFields; ++i) {
+            readBitsBytewise(buf.data(), pos, (uint8_t*)&field, 11);
+        }
+    });
+
+    benchmark("  writeBitField", numIters, {
+        bitstream.setPos(0);
+        for (size_t i = 0; i < numFields; ++i) {
+            bitstream.writeBitField(i, 11);
+        }
+    });
+    benchmark("  writeBits", numIters, {
+        bitstream.setPos(0);
+        for (size_t i = 0; i < numFields; ++i) {
+            bitstream.writeBits((const uint8_t*)&i, 11);
+        }
+    });
+    benchmark("  writeBits bytewise (old)", numIters, {
+        size_t pos = 0;
+        for (size_t i = 0; i < numFields; ++i) {
+            writeBitsBytewise(buf.data(), pos, (const uint8_t*)&i, 11);
+        }
+    });
+
+    // Encoding a packet's worth of fields into a cleared send buffer, growing per field vs reserving once
+    std::vector<uint8_t> sendBuf;
+    size_t numEncodeFields = 64;
+    std::cout << "Bitstream encode, " << numEncodeFields << " 4-byte fields + 1 bit" << std::endl;
+    benchmark("  grow per field", numIters, {
+        sendBuf.clear();
+        BitStream sendStream(sendBuf);
+        for (uint32_t i = 0; i < numEncodeFields; ++i) {
+            sendStream.write(i);
+        }
+        sendStream.writeBit(true);
+    });
+    benchmark("  reserve", numIters, {
+        sendBuf.clear();
+        BitStream sendStream(sendBuf);
+        sendStream.reserve(numEncodeFields * 32 + 1);
+        for (uint32_t i = 0; i < numEncodeFields; ++i) {
+            sendStream.write(i);
+        }
+        sendStream.writeBit(true);
+        sendStream.trimToPos();
+    });
+
+    benchKeep(field);
+    benchKeep(buf[0]);
+    benchKeep(sendBuf[0]);
+}
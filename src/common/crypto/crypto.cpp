@@ -1,37 +1,48 @@
 #include <array>
-#include <iostream>
 #include <vector>
 #include "crypto.h"
 #include "md5mac.h"
+#include "common/log.h"
 
 bool calcMD5MAC(const std::vector<uint8_t>& key, const std::vector<uint8_t>& msg, std::vector<uint8_t>& outBuf) {
-    std::array<byte, CryptoPP::MD5MAC::DIGESTSIZE> digest;
+    return calcMD5MAC(key, msg.data(), msg.size(), outBuf.data(), outBuf.size());
+}
 
+bool calcMD5MAC(const std::vector<uint8_t>& key, const uint8_t* msg, size_t msgLen, uint8_t* outBuf, size_t outLen) {
     if (key.size() < 16) {
-        std::cout << "MD5MAC key too short!" << std::endl;
+        LOG(LC_Crypto, LL_Warning) << "MD5MAC key too short!";
         return false;
     }
 
     CryptoPP::MD5MAC mac(key.data());
-    mac.Update(msg.data(), msg.size());
+    return calcMD5MAC(mac, msg, msgLen, outBuf, outLen);
+}
+
+bool calcMD5MAC(CryptoPP::MD5MAC& mac, const uint8_t* msg, size_t msgLen, uint8_t* outBuf, size_t outLen) {
+    std::array<byte, CryptoPP::MD5MAC::DIGESTSIZE> digest;
+
+    // Final restarts the MAC from its keyed state, so it can be reused without rekeying
+    mac.Update(msg, msgLen);
     mac.Final(digest.data());
 
-    for (size_t i = 0; i < outBuf.size(); i += CryptoPP::MD5MAC::DIGESTSIZE) {
-        std::copy(digest.begin(), digest.begin() + std::min((size_t)CryptoPP::MD5MAC::DIGESTSIZE, outBuf.size() - i), outBuf.begin() + i);
+    for (size_t i = 0; i < outLen; i += CryptoPP::MD5MAC::DIGESTSIZE) {
+        std::copy(digest.begin(), digest.begin() + std::min((size_t)CryptoPP::MD5MAC::DIGESTSIZE, outLen - i), outBuf + i);
     }
+
+    return true;
 }
 
 /**
  * Makes sure that the input and output buffers are valid for RC5 usage.
  */
-bool checkRC5Buffers(const std::vector<uint8_t>& msg, const std::vector<uint8_t>& outBuf) {
-    if (msg.size() % CryptoPP::RC5::BLOCKSIZE != 0) {
-        std::cout << "RC5 content size must be a multiple of the RC5 block size!" << std::endl;
+bool checkRC5Buffers(size_t msgLen, size_t outLen) {
+    if (msgLen % CryptoPP::RC5::BLOCKSIZE != 0) {
+        LOG(LC_Crypto, LL_Warning) << "RC5 content size must be a multiple of the RC5 block size!";
         return false;
     }
 
-    if (outBuf.size() < msg.size()) {
-        std::cout << "Not enough space in output buffer for RC5 decryption!" << std::endl;
+    if (outLen < msgLen) {
+        LOG(LC_Crypto, LL_Warning) << "Not enough space in output buffer for RC5 decryption!";
         return false;
     }
 
@@ -39,25 +50,53 @@ bool checkRC5Buffers(const std::vector<uint8_t>& msg, const std::vector<uint8_t>
 }
 
 bool decryptRC5(const CryptoPP::RC5::Decryption& decryptor, const std::vector<uint8_t>& msg, std::vector<uint8_t>& outBuf) {
-    if (!checkRC5Buffers(msg, outBuf)) {
+    return decryptRC5(decryptor, msg.data(), msg.size(), outBuf.data(), outBuf.size());
+}
+
+bool decryptRC5(const CryptoPP::RC5::Decryption& decryptor, const uint8_t* msg, size_t msgLen, uint8_t* outBuf, size_t outLen) {
+    if (!checkRC5Buffers(msgLen, outLen)) {
         return false;
     }
 
-    for (int i = 0; i < msg.size(); i += decryptor.BlockSize()) {
-        decryptor.ProcessAndXorBlock(msg.data() + i, NULL, outBuf.data() + i);
+    for (size_t i = 0; i < msgLen; i += decryptor.BlockSize()) {
+        decryptor.ProcessAndXorBlock(msg + i, NULL, outBuf + i);
+    }
+
+    return true;
+}
+
+bool decryptRC5(const RC5Blocks& rc5, const uint8_t* msg, size_t msgLen, uint8_t* outBuf, size_t outLen) {
+    if (!checkRC5Buffers(msgLen, outLen)) {
+        return false;
     }
 
+    rc5.decrypt(msg, outBuf, msgLen / CryptoPP::RC5::BLOCKSIZE);
+
     return true;
 }
 
 bool encryptRC5(const CryptoPP::RC5::Encryption& encryptor, const std::vector<uint8_t>& msg, std::vector<uint8_t>& outBuf) {
-    if (!checkRC5Buffers(msg, outBuf)) {
+    return encryptRC5(encryptor, msg.data(), msg.size(), outBuf.data(), outBuf.size());
+}
+
+bool encryptRC5(const CryptoPP::RC5::Encryption& encryptor, const uint8_t* msg, size_t msgLen, uint8_t* outBuf, size_t outLen) {
+    if (!checkRC5Buffers(msgLen, outLen)) {
         return false;
     }
 
-    for (int i = 0; i < msg.size(); i += encryptor.BlockSize()) {
-        encryptor.ProcessAndXorBlock(msg.data() + i, NULL, outBuf.data() + i);
+    for (size_t i = 0; i < msgLen; i += encryptor.BlockSize()) {
+        encryptor.ProcessAndXorBlock(msg + i, NULL, outBuf + i);
     }
 
     return true;
 }
+
+bool encryptRC5(const RC5Blocks& rc5, const uint8_t* msg, size_t msgLen, uint8_t* outBuf, size_t outLen) {
+    if (!checkRC5Buffers(msgLen, outLen)) {
+        return false;
+    }
+
+    rc5.encrypt(msg, outBuf, msgLen / CryptoPP::RC5::BLOCKSIZE);
+
+    return true;
+}
@@ -1,20 +1,33 @@
 #pragma once
 
 #include <vector>
+#include "md5mac.h"
 #include "rc5.h"
+#include "rc5_blocks.h"
 
 /**
  * Calculates the MD5-MAC of a message.
  * Completely fills the output buffer by repeating the MAC digest.
  */
 bool calcMD5MAC(const std::vector<uint8_t>& key, const std::vector<uint8_t>& msg, std::vector<uint8_t>& outBuf);
+bool calcMD5MAC(const std::vector<uint8_t>& key, const uint8_t* msg, size_t msgLen, uint8_t* outBuf, size_t outLen);
+
+/**
+ * Calculates the MD5-MAC of a message with an already keyed MAC, skipping the key schedule.
+ * The MAC is left back in its keyed state, ready for the next message.
+ */
+bool calcMD5MAC(CryptoPP::MD5MAC& mac, const uint8_t* msg, size_t msgLen, uint8_t* outBuf, size_t outLen);
 
 /**
  * Decrypts an RC5 message.
  */
 bool decryptRC5(const CryptoPP::RC5::Decryption& decryptor, const std::vector<uint8_t>& msg, std::vector<uint8_t>& outBuf);
+bool decryptRC5(const CryptoPP::RC5::Decryption& decryptor, const uint8_t* msg, size_t msgLen, uint8_t* outBuf, size_t outLen);
+bool decryptRC5(const RC5Blocks& rc5, const uint8_t* msg, size_t msgLen, uint8_t* outBuf, size_t outLen);
 
 /**
  * Encrypts an RC5 message.
  */
 bool encryptRC5(const CryptoPP::RC5::Encryption& encryptor, const std::vector<uint8_t>& msg, std::vector<uint8_t>& outBuf);
+bool encryptRC5(const CryptoPP::RC5::Encryption& encryptor, const uint8_t* msg, size_t msgLen, uint8_t* outBuf, size_t outLen);
+bool encryptRC5(const RC5Blocks& rc5, const uint8_t* msg, size_t msgLen, uint8_t* outBuf, size_t outLen);
@@ -0,0 +1,104 @@
+#include <vector>
+#include "crypto.h"
+#include "crypto_test.h"
+#include "rc5.h"
+#include "rc5_blocks.h"
+#include "common/bench.h"
+#include "common/log.h"
+#include "common/test.h"
+#include "common/util.h"
+
+std::vector<uint8_t> makeTestBlocks(size_t numBlocks) {
+    std::vector<uint8_t> blocks(numBlocks * CryptoPP::RC5::BLOCKSIZE);
+    for (size_t i = 0; i < blocks.size(); ++i) {
+        blocks[i] = (uint8_t)(i * 37 + 11);
+    }
+
+    return blocks;
+}
+
+void testRC5BlocksKnownAnswers() {
+    // RC5-32/12/16 examples from Rivest's RC5 paper, each encrypting the previous ciphertext
+    static std::vector<uint8_t> key1(16, 0x00);
+    static std::vector<uint8_t> key2 = hexToBytes("915F4619BE41B2516355A50110A9CE91");
+    static std::vector<uint8_t> expected1 = hexToBytes("21A5DBEE154B8F6D");
+    static std::vector<uint8_t> expected2 = hexToBytes("F7C013AC5B2B8952");
+
+    RC5Blocks rc5;
+    std::vector<uint8_t> block(8, 0x00);
+
+    rc5.setKey(key1.data(), key1.size(), 12);
+    rc5.encryptScalar(block.data(), block.data(), 1);
+    assertBuffersEqual(block, expected1);
+
+    rc5.setKey(key2.data(), key2.size(), 12);
+    rc5.encryptScalar(block.data(), block.data(), 1);
+    assertBuffersEqual(block, expected2);
+
+    rc5.decryptScalar(block.data(), block.data(), 1);
+    assertBuffersEqual(block, expected1);
+}
+
+void testRC5BlocksMatchesCryptoPP() {
+    // Same shape of key as the session keys
+    static std::vector<uint8_t> key = hexToBytes("000102030405060708090A0B0C0D0E0F10111213");
+
+    // Not a multiple of 8 blocks, so both the vector and leftover paths are covered
+    std::vector<uint8_t> plaintext = makeTestBlocks(37);
+
+    RC5Blocks rc5;
+    rc5.setKey(key.data(), key.size());
+
+    CryptoPP::RC5::Encryption cryptoPPEnc;
+    cryptoPPEnc.SetKey(key.data(), key.size());
+    CryptoPP::RC5::Decryption cryptoPPDec;
+    cryptoPPDec.SetKey(key.data(), key.size());
+
+    std::vector<uint8_t> expected(plaintext.size());
+    encryptRC5(cryptoPPEnc, plaintext, expected);
+
+    std::vector<uint8_t> encrypted(plaintext.size());
+    rc5.encrypt(plaintext.data(), encrypted.data(), 37);
+    assertBuffersEqual(encrypted, expected);
+
+    std::vector<uint8_t> encryptedScalar(plaintext.size());
+    rc5.encryptScalar(plaintext.data(), encryptedScalar.data(), 37);
+    assertBuffersEqual(encryptedScalar, expected);
+
+    std::vector<uint8_t> decryptedCryptoPP(plaintext.size());
+    decryptRC5(cryptoPPDec, encrypted, decryptedCryptoPP);
+    assertBuffersEqual(decryptedCryptoPP, plaintext);
+
+    // In-place, as the session does it
+    rc5.decrypt(encrypted.data(), encrypted.data(), 37);
+    assertBuffersEqual(encrypted, plaintext);
+}
+
+void testCrypto() {
+    testRC5BlocksKnownAnswers();
+    testRC5BlocksMatchesCryptoPP();
+}
+
+void benchCrypto() {
+    static std::vector<uint8_t> key = hexToBytes("000102030405060708090A0B0C0D0E0F10111213");
+
+    // About the size of the ObjectCreateMessage sent on character select
+    std::vector<uint8_t> packet = makeTestBlocks(76);
+    size_t numBlocks = packet.size() / CryptoPP::RC5::BLOCKSIZE;
+
+    RC5Blocks rc5;
+    rc5.setKey(key.data(), key.size());
+
+    CryptoPP::RC5::Encryption cryptoPPEnc;
+    cryptoPPEnc.SetKey(key.data(), key.size());
+
+    size_t numPackets = 100000;
+    std::cout << "RC5 encrypt, " << packet.size() << " byte packet" << std::endl;
+    benchmark("  RC5Blocks::encrypt", numPackets,
+        rc5.encrypt(packet.data(), packet.data(), numBlocks));
+    benchmark("  RC5Blocks::encryptScalar", numPackets,
+        rc5.encryptScalar(packet.data(), packet.data(), numBlocks));
+    benchmark("  CryptoPP::RC5 per block (old)", numPackets,
+        encryptRC5(cryptoPPEnc, packet.data(), packet.size(), packet.data(), packet.size()));
+    benchKeep(packet[0]);
+}
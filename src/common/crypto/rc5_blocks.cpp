@@ -0,0 +1,181 @@
+#include <algorithm>
+#include <cstring>
+#include <vector>
+#include "rc5_blocks.h"
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+const uint32_t RC5_P32 = 0xB7E15163;
+const uint32_t RC5_Q32 = 0x9E3779B9;
+
+inline uint32_t rotateLeft(uint32_t value, uint32_t shift) {
+    shift &= 31;
+    return (value << shift) | (value >> ((32 - shift) & 31));
+}
+
+inline uint32_t rotateRight(uint32_t value, uint32_t shift) {
+    shift &= 31;
+    return (value >> shift) | (value << ((32 - shift) & 31));
+}
+
+// RC5 words are little endian regardless of platform
+inline uint32_t loadWord(const uint8_t* data) {
+    return (uint32_t)data[0] | ((uint32_t)data[1] << 8) | ((uint32_t)data[2] << 16) | ((uint32_t)data[3] << 24);
+}
+
+inline void storeWord(uint8_t* data, uint32_t value) {
+    data[0] = (uint8_t)value;
+    data[1] = (uint8_t)(value >> 8);
+    data[2] = (uint8_t)(value >> 16);
+    data[3] = (uint8_t)(value >> 24);
+}
+
+RC5Blocks::RC5Blocks() :
+    rounds(0) {
+
+}
+
+void RC5Blocks::setKey(const uint8_t* key, size_t keyLen, unsigned rounds) {
+    this->rounds = rounds;
+
+    size_t numKeyWords = std::max((size_t)1, (keyLen + 3) / 4);
+    std::vector<uint32_t> keyWords(numKeyWords, 0);
+    for (size_t i = 0; i < keyLen; ++i) {
+        keyWords[i / 4] |= (uint32_t)key[i] << (8 * (i % 4));
+    }
+
+    sTable.resize(2 * rounds + 2);
+    sTable[0] = RC5_P32;
+    for (size_t i = 1; i < sTable.size(); ++i) {
+        sTable[i] = sTable[i - 1] + RC5_Q32;
+    }
+
+    uint32_t a = 0;
+    uint32_t b = 0;
+    size_t i = 0;
+    size_t j = 0;
+    size_t numMixes = 3 * std::max(sTable.size(), numKeyWords);
+    for (size_t mix = 0; mix < numMixes; ++mix) {
+        a = sTable[i] = rotateLeft(sTable[i] + a + b, 3);
+        b = keyWords[j] = rotateLeft(keyWords[j] + a + b, a + b);
+        i = (i + 1) % sTable.size();
+        j = (j + 1) % numKeyWords;
+    }
+}
+
+void RC5Blocks::encryptScalar(const uint8_t* in, uint8_t* out, size_t numBlocks) const {
+    const uint32_t* s = sTable.data();
+
+    for (size_t block = 0; block < numBlocks; ++block) {
+        uint32_t a = loadWord(in + block * 8) + s[0];
+        uint32_t b = loadWord(in + block * 8 + 4) + s[1];
+
+        for (unsigned round = 1; round <= rounds; ++round) {
+            a = rotateLeft(a ^ b, b) + s[2 * round];
+            b = rotateLeft(b ^ a, a) + s[2 * round + 1];
+        }
+
+        storeWord(out + block * 8, a);
+        storeWord(out + block * 8 + 4, b);
+    }
+}
+
+void RC5Blocks::decryptScalar(const uint8_t* in, uint8_t* out, size_t numBlocks) const {
+    const uint32_t* s = sTable.data();
+
+    for (size_t block = 0; block < numBlocks; ++block) {
+        uint32_t a = loadWord(in + block * 8);
+        uint32_t b = loadWord(in + block * 8 + 4);
+
+        for (unsigned round = rounds; round >= 1; --round) {
+            b = rotateRight(b - s[2 * round + 1], a) ^ a;
+            a = rotateRight(a - s[2 * round], b) ^ b;
+        }
+
+        storeWord(out + block * 8, a - s[0]);
+        storeWord(out + block * 8 + 4, b - s[1]);
+    }
+}
+
+#ifdef __AVX2__
+// Variable shifts only look at the low 5 bits in scalar code, so mask the same way here
+inline __m256i rotateLeft8(__m256i value, __m256i shift) {
+    shift = _mm256_and_si256(shift, _mm256_set1_epi32(31));
+    return _mm256_or_si256(_mm256_sllv_epi32(value, shift), _mm256_srlv_epi32(value, _mm256_sub_epi32(_mm256_set1_epi32(32), shift)));
+}
+
+inline __m256i rotateRight8(__m256i value, __m256i shift) {
+    shift = _mm256_and_si256(shift, _mm256_set1_epi32(31));
+    return _mm256_or_si256(_mm256_srlv_epi32(value, shift), _mm256_sllv_epi32(value, _mm256_sub_epi32(_mm256_set1_epi32(32), shift)));
+}
+
+/**
+ * Loads 8 blocks, splitting them into a vector of A words and a vector of B words.
+ * The lane order is shuffled, but storeBlocks8 undoes it.
+ */
+inline void loadBlocks8(const uint8_t* in, __m256i& a, __m256i& b) {
+    __m256 lo = _mm256_castsi256_ps(_mm256_loadu_si256((const __m256i*)in));
+    __m256 hi = _mm256_castsi256_ps(_mm256_loadu_si256((const __m256i*)(in + 32)));
+    a = _mm256_castps_si256(_mm256_shuffle_ps(lo, hi, _MM_SHUFFLE(2, 0, 2, 0)));
+    b = _mm256_castps_si256(_mm256_shuffle_ps(lo, hi, _MM_SHUFFLE(3, 1, 3, 1)));
+}
+
+inline void storeBlocks8(uint8_t* out, __m256i a, __m256i b) {
+    _mm256_storeu_si256((__m256i*)out, _mm256_unpacklo_epi32(a, b));
+    _mm256_storeu_si256((__m256i*)(out + 32), _mm256_unpackhi_epi32(a, b));
+}
+#endif
+
+void RC5Blocks::encrypt(const uint8_t* in, uint8_t* out, size_t numBlocks) const {
+    size_t block = 0;
+
+#ifdef __AVX2__
+    const uint32_t* s = sTable.data();
+
+    for (; block + 8 <= numBlocks; block += 8) {
+        __m256i a;
+        __m256i b;
+        loadBlocks8(in + block * 8, a, b);
+
+        a = _mm256_add_epi32(a, _mm256_set1_epi32(s[0]));
+        b = _mm256_add_epi32(b, _mm256_set1_epi32(s[1]));
+
+        for (unsigned round = 1; round <= rounds; ++round) {
+            a = _mm256_add_epi32(rotateLeft8(_mm256_xor_si256(a, b), b), _mm256_set1_epi32(s[2 * round]));
+            b = _mm256_add_epi32(rotateLeft8(_mm256_xor_si256(b, a), a), _mm256_set1_epi32(s[2 * round + 1]));
+        }
+
+        storeBlocks8(out + block * 8, a, b);
+    }
+#endif
+
+    encryptScalar(in + block * 8, out + block * 8, numBlocks - block);
+}
+
+void RC5Blocks::decrypt(const uint8_t* in, uint8_t* out, size_t numBlocks) const {
+    size_t block = 0;
+
+#ifdef __AVX2__
+    const uint32_t* s = sTable.data();
+
+    for (; block + 8 <= numBlocks; block += 8) {
+        __m256i a;
+        __m256i b;
+        loadBlocks8(in + block * 8, a, b);
+
+        for (unsigned round = rounds; round >= 1; --round) {
+            b = _mm256_xor_si256(rotateRight8(_mm256_sub_epi32(b, _mm256_set1_epi32(s[2 * round + 1])), a), a);
+            a = _mm256_xor_si256(rotateRight8(_mm256_sub_epi32(a, _mm256_set1_epi32(s[2 * round])), b), b);
+        }
+
+        a = _mm256_sub_epi32(a, _mm256_set1_epi32(s[0]));
+        b = _mm256_sub_epi32(b, _mm256_set1_epi32(s[1]));
+
+        storeBlocks8(out + block * 8, a, b);
+    }
+#endif
+
+    decryptScalar(in + block * 8, out + block * 8, numBlocks - block);
+}
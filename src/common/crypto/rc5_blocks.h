@@ -0,0 +1,42 @@
+#pragma once
+
+#include <vector>
+#include "rc5.h"
+
+/**
+ * RC5-32 in ECB mode over many blocks per call, instead of one virtual call per 8-byte block.
+ * Gives the same output as CryptoPP::RC5 for the same key and rounds.
+ * Uses AVX2 to work on 8 blocks at a time when built with it, and plain C++ otherwise.
+ */
+class RC5Blocks {
+public:
+    RC5Blocks();
+
+    /**
+     * Expands the key. Must be called before encrypting or decrypting.
+     */
+    void setKey(const uint8_t* key, size_t keyLen, unsigned rounds = CryptoPP::RC5::DEFAULT_ROUNDS);
+
+    /**
+     * Encrypts numBlocks 8-byte blocks. in and out may be the same buffer.
+     */
+    void encrypt(const uint8_t* in, uint8_t* out, size_t numBlocks) const;
+
+    /**
+     * Decrypts numBlocks 8-byte blocks. in and out may be the same buffer.
+     */
+    void decrypt(const uint8_t* in, uint8_t* out, size_t numBlocks) const;
+
+    /**
+     * The portable versions of encrypt and decrypt, used for blocks left over from the vector path.
+     * Exposed so tests and benchmarks can compare against them.
+     */
+    void encryptScalar(const uint8_t* in, uint8_t* out, size_t numBlocks) const;
+    void decryptScalar(const uint8_t* in, uint8_t* out, size_t numBlocks) const;
+
+private:
+    unsigned rounds;
+
+    // Expanded key table, 2 * rounds + 2 words
+    std::vector<uint32_t> sTable;
+};
@@ -0,0 +1,71 @@
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "dh_key_pool.h"
+#include "integer.h"
+#include "session.h"
+
+DHKeyPool::DHKeyPool(const CryptoPP::Integer& p, const CryptoPP::Integer& g, size_t numKeys) :
+    p(p),
+    g(g),
+    numKeys(numKeys),
+    stopping(false) {
+    fillThread = std::thread([this]() {
+        fill();
+    });
+}
+
+DHKeyPool::~DHKeyPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    needsFill.notify_all();
+
+    fillThread.join();
+}
+
+bool DHKeyPool::take(const CryptoPP::Integer& p, const CryptoPP::Integer& g, std::vector<uint8_t>& privKey, std::vector<uint8_t>& pubKey) {
+    if (!(p == this->p && g == this->g)) {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+
+    // Every take leaves the pool short of numKeys, so let the fill thread know
+    needsFill.notify_one();
+
+    if (keys.empty()) {
+        return false;
+    }
+
+    privKey = std::move(keys.front().privKey);
+    pubKey = std::move(keys.front().pubKey);
+    keys.pop_front();
+
+    return true;
+}
+
+void DHKeyPool::fill() {
+    std::unique_lock<std::mutex> lock(mutex);
+
+    while (true) {
+        needsFill.wait(lock, [this]() {
+            return stopping || keys.size() < numKeys;
+        });
+
+        if (stopping) {
+            return;
+        }
+
+        // Generate with the mutex released so takes aren't held up
+        lock.unlock();
+        KeyPair keyPair;
+        Session::generateKeyPair(p, g, keyPair.privKey, keyPair.pubKey);
+        lock.lock();
+
+        keys.push_back(std::move(keyPair));
+    }
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "integer.h"
+
+/**
+ * Keeps ready-made Diffie-Hellman key pairs for one (p, g) group, so a handshake can pop a key instead of generating one.
+ * A background thread tops the pool back up to numKeys whenever it runs low.
+ *
+ * Only the group the pool is made with is pooled. Clients choose p and g, so pooling whatever groups they ask for
+ * would let any client fill the pool with junk groups and crowd out the one stock clients use.
+ */
+class DHKeyPool {
+public:
+    DHKeyPool(const CryptoPP::Integer& p, const CryptoPP::Integer& g, size_t numKeys);
+
+    ~DHKeyPool();
+
+    /**
+     * Takes a key pair for the given group.
+     * @return True if a key pair was available, false if the caller needs to generate its own (including for any other group).
+     */
+    bool take(const CryptoPP::Integer& p, const CryptoPP::Integer& g, std::vector<uint8_t>& privKey, std::vector<uint8_t>& pubKey);
+
+private:
+    struct KeyPair {
+        std::vector<uint8_t> privKey;
+        std::vector<uint8_t> pubKey;
+    };
+
+    /**
+     * Generates key pairs whenever the pool is below numKeys, until the pool is destroyed.
+     */
+    void fill();
+
+    const CryptoPP::Integer p;
+    const CryptoPP::Integer g;
+    size_t numKeys;
+
+    std::mutex mutex;
+    std::condition_variable needsFill;
+    std::deque<KeyPair> keys;
+    bool stopping;
+    std::thread fillThread;
+};
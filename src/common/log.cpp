@@ -1,7 +1,269 @@
+#include <algorithm>
+#include <atomic>
 #include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <ostream>
+#include <streambuf>
 #include <string>
 #include <vector>
 #include "log.h"
+#include "log_sink.h"
+
+// The SSSE3 hex path is compiled on every x86 build, and picked at runtime on CPUs that support it
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define PSEMU_HEX_SSSE3
+#define PSEMU_TARGET_SSSE3 __attribute__((target("ssse3")))
+#include <tmmintrin.h>
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#define PSEMU_HEX_SSSE3
+#define PSEMU_TARGET_SSSE3
+#include <intrin.h>
+#include <tmmintrin.h>
+#endif
+
+// Per-packet logging is opt-in, everything else is shown by default
+std::atomic<int> logLevels[LC_NumCategories] = {
+    { LL_Info },
+    { LL_Info },
+    { LL_Info },
+    { LL_Info }
+};
+
+void setLogLevel(LogCategory category, LogLevel level) {
+    logLevels[category].store(level, std::memory_order_relaxed);
+}
+
+void setLogLevel(LogLevel level) {
+    for (auto& categoryLevel : logLevels) {
+        categoryLevel.store(level, std::memory_order_relaxed);
+    }
+}
+
+std::atomic<LogSink*> logSink(nullptr);
+
+void setLogSink(LogSink* sink) {
+    logSink.store(sink, std::memory_order_release);
+}
+
+/**
+ * Writes into a fixed buffer, failing once it's full rather than growing.
+ */
+class LogStreamBuf : public std::streambuf {
+public:
+    void reset(char* buf, size_t size) {
+        setp(buf, buf + size);
+    }
+
+    size_t getSize() const {
+        return pptr() - pbase();
+    }
+
+protected:
+    int_type overflow(int_type /*ch*/) override {
+        return traits_type::eof();
+    }
+};
+
+/**
+ * Reused for every line a thread logs, so that formatting a line doesn't construct a stream or allocate.
+ */
+struct LogThreadState {
+    LogThreadState() :
+        stream(&buf) {
+
+    }
+
+    LogStreamBuf buf;
+    std::ostream stream;
+    // Used when there's no sink
+    char stdoutLine[LogSink::LINE_SIZE];
+};
+
+thread_local LogThreadState logThreadState;
+
+LogLine::LogLine(LogLevel level) :
+    level(level),
+    sink(logSink.load(std::memory_order_acquire)),
+    ticket(0),
+    line(nullptr) {
+    line = sink != nullptr ? sink->claim(ticket) : logThreadState.stdoutLine;
+
+    // Clear anything (such as std::hex) left over from the last line
+    std::ostream& stream = logThreadState.stream;
+    stream.clear();
+    stream.flags(std::ios_base::dec | std::ios_base::skipws);
+    stream.fill(' ');
+    stream.width(0);
+    stream.precision(6);
+
+    if (line == nullptr) {
+        // Dropped, so make streaming into it do nothing
+        logThreadState.buf.reset(nullptr, 0);
+        stream.setstate(std::ios_base::badbit);
+        return;
+    }
+
+    // -1 to always leave room for the newline
+    logThreadState.buf.reset(line, LogSink::LINE_SIZE - 1);
+}
+
+LogLine::~LogLine() {
+    if (line == nullptr) {
+        return;
+    }
+
+    size_t len = logThreadState.buf.getSize();
+
+    // Mark lines that were cut short
+    if (logThreadState.stream.bad() && len >= 3) {
+        memcpy(line + len - 3, "...", 3);
+    }
+
+    line[len++] = '\n';
+
+    if (sink != nullptr) {
+        sink->publish(ticket, len);
+        return;
+    }
+
+    std::cout.write(line, len);
+    if (level >= LL_Error) {
+        std::cout.flush();
+    }
+}
+
+std::ostream& LogLine::stream() {
+    return logThreadState.stream;
+}
+
+/**
+ * The " XX" rendering of every byte value.
+ */
+struct HexTable {
+    HexTable() {
+        static const char digits[] = "0123456789ABCDEF";
+
+        for (int byte = 0; byte < 256; ++byte) {
+            triplets[byte][0] = ' ';
+            triplets[byte][1] = digits[byte >> 4];
+            triplets[byte][2] = digits[byte & 0xF];
+        }
+    }
+
+    char triplets[256][3];
+};
+
+#ifdef PSEMU_HEX_SSSE3
+/**
+ * @return Whether the CPU supports SSSE3
+ */
+bool cpuHasSSSE3() {
+#ifdef _MSC_VER
+    int info[4];
+    __cpuid(info, 1);
+    return (info[2] & (1 << 9)) != 0;
+#else
+    return __builtin_cpu_supports("ssse3");
+#endif
+}
+
+/**
+ * Renders 16 bytes into 48 chars, looking up both nibbles of every byte at once,
+ * then spreading the digits out into " XX" triplets with byte shuffles.
+ */
+PSEMU_TARGET_SSSE3 inline void renderHex16(const uint8_t* data, char* out) {
+    const __m128i digits = _mm_setr_epi8('0', '1', '2', '3', '4', '5', '6', '7', '8', '9', 'A', 'B', 'C', 'D', 'E', 'F');
+    const __m128i lowNibbleMask = _mm_set1_epi8(0x0F);
+
+    __m128i bytes = _mm_loadu_si128((const __m128i*)data);
+    __m128i highDigits = _mm_shuffle_epi8(digits, _mm_and_si128(_mm_srli_epi16(bytes, 4), lowNibbleMask));
+    __m128i lowDigits = _mm_shuffle_epi8(digits, _mm_and_si128(bytes, lowNibbleMask));
+
+    // Output char k is part of byte k / 3's triplet: a space, then the high digit, then the low digit.
+    // -1 (0x80) makes the shuffle produce 0 for that position
+    const __m128i highShuffles[3] = {
+        _mm_setr_epi8(-1, 0, -1, -1, 1, -1, -1, 2, -1, -1, 3, -1, -1, 4, -1, -1),
+        _mm_setr_epi8(5, -1, -1, 6, -1, -1, 7, -1, -1, 8, -1, -1, 9, -1, -1, 10),
+        _mm_setr_epi8(-1, -1, 11, -1, -1, 12, -1, -1, 13, -1, -1, 14, -1, -1, 15, -1)
+    };
+    const __m128i lowShuffles[3] = {
+        _mm_setr_epi8(-1, -1, 0, -1, -1, 1, -1, -1, 2, -1, -1, 3, -1, -1, 4, -1),
+        _mm_setr_epi8(-1, 5, -1, -1, 6, -1, -1, 7, -1, -1, 8, -1, -1, 9, -1, -1),
+        _mm_setr_epi8(10, -1, -1, 11, -1, -1, 12, -1, -1, 13, -1, -1, 14, -1, -1, 15)
+    };
+    const __m128i spaces[3] = {
+        _mm_setr_epi8(' ', 0, 0, ' ', 0, 0, ' ', 0, 0, ' ', 0, 0, ' ', 0, 0, ' '),
+        _mm_setr_epi8(0, 0, ' ', 0, 0, ' ', 0, 0, ' ', 0, 0, ' ', 0, 0, ' ', 0),
+        _mm_setr_epi8(0, ' ', 0, 0, ' ', 0, 0, ' ', 0, 0, ' ', 0, 0, ' ', 0, 0)
+    };
+
+    for (int i = 0; i < 3; ++i) {
+        __m128i chars = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(highDigits, highShuffles[i]), _mm_shuffle_epi8(lowDigits, lowShuffles[i])), spaces[i]);
+        _mm_storeu_si128((__m128i*)(out + i * 16), chars);
+    }
+}
+
+/**
+ * Renders as many whole 16 byte blocks as there are.
+ * @return The number of bytes rendered
+ */
+PSEMU_TARGET_SSSE3 size_t renderHexBlocks(const uint8_t* data, size_t len, char* out) {
+    size_t i = 0;
+    for (; i + 16 <= len; i += 16) {
+        renderHex16(data + i, out + i * 3);
+    }
+
+    return i;
+}
+#endif
+
+void renderHexScalar(const uint8_t* data, size_t len, char* out) {
+    static const HexTable table;
+
+    for (size_t i = 0; i < len; ++i) {
+        memcpy(out + i * 3, table.triplets[data[i]], 3);
+    }
+}
+
+bool renderHexSSSE3(const uint8_t* data, size_t len, char* out) {
+#ifdef PSEMU_HEX_SSSE3
+    static const bool hasSSSE3 = cpuHasSSSE3();
+    if (!hasSSSE3) {
+        return false;
+    }
+
+    size_t numRendered = renderHexBlocks(data, len, out);
+    renderHexScalar(data + numRendered, len - numRendered, out + numRendered * 3);
+    return true;
+#else
+    return false;
+#endif
+}
+
+void renderHex(const uint8_t* data, size_t len, char* out) {
+    if (len < 16 || !renderHexSSSE3(data, len, out)) {
+        renderHexScalar(data, len, out);
+    }
+}
+
+std::ostream& operator<<(std::ostream& stream, const HexDump& dump) {
+    // Render in chunks on the stack, so a dump goes straight into the line without allocating
+    char buf[64 * 3];
+    for (size_t i = 0; i < dump.len; i += 64) {
+        size_t chunkLen = std::min((size_t)64, dump.len - i);
+        renderHex(dump.data + i, chunkLen, buf);
+        stream.write(buf, chunkLen * 3);
+    }
+
+    return stream;
+}
+
+std::ostream& operator<<(std::ostream& stream, const AsciiDump& dump) {
+    stream.write((const char*)dump.data, dump.len);
+
+    return stream;
+}
 
 std::string strAscii(const std::vector<uint8_t>& data) {
     return strAscii(data.begin(), data.end());
@@ -23,14 +285,8 @@ std::string strHex(const std::vector<uint8_t>& data) {
 }
 
 std::string strHex(const uint8_t* data, size_t len) {
-    std::string result;
-    result.reserve(len * 3);
-
-    char buf[4];
-    for (size_t i = 0; i < len; ++i) {
-        sprintf(buf, " %02X", data[i]);
-        result += buf;
-    }
+    std::string result(len * 3, ' ');
+    renderHex(data, len, &result[0]);
 
     return result;
 }
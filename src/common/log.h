@@ -1,8 +1,141 @@
 #pragma once
 
+#include <array>
+#include <atomic>
+#include <ostream>
 #include <string>
 #include <vector>
 
+enum LogLevel {
+    LL_Trace,
+    LL_Debug,
+    LL_Info,
+    LL_Warning,
+    LL_Error,
+    LL_None
+};
+
+enum LogCategory {
+    LC_Server,
+    LC_Session,
+    LC_Crypto,
+    LC_Packet,
+    LC_NumCategories
+};
+
+// Statements below this level are compiled out entirely. Release builds drop the per-packet debug and trace logging
+#ifndef PSEMU_LOG_COMPILE_LEVEL
+#ifdef NDEBUG
+#define PSEMU_LOG_COMPILE_LEVEL LL_Info
+#else
+#define PSEMU_LOG_COMPILE_LEVEL LL_Trace
+#endif
+#endif
+
+/**
+ * Logs a line to a category, used like a stream: LOG(LC_Server, LL_Info) << "Listening on " << port;
+ * When the level is disabled, the rest of the statement (including any formatting) is never evaluated.
+ */
+#define LOG(category, level) \
+    if ((level) < PSEMU_LOG_COMPILE_LEVEL || !isLogEnabled(category, level)) {} else LogLine(level).stream()
+
+extern std::atomic<int> logLevels[LC_NumCategories];
+
+/**
+ * @return Whether a level is enabled for a category at runtime.
+ */
+inline bool isLogEnabled(LogCategory category, LogLevel level) {
+    return level >= logLevels[category].load(std::memory_order_relaxed);
+}
+
+/**
+ * Sets the minimum runtime level for a category. Can't enable anything below PSEMU_LOG_COMPILE_LEVEL.
+ */
+void setLogLevel(LogCategory category, LogLevel level);
+
+/**
+ * Sets the minimum runtime level for every category.
+ */
+void setLogLevel(LogLevel level);
+
+class LogSink;
+
+/**
+ * Sends all log lines to a sink instead of stdout. The sink must outlive any logging.
+ * Pass nullptr to go back to stdout.
+ */
+void setLogSink(LogSink* sink);
+
+/**
+ * Formats a single log line in place, either straight into a LogSink slot or a per-thread buffer, and writes it out when destroyed.
+ * Lines too long for a slot are truncated. Only constructed by LOG once the level is known to be enabled.
+ */
+class LogLine {
+public:
+    LogLine(LogLevel level);
+
+    ~LogLine();
+
+    std::ostream& stream();
+
+private:
+    LogLevel level;
+    LogSink* sink;
+    size_t ticket;
+    // Where the line is being formatted, or nullptr if it's being dropped
+    char* line;
+};
+
+/**
+ * Renders bytes as hex, 3 chars per byte (" XX"), into out. Doesn't allocate or null terminate.
+ * Table driven, with an SSSE3 path for long inputs on CPUs that support it.
+ */
+void renderHex(const uint8_t* data, size_t len, char* out);
+
+/**
+ * The two halves of renderHex, so tests can check one against the other on any build.
+ * renderHexSSSE3 renders nothing if the build or CPU doesn't support SSSE3.
+ * @return Whether renderHexSSSE3 rendered the bytes
+ */
+void renderHexScalar(const uint8_t* data, size_t len, char* out);
+bool renderHexSSSE3(const uint8_t* data, size_t len, char* out);
+
+/**
+ * Streams a buffer as hex without building an intermediate string.
+ */
+struct HexDump {
+    const uint8_t* data;
+    size_t len;
+};
+
+/**
+ * Streams a buffer as ASCII without building an intermediate string.
+ */
+struct AsciiDump {
+    const uint8_t* data;
+    size_t len;
+};
+
+std::ostream& operator<<(std::ostream& stream, const HexDump& dump);
+std::ostream& operator<<(std::ostream& stream, const AsciiDump& dump);
+
+inline HexDump hexDump(const uint8_t* data, size_t len) {
+    return HexDump{ data, len };
+}
+
+inline HexDump hexDump(const std::vector<uint8_t>& data) {
+    return HexDump{ data.data(), data.size() };
+}
+
+template<size_t arraySize>
+HexDump hexDump(const std::array<uint8_t, arraySize>& data) {
+    return HexDump{ data.data(), data.size() };
+}
+
+inline AsciiDump asciiDump(const uint8_t* data, size_t len) {
+    return AsciiDump{ data, len };
+}
+
 template<typename Iterator>
 std::string strAscii(Iterator first, Iterator last) {
     std::string result;
@@ -24,15 +157,17 @@ std::string strAscii(const std::vector<uint8_t>& data);
 
 std::string strAscii(const uint8_t* data, size_t len);
 
+std::string strHex(const std::vector<uint8_t>& data);
+
+std::string strHex(const uint8_t* data, size_t len);
+
 template<typename Iterator>
 std::string strHex(Iterator first, Iterator last) {
-    std::string result;
-    result.reserve(std::distance(first, last) * 3);
+    std::string result(std::distance(first, last) * 3, ' ');
 
-    char buf[4];
-    for (; first != last; ++first) {
-        sprintf(buf, " %02X", *first);
-        result += buf;
+    for (size_t i = 0; first != last; ++first, ++i) {
+        uint8_t byte = (uint8_t)*first;
+        renderHex(&byte, 1, &result[i * 3]);
     }
 
     return result;
@@ -40,9 +175,5 @@ std::string strHex(Iterator first, Iterator last) {
 
 template<size_t arraySize>
 std::string strHex(const std::array<uint8_t, arraySize>& data) {
-    return strHex(data.begin(), data.end());
+    return strHex(data.data(), data.size());
 }
-
-std::string strHex(const std::vector<uint8_t>& data);
-
-std::string strHex(const uint8_t* data, size_t len);
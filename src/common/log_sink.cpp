@@ -0,0 +1,112 @@
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <thread>
+#include "log_sink.h"
+
+// How long the writer sleeps when there's nothing to write
+const std::chrono::milliseconds LOG_SINK_IDLE_SLEEP(2);
+
+LogSink::LogSink(FILE* file, size_t numSlots) :
+    file(file),
+    enqueuePos(0),
+    dequeuePos(0),
+    numDropped(0),
+    stopping(false) {
+    size_t capacity = 1;
+    while (capacity < numSlots) {
+        capacity <<= 1;
+    }
+
+    slots.reset(new Slot[capacity]);
+    mask = capacity - 1;
+    for (size_t i = 0; i < capacity; ++i) {
+        slots[i].sequence.store(i, std::memory_order_relaxed);
+    }
+
+    writer = std::thread([this]() {
+        write();
+    });
+}
+
+LogSink::~LogSink() {
+    stopping.store(true, std::memory_order_release);
+    writer.join();
+}
+
+char* LogSink::claim(size_t& ticket) {
+    size_t pos = enqueuePos.load(std::memory_order_relaxed);
+
+    while (true) {
+        Slot& slot = slots[pos & mask];
+        size_t sequence = slot.sequence.load(std::memory_order_acquire);
+        intptr_t diff = (intptr_t)sequence - (intptr_t)pos;
+
+        if (diff == 0) {
+            // Slot is free, try to take it before another producer does
+            if (enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                ticket = pos;
+                return slot.text;
+            }
+        } else if (diff < 0) {
+            // The writer hasn't freed this slot from the last time around, so the queue is full
+            numDropped.fetch_add(1, std::memory_order_relaxed);
+            return nullptr;
+        } else {
+            // Another producer took it, try the next one
+            pos = enqueuePos.load(std::memory_order_relaxed);
+        }
+    }
+}
+
+void LogSink::publish(size_t ticket, size_t len) {
+    Slot& slot = slots[ticket & mask];
+    slot.len = len;
+    slot.sequence.store(ticket + 1, std::memory_order_release);
+}
+
+size_t LogSink::getNumDropped() const {
+    return numDropped.load(std::memory_order_relaxed);
+}
+
+void LogSink::write() {
+    size_t numDroppedReported = 0;
+
+    while (true) {
+        // Check before draining, so that everything published before destruction still gets written
+        bool stop = stopping.load(std::memory_order_acquire);
+
+        size_t numWritten = 0;
+        while (true) {
+            Slot& slot = slots[dequeuePos & mask];
+            if (slot.sequence.load(std::memory_order_acquire) != dequeuePos + 1) {
+                break;
+            }
+
+            fwrite(slot.text, 1, slot.len, file);
+
+            // Free the slot for the producer that wraps around to it next
+            slot.sequence.store(dequeuePos + mask + 1, std::memory_order_release);
+            ++dequeuePos;
+            ++numWritten;
+        }
+
+        size_t curNumDropped = numDropped.load(std::memory_order_relaxed);
+        if (curNumDropped != numDroppedReported) {
+            fprintf(file, "Log queue full, dropped %zu lines\n", curNumDropped - numDroppedReported);
+            numDroppedReported = curNumDropped;
+            ++numWritten;
+        }
+
+        if (numWritten > 0) {
+            // One flush per batch rather than per line
+            fflush(file);
+        } else if (stop) {
+            return;
+        } else {
+            std::this_thread::sleep_for(LOG_SINK_IDLE_SLEEP);
+        }
+    }
+}
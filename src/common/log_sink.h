@@ -0,0 +1,70 @@
+#pragma once
+
+#include <atomic>
+#include <cstdio>
+#include <memory>
+#include <thread>
+
+/**
+ * A bounded, lock-free queue of log lines from any number of threads, written out to a file by a background thread.
+ * Lines are formatted straight into the queue's slots, so logging never allocates or blocks on I/O.
+ * When the queue is full, lines are dropped and counted instead.
+ */
+class LogSink {
+public:
+    // Longest line that fits in a slot, including the newline. Enough for a hex dump of a full-size packet
+    static const size_t LINE_SIZE = 2048;
+
+    /**
+     * @param numSlots Rounded up to a power of 2.
+     */
+    LogSink(FILE* file, size_t numSlots);
+
+    /**
+     * Writes out everything still queued before returning.
+     */
+    ~LogSink();
+
+    /**
+     * Claims a slot to format a line into. Every successful claim must be followed by a publish.
+     * @return A buffer of LINE_SIZE bytes, or nullptr if the queue is full and the line should be dropped.
+     */
+    char* claim(size_t& ticket);
+
+    /**
+     * Hands a claimed slot to the writer thread.
+     */
+    void publish(size_t ticket, size_t len);
+
+    /**
+     * @return How many lines have been dropped because the queue was full.
+     */
+    size_t getNumDropped() const;
+
+private:
+    struct Slot {
+        // Tells producers and the writer whose turn it is to use this slot
+        std::atomic<size_t> sequence;
+        size_t len;
+        char text[LINE_SIZE];
+    };
+
+    /**
+     * Writes published lines out in batches until the sink is destroyed.
+     */
+    void write();
+
+    FILE* file;
+
+    std::unique_ptr<Slot[]> slots;
+    size_t mask;
+
+    std::atomic<size_t> enqueuePos;
+    // Only touched by the writer thread
+    size_t dequeuePos;
+
+    std::atomic<size_t> numDropped;
+    std::atomic<bool> stopping;
+
+    std::thread writer;
+};
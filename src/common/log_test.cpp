@@ -0,0 +1,115 @@
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "bench.h"
+#include "log.h"
+#include "log_test.h"
+#include "test.h"
+#include "util.h"
+
+/**
+ * The old sprintf-based formatting, to check and benchmark against.
+ */
+std::string strHexSprintf(const uint8_t* data, size_t len) {
+    std::string result;
+    result.reserve(len * 3);
+
+    char buf[4];
+    for (size_t i = 0; i < len; ++i) {
+        sprintf(buf, " %02X", data[i]);
+        result += buf;
+    }
+
+    return result;
+}
+
+void testStrHex() {
+    std::vector<uint8_t> allBytes(256);
+    for (size_t i = 0; i < allBytes.size(); ++i) {
+        allBytes[i] = (uint8_t)i;
+    }
+
+    // Every length up to a few SIMD blocks, so that both the vector and leftover paths are covered
+    for (size_t len = 0; len <= 50; ++len) {
+        assertEqual(strHex(allBytes.data() + 200, len), strHexSprintf(allBytes.data() + 200, len));
+    }
+
+    assertEqual(strHex(allBytes), strHexSprintf(allBytes.data(), allBytes.size()));
+    assertEqual(strHex(allBytes.begin(), allBytes.begin() + 3), std::string(" 00 01 02"));
+}
+
+void testRenderHexPaths() {
+    std::vector<uint8_t> data(300);
+    for (size_t i = 0; i < data.size(); ++i) {
+        data[i] = (uint8_t)(i * 37 + 11);
+    }
+
+    // Called directly, since renderHex only takes the SSSE3 path on CPUs that have it
+    std::vector<char> scalar(data.size() * 3);
+    std::vector<char> simd(data.size() * 3);
+    for (size_t len = 0; len <= data.size(); len += 7) {
+        renderHexScalar(data.data(), len, scalar.data());
+        if (!renderHexSSSE3(data.data(), len, simd.data())) {
+            std::cout << "SSSE3 not supported, skipping its renderHex test" << std::endl;
+            return;
+        }
+
+        assertEqual(std::string(simd.data(), len * 3), std::string(scalar.data(), len * 3));
+        assertEqual(std::string(scalar.data(), len * 3), strHexSprintf(data.data(), len));
+    }
+}
+
+void testHexToBytes() {
+    static std::vector<uint8_t> expected = { 0x01, 0xAB, 0xCD, 0xEF, 0x90 };
+    assertBuffersEqual(hexToBytes("01ABcdef90"), expected);
+    assertBuffersEqual(hexToBytes(" 01 AB CD EF 90"), expected);
+
+    // Stops at the end of the output
+    uint8_t outBuf[2];
+    std::string hex = "01ABCDEF";
+    assertEqual(hexToBytes(hex.data(), hex.size(), outBuf, sizeof(outBuf)), (size_t)2);
+    assertEqual((int)outBuf[1], 0xAB);
+
+    // A dangling digit is ignored
+    assertEqual(hexToBytes("ABC").size(), (size_t)1);
+
+    std::vector<uint8_t> allBytes(256);
+    for (size_t i = 0; i < allBytes.size(); ++i) {
+        allBytes[i] = (uint8_t)i;
+    }
+    assertBuffersEqual(hexToBytes(strHex(allBytes)), allBytes);
+}
+
+void testLog() {
+    testStrHex();
+    testRenderHexPaths();
+    testHexToBytes();
+}
+
+void benchLog() {
+    // About the size of the ObjectCreateMessage dumped on character select
+    std::vector<uint8_t> packet(608);
+    for (size_t i = 0; i < packet.size(); ++i) {
+        packet[i] = (uint8_t)(i * 37 + 11);
+    }
+    std::string packetHex = strHex(packet);
+    std::vector<char> rendered(packet.size() * 3);
+    std::vector<uint8_t> parsed(packet.size());
+
+    size_t numDumps = 100000;
+    std::cout << "Hex, " << packet.size() << " byte packet" << std::endl;
+    benchmark("  renderHex", numDumps,
+        renderHex(packet.data(), packet.size(), rendered.data()));
+    benchmark("  renderHexScalar", numDumps,
+        renderHexScalar(packet.data(), packet.size(), rendered.data()));
+    benchmark("  strHex", numDumps,
+        benchKeep(strHex(packet).size()));
+    benchmark("  sprintf per byte (old)", numDumps,
+        benchKeep(strHexSprintf(packet.data(), packet.size()).size()));
+    benchmark("  hexToBytes into buffer", numDumps,
+        benchKeep(hexToBytes(packetHex.data(), packetHex.size(), parsed.data(), parsed.size())));
+    benchmark("  hexToBytes into vector", numDumps,
+        benchKeep(hexToBytes(packetHex).size()));
+    benchKeep(rendered[0]);
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+
+/**
+ * Routes packets to handlers by their one byte opcode with a single table lookup, and counts how many of each arrive.
+ * Handler is the function pointer type that handlers share, and dispatch passes its arguments straight through to it.
+ *
+ * Handlers are all added up front (before any dispatch), so lookups don't lock.
+ * Counts are relaxed atomics, since several server shards can dispatch through the same table at once.
+ * They're for diagnostics, so an increment may occasionally be lost when two shards count the same opcode at the same time.
+ */
+template<typename Handler>
+class OpcodeTable {
+public:
+    static const size_t NUM_OPCODES = 256;
+
+    OpcodeTable() {
+        for (auto& entry : entries) {
+            entry.handler = nullptr;
+            entry.name = nullptr;
+            entry.count.store(0, std::memory_order_relaxed);
+        }
+    }
+
+    /**
+     * Sets the handler for an opcode. The name must outlive the table (use OPCODE_TABLE_ADD to name it after the opcode).
+     */
+    void add(uint8_t opcode, const char* name, Handler handler) {
+        entries[opcode].handler = handler;
+        entries[opcode].name = name;
+    }
+
+    /**
+     * Counts the opcode, and calls its handler with the given arguments.
+     * @return Whether the opcode has a handler
+     */
+    template<typename... Args>
+    bool dispatch(uint8_t opcode, Args&&... args) {
+        Entry& entry = entries[opcode];
+        // A plain load and store rather than a locked add, which would cost more than the lookup itself
+        entry.count.store(entry.count.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+
+        if (entry.handler == nullptr) {
+            return false;
+        }
+
+        entry.handler(std::forward<Args>(args)...);
+        return true;
+    }
+
+    /**
+     * @return The name the opcode's handler was added with, or nullptr if it has no handler
+     */
+    const char* getName(uint8_t opcode) const {
+        return entries[opcode].name;
+    }
+
+    /**
+     * @return The number of times the opcode was dispatched, whether or not it has a handler
+     */
+    uint64_t getCount(uint8_t opcode) const {
+        return entries[opcode].count.load(std::memory_order_relaxed);
+    }
+
+private:
+    class Entry {
+    public:
+        Handler handler;
+        const char* name;
+        std::atomic<uint64_t> count;
+    };
+
+    std::array<Entry, NUM_OPCODES> entries;
+};
+
+#define OPCODE_TABLE_ADD(table, opcode, handler) (table).add(opcode, #opcode, handler)
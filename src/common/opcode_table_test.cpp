@@ -0,0 +1,103 @@
+#include <cstring>
+#include "bench.h"
+#include "opcode_table.h"
+#include "opcode_table_test.h"
+#include "test.h"
+
+namespace {
+
+enum TestOpcode : uint8_t {
+    OP_TestFirst = 0x00,
+    OP_TestSecond = 0x07,
+    OP_TestLast = 0xFF
+};
+
+typedef void(*TestHandler)(uint64_t& sum, uint8_t opcode);
+
+void addOpcode(uint64_t& sum, uint8_t opcode) {
+    sum += opcode;
+}
+
+void addDoubleOpcode(uint64_t& sum, uint8_t opcode) {
+    sum += 2 * opcode;
+}
+
+}
+
+void testOpcodeTableDispatch() {
+    OpcodeTable<TestHandler> table;
+    OPCODE_TABLE_ADD(table, OP_TestFirst, addOpcode);
+    OPCODE_TABLE_ADD(table, OP_TestSecond, addDoubleOpcode);
+    OPCODE_TABLE_ADD(table, OP_TestLast, addOpcode);
+
+    uint64_t sum = 1000;
+    assertEqual(table.dispatch(OP_TestFirst, sum, (uint8_t)OP_TestFirst), true);
+    assertEqual(sum, 1000);
+    assertEqual(table.dispatch(OP_TestSecond, sum, (uint8_t)OP_TestSecond), true);
+    assertEqual(sum, 1014);
+    assertEqual(table.dispatch(OP_TestLast, sum, (uint8_t)OP_TestLast), true);
+    assertEqual(sum, 1269);
+
+    // Unregistered opcodes don't call anything
+    assertEqual(table.dispatch(0x08, sum, (uint8_t)0x08), false);
+    assertEqual(sum, 1269);
+}
+
+void testOpcodeTableNamesAndCounts() {
+    OpcodeTable<TestHandler> table;
+    OPCODE_TABLE_ADD(table, OP_TestSecond, addOpcode);
+
+    assertEqual(std::strcmp(table.getName(OP_TestSecond), "OP_TestSecond"), 0);
+    assertEqual((table.getName(OP_TestFirst) == nullptr), true);
+
+    uint64_t sum = 0;
+    for (int i = 0; i < 3; ++i) {
+        table.dispatch(OP_TestSecond, sum, (uint8_t)OP_TestSecond);
+    }
+    table.dispatch(0x42, sum, (uint8_t)0x42);
+
+    // Unknown opcodes are counted too, so floods of them show up
+    assertEqual(table.getCount(OP_TestSecond), 3);
+    assertEqual(table.getCount(0x42), 1);
+    assertEqual(table.getCount(OP_TestFirst), 0);
+}
+
+void testOpcodeTable() {
+    testOpcodeTableDispatch();
+    testOpcodeTableNamesAndCounts();
+}
+
+void benchOpcodeTable() {
+    size_t numIters = 10000000;
+    uint64_t sum = 0;
+
+    // A mix of opcodes as they'd arrive, so the switch can't predict every branch
+    const uint8_t opcodes[] = { 0x01, 0x03, 0x09, 0x0A, 0x0B, 0x0D, 0x15, 0x19, 0x1A, 0x1E, 0x30, 0x31 };
+    const size_t numOpcodes = sizeof(opcodes) / sizeof(opcodes[0]);
+
+    OpcodeTable<TestHandler> table;
+    for (size_t i = 0; i < numOpcodes; ++i) {
+        table.add(opcodes[i], "op", (i & 1) ? addDoubleOpcode : addOpcode);
+    }
+
+    std::cout << "OpcodeTable" << std::endl;
+    benchmark("  table", numIters, {
+        uint8_t opcode = opcodes[(benchIter * 7) % numOpcodes];
+        table.dispatch(opcode, sum, opcode);
+    });
+    benchmark("  switch", numIters, {
+        uint8_t opcode = opcodes[(benchIter * 7) % numOpcodes];
+        switch (opcode) {
+        case 0x01: case 0x09: case 0x0B: case 0x15: case 0x1A: case 0x30:
+            addOpcode(sum, opcode);
+            break;
+        case 0x03: case 0x0A: case 0x0D: case 0x19: case 0x1E: case 0x31:
+            addDoubleOpcode(sum, opcode);
+            break;
+        default:
+            break;
+        }
+    });
+
+    benchKeep(sum);
+}
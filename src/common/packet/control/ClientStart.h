@@ -1,6 +1,7 @@
 #pragma once
 
 #include "common/bitstream.h"
+#include "common/packet/pkt_schema.h"
 
 class ClientStart {
 public:
@@ -8,11 +9,14 @@ public:
     uint32_t clientNonce;
     uint32_t unk1;
 
+    typedef PacketSchema<ClientStart,
+        PKT_FIELD(ClientStart, unk0),
+        PKT_FIELD(ClientStart, clientNonce),
+        PKT_FIELD(ClientStart, unk1)> Schema;
+
     static ClientStart decode(BitStream& bitStream) {
         ClientStart packet;
-        bitStream.read(packet.unk0);
-        bitStream.read(packet.clientNonce);
-        bitStream.read(packet.unk1);
+        Schema::decode(bitStream, packet);
         return packet;
     }
 };
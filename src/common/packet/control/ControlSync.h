@@ -1,6 +1,7 @@
 #pragma once
 
 #include "common/bitstream.h"
+#include "common/packet/pkt_schema.h"
 
 class ControlSync {
 public:
@@ -13,16 +14,19 @@ public:
     uint64_t field64A;
     uint64_t field64B;
 
+    typedef PacketSchema<ControlSync,
+        PKT_FIELD(ControlSync, timeDiff),
+        PKT_FIELD(ControlSync, unk),
+        PKT_FIELD(ControlSync, field1),
+        PKT_FIELD(ControlSync, field2),
+        PKT_FIELD(ControlSync, field3),
+        PKT_FIELD(ControlSync, field4),
+        PKT_FIELD(ControlSync, field64A),
+        PKT_FIELD(ControlSync, field64B)> Schema;
+
     static ControlSync decode(BitStream& bitStream) {
         ControlSync packet;
-        bitStream.read(packet.timeDiff);
-        bitStream.read(packet.unk);
-        bitStream.read(packet.field1);
-        bitStream.read(packet.field2);
-        bitStream.read(packet.field3);
-        bitStream.read(packet.field4);
-        bitStream.read(packet.field64A);
-        bitStream.read(packet.field64B);
+        Schema::decode(bitStream, packet);
         return packet;
     }
 };
@@ -2,6 +2,7 @@
 
 #include "opcodes.h"
 #include "common/bitstream.h"
+#include "common/packet/pkt_schema.h"
 
 class ControlSyncResp {
 public:
@@ -12,17 +13,24 @@ public:
     uint64_t field3;
     uint64_t field4;
 
+    typedef PacketSchema<ControlSyncResp,
+        PKT_FIELD(ControlSyncResp, timeDiff),
+        PKT_FIELD(ControlSyncResp, serverTick),
+        PKT_FIELD(ControlSyncResp, field1),
+        PKT_FIELD(ControlSyncResp, field2),
+        PKT_FIELD(ControlSyncResp, field3),
+        PKT_FIELD(ControlSyncResp, field4)> Schema;
+
+    size_t maxEncodedBits() const {
+        return 8 + 8 + Schema::encodedBits(*this);
+    }
+
     void encode(BitStream& bitStream) {
         uint8_t controlByte = 0x00;
         bitStream.write(controlByte);
         uint8_t opcode = OP_ControlSyncResp;
         bitStream.write(opcode);
 
-        bitStream.write(timeDiff);
-        bitStream.write(serverTick);
-        bitStream.write(field1);
-        bitStream.write(field2);
-        bitStream.write(field3);
-        bitStream.write(field4);
+        Schema::encode(bitStream, *this);
     }
 };
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <vector>
+#include "opcodes.h"
+#include "common/bitstream.h"
+
+/**
+ * Several packets sent in one datagram, each prefixed by its size.
+ * Sizes under 0xFF are one byte, otherwise 0xFF is followed by a 16-bit size, and 0xFFFF by a 32-bit size.
+ * OP_MultiPacket has the same layout, but only ever one byte sizes.
+ */
+class MultiPacketEx {
+public:
+    class InnerPacket {
+    public:
+        // Points into the decoded stream's buffer, so it is only valid for as long as that buffer is
+        uint8_t* data;
+        size_t size;
+    };
+
+    std::vector<InnerPacket> packets;
+
+    static MultiPacketEx decode(BitStream& bitStream) {
+        MultiPacketEx packet;
+        while (bitStream.getRemainingBytes() > 0) {
+            InnerPacket innerPacket;
+            innerPacket.size = readSize(bitStream);
+            innerPacket.data = bitStream.readView(innerPacket.size);
+            if (bitStream.getLastError() != BitStream::Error::NONE) {
+                break;
+            }
+
+            packet.packets.push_back(innerPacket);
+        }
+
+        return packet;
+    }
+
+    /**
+     * @return The number of bytes the size prefix of a packet takes
+     */
+    static size_t encodedSizeBytes(size_t size) {
+        return size < 0xFF ? 1 : (size < 0xFFFF ? 3 : 7);
+    }
+
+    static size_t readSize(BitStream& bitStream) {
+        uint8_t size8;
+        bitStream.read(size8);
+        if (size8 != 0xFF) {
+            return size8;
+        }
+
+        uint16_t size16;
+        bitStream.read(size16);
+        if (size16 != 0xFFFF) {
+            return size16;
+        }
+
+        uint32_t size32;
+        bitStream.read(size32);
+        return size32;
+    }
+
+    static void writeSize(BitStream& bitStream, size_t size) {
+        if (size < 0xFF) {
+            bitStream.write((uint8_t)size);
+            return;
+        }
+
+        bitStream.write((uint8_t)0xFF);
+        if (size < 0xFFFF) {
+            bitStream.write((uint16_t)size);
+            return;
+        }
+
+        bitStream.write((uint16_t)0xFFFF);
+        bitStream.write((uint32_t)size);
+    }
+};
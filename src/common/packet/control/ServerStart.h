@@ -3,6 +3,7 @@
 #include <array>
 #include "opcodes.h"
 #include "common/bitstream.h"
+#include "common/packet/pkt_schema.h"
 
 class ServerStart {
 public:
@@ -10,14 +11,21 @@ public:
     uint32_t serverNonce;
     std::array<uint8_t, 11> unk0;
 
+    typedef PacketSchema<ServerStart,
+        PKT_FIELD(ServerStart, clientNonce),
+        PKT_FIELD(ServerStart, serverNonce),
+        PKT_FIELD(ServerStart, unk0)> Schema;
+
+    size_t maxEncodedBits() const {
+        return 8 + 8 + Schema::encodedBits(*this);
+    }
+
     void encode(BitStream& bitStream) {
         uint8_t opcode = 0x00;
         bitStream.write(opcode);
         uint8_t controlOpcode = OP_ServerStart;
         bitStream.write(controlOpcode);
 
-        bitStream.write(clientNonce);
-        bitStream.write(serverNonce);
-        bitStream.write(unk0);
+        Schema::encode(bitStream, *this);
     }
 };
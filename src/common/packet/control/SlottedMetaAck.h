@@ -8,6 +8,18 @@ public:
     uint8_t slot;
     uint16_t subslot;
 
+    static SlottedMetaAck decode(BitStream& bitStream, uint8_t slot) {
+        SlottedMetaAck packet;
+        packet.slot = slot;
+        bitStream.read(packet.subslot);
+        return packet;
+    }
+
+    size_t maxEncodedBits() const {
+        return 8 + 8 +
+            BitStream::maxEncodedBits(subslot);
+    }
+
     void encode(BitStream& bitStream) {
         uint8_t opcode = 0x00;
         bitStream.write(opcode);
@@ -0,0 +1,34 @@
+#pragma once
+
+#include "opcodes.h"
+#include "common/bitstream.h"
+
+/**
+ * Asks for a slotted packet to be resent, since a later one arrived without it.
+ */
+class SlottedMetaNack {
+public:
+    uint8_t slot;
+    uint16_t subslot;
+
+    static SlottedMetaNack decode(BitStream& bitStream, uint8_t slot) {
+        SlottedMetaNack packet;
+        packet.slot = slot;
+        bitStream.read(packet.subslot);
+        return packet;
+    }
+
+    size_t maxEncodedBits() const {
+        return 8 + 8 +
+            BitStream::maxEncodedBits(subslot);
+    }
+
+    void encode(BitStream& bitStream) {
+        uint8_t opcode = 0x00;
+        bitStream.write(opcode);
+        uint8_t controlOpcode = OP_RelatedA0 + slot % 4;
+        bitStream.write(controlOpcode);
+
+        bitStream.write(subslot);
+    }
+};
@@ -1,22 +1,40 @@
 #pragma once
 
-#include <vector>
+#include "opcodes.h"
 #include "common/bitstream.h"
 
 class SlottedMetaPacket {
 public:
     uint8_t slot;
     uint16_t subslot;
-    std::vector<uint8_t> rest;
+    // Points into the decoded stream's buffer, so it is only valid for as long as that buffer is.
+    // Read only, so that encoding can point it at buffers that aren't the packet's to change, such as a retransmit's payload
+    const uint8_t* rest;
+    size_t restSize;
 
     static SlottedMetaPacket decode(BitStream& bitStream, uint8_t slot) {
         SlottedMetaPacket packet;
         packet.slot = slot;
         bitStream.read(packet.subslot);
 
-        size_t remainingBytes = bitStream.getRemainingBytes();
-        packet.rest.resize(remainingBytes);
-        bitStream.readBytes(packet.rest.data(), remainingBytes);
+        packet.restSize = bitStream.getRemainingBytes();
+        packet.rest = bitStream.readView(packet.restSize);
         return packet;
     }
+
+    size_t maxEncodedBits() const {
+        return 8 + 8 +
+            BitStream::maxEncodedBits(subslot) +
+            restSize * 8;
+    }
+
+    void encode(BitStream& bitStream) {
+        uint8_t opcode = 0x00;
+        bitStream.write(opcode);
+        uint8_t controlOpcode = OP_SlottedMetaPacket0 + slot % 8;
+        bitStream.write(controlOpcode);
+
+        bitStream.write(subslot);
+        bitStream.writeBytes(rest, restSize);
+    }
 };
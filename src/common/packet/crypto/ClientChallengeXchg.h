@@ -2,6 +2,7 @@
 
 #include <array>
 #include "common/bitstream.h"
+#include "common/packet/pkt_schema.h"
 
 class ClientChallengeXchg {
 public:
@@ -23,25 +24,28 @@ public:
     uint32_t unk3;
     uint8_t unkEnd2;
 
+    typedef PacketSchema<ClientChallengeXchg,
+        PKT_FIELD(ClientChallengeXchg, unk0),
+        PKT_FIELD(ClientChallengeXchg, unk1),
+        PKT_FIELD(ClientChallengeXchg, clientTime),
+        PKT_FIELD(ClientChallengeXchg, challenge),
+        PKT_FIELD(ClientChallengeXchg, unkEndChallenge),
+        PKT_FIELD(ClientChallengeXchg, unkObjects0),
+        PKT_FIELD(ClientChallengeXchg, unkObjectType),
+        PKT_FIELD(ClientChallengeXchg, unk2),
+        PKT_EXPECT(ClientChallengeXchg, pLen, 16),
+        PKT_FIELD(ClientChallengeXchg, p),
+        PKT_EXPECT(ClientChallengeXchg, gLen, 16),
+        PKT_FIELD(ClientChallengeXchg, g),
+        PKT_FIELD(ClientChallengeXchg, unkEnd0),
+        PKT_FIELD(ClientChallengeXchg, unkEnd1),
+        PKT_FIELD(ClientChallengeXchg, unkObjects1),
+        PKT_FIELD(ClientChallengeXchg, unk3),
+        PKT_FIELD(ClientChallengeXchg, unkEnd2)> Schema;
+
     static ClientChallengeXchg decode(BitStream& bitStream) {
         ClientChallengeXchg packet;
-        bitStream.read(packet.unk0);
-        bitStream.read(packet.unk1);
-        bitStream.read(packet.clientTime);
-        bitStream.read(packet.challenge);
-        bitStream.read(packet.unkEndChallenge);
-        bitStream.read(packet.unkObjects0);
-        bitStream.read(packet.unkObjectType);
-        bitStream.read(packet.unk2);
-        bitStream.read(packet.pLen);
-        bitStream.read(packet.p);
-        bitStream.read(packet.gLen);
-        bitStream.read(packet.g);
-        bitStream.read(packet.unkEnd0);
-        bitStream.read(packet.unkEnd1);
-        bitStream.read(packet.unkObjects1);
-        bitStream.read(packet.unk3);
-        bitStream.read(packet.unkEnd2);
+        Schema::decode(bitStream, packet);
         return packet;
     }
 };
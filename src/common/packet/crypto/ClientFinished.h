@@ -2,6 +2,7 @@
 
 #include <array>
 #include "common/bitstream.h"
+#include "common/packet/pkt_schema.h"
 
 class ClientFinished {
 public:
@@ -11,13 +12,16 @@ public:
     uint16_t unk0;
     std::array<uint8_t, 12> challengeResult;
 
+    typedef PacketSchema<ClientFinished,
+        PKT_FIELD(ClientFinished, unkObjectType),
+        PKT_FIELD(ClientFinished, pubKeyLen),
+        PKT_FIELD(ClientFinished, pubKey),
+        PKT_FIELD(ClientFinished, unk0),
+        PKT_FIELD(ClientFinished, challengeResult)> Schema;
+
     static ClientFinished decode(BitStream& bitStream) {
         ClientFinished packet;
-        bitStream.read(packet.unkObjectType);
-        bitStream.read(packet.pubKeyLen);
-        bitStream.read(packet.pubKey);
-        bitStream.read(packet.unk0);
-        bitStream.read(packet.challengeResult);
+        Schema::decode(bitStream, packet);
         return packet;
     }
 };
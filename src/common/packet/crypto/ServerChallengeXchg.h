@@ -2,6 +2,7 @@
 
 #include <array>
 #include "common/bitstream.h"
+#include "common/packet/pkt_schema.h"
 
 class ServerChallengeXchg {
 public:
@@ -16,16 +17,23 @@ public:
     std::array<uint8_t, 16> pubKey;
     uint8_t unk3;
 
+    typedef PacketSchema<ServerChallengeXchg,
+        PKT_FIELD(ServerChallengeXchg, unk0),
+        PKT_FIELD(ServerChallengeXchg, unk1),
+        PKT_FIELD(ServerChallengeXchg, serverTime),
+        PKT_FIELD(ServerChallengeXchg, challenge),
+        PKT_FIELD(ServerChallengeXchg, unkChallengeEnd),
+        PKT_FIELD(ServerChallengeXchg, unkObjects),
+        PKT_FIELD(ServerChallengeXchg, unk2),
+        PKT_FIELD(ServerChallengeXchg, pubKeyLen),
+        PKT_FIELD(ServerChallengeXchg, pubKey),
+        PKT_FIELD(ServerChallengeXchg, unk3)> Schema;
+
+    size_t maxEncodedBits() const {
+        return Schema::encodedBits(*this);
+    }
+
     void encode(BitStream& bitStream) {
-        bitStream.write(unk0);
-        bitStream.write(unk1);
-        bitStream.write(serverTime);
-        bitStream.write(challenge);
-        bitStream.write(unkChallengeEnd);
-        bitStream.write(unkObjects);
-        bitStream.write(unk2);
-        bitStream.write(pubKeyLen);
-        bitStream.write(pubKey);
-        bitStream.write(unk3);
+        Schema::encode(bitStream, *this);
     }
 };
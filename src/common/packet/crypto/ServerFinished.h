@@ -2,14 +2,22 @@
 
 #include <array>
 #include "common/bitstream.h"
+#include "common/packet/pkt_schema.h"
 
 class ServerFinished {
 public:
     uint16_t unk0;
     std::array<uint8_t, 12> challengeResult;
 
+    typedef PacketSchema<ServerFinished,
+        PKT_FIELD(ServerFinished, unk0),
+        PKT_FIELD(ServerFinished, challengeResult)> Schema;
+
+    size_t maxEncodedBits() const {
+        return Schema::encodedBits(*this);
+    }
+
     void encode(BitStream& bitStream) {
-        bitStream.write(unk0);
-        bitStream.write(challengeResult);
+        Schema::encode(bitStream, *this);
     }
 };
@@ -2,6 +2,7 @@
 
 #include "common/packet/opcodes.h"
 #include "common/bitstream.h"
+#include "common/packet/pkt_schema.h"
 
 /**
     Dispatched to the server when the player encounters something for the very first time in their campaign.
@@ -30,12 +31,15 @@ public:
     uint32_t unk;
     std::string event_name;
 
-    static AvatarFirstTimeEventMessage decode(BitStream &bitstream) {
+    typedef PacketSchema<AvatarFirstTimeEventMessage,
+        PKT_FIELD(AvatarFirstTimeEventMessage, avatar_uid),
+        PKT_FIELD(AvatarFirstTimeEventMessage, object_id),
+        PKT_FIELD(AvatarFirstTimeEventMessage, unk),
+        PKT_FIELD(AvatarFirstTimeEventMessage, event_name)> Schema;
+
+    static AvatarFirstTimeEventMessage decode(BitStream& bitstream) {
         AvatarFirstTimeEventMessage packet;
-        bitstream.read(packet.avatar_uid);
-        bitstream.read(packet.object_id);
-        bitstream.read(packet.unk);
-        bitstream.read(packet.event_name);
+        Schema::decode(bitstream, packet);
         return packet;
     }
 };
@@ -2,6 +2,7 @@
 
 #include "opcodes.h"
 #include "common/bitstream.h"
+#include "common/packet/pkt_schema.h"
 
 class CharacterInfoMessage {
 public:
@@ -12,15 +13,22 @@ public:
     bool finished;
     uint32_t secondsSinceLastLogin;
 
+    typedef PacketSchema<CharacterInfoMessage,
+        PKT_FIELD(CharacterInfoMessage, unknown),
+        PKT_FIELD(CharacterInfoMessage, zoneId),
+        PKT_FIELD(CharacterInfoMessage, charId),
+        PKT_FIELD(CharacterInfoMessage, charGUID),
+        PKT_FIELD(CharacterInfoMessage, finished),
+        PKT_FIELD(CharacterInfoMessage, secondsSinceLastLogin)> Schema;
+
+    size_t maxEncodedBits() const {
+        return 8 + Schema::encodedBits(*this);
+    }
+
     void encode(BitStream& bitStream) {
         uint8_t opcode = OP_CharacterInfoMessage;
         bitStream.write(opcode);
 
-        bitStream.write(unknown);
-        bitStream.write(zoneId);
-        bitStream.write(charId);
-        bitStream.write(charGUID);
-        bitStream.writeBit(finished);
-        bitStream.write(secondsSinceLastLogin);
+        Schema::encode(bitStream, *this);
     }
 };
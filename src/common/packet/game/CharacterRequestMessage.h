@@ -1,6 +1,7 @@
 #pragma once
 
 #include "common/bitstream.h"
+#include "common/packet/pkt_schema.h"
 
 class CharacterRequestMessage {
 public:
@@ -12,10 +13,13 @@ public:
     uint32_t charId;
     uint32_t action;
 
+    typedef PacketSchema<CharacterRequestMessage,
+        PKT_FIELD(CharacterRequestMessage, charId),
+        PKT_FIELD(CharacterRequestMessage, action)> Schema;
+
     static CharacterRequestMessage decode(BitStream& bitStream) {
         CharacterRequestMessage packet;
-        bitStream.read(packet.charId);
-        bitStream.read(packet.action);
+        Schema::decode(bitStream, packet);
         return packet;
     }
 };
@@ -3,6 +3,7 @@
 #include <string>
 #include "opcodes.h"
 #include "common/bitstream.h"
+#include "common/packet/pkt_schema.h"
 #include "common/util.h"
 
 class ConnectToWorldMessage {
@@ -11,12 +12,19 @@ public:
     std::string serverAddress;
     uint16_t serverPort;
 
+    typedef PacketSchema<ConnectToWorldMessage,
+        PKT_FIELD(ConnectToWorldMessage, serverName),
+        PKT_FIELD(ConnectToWorldMessage, serverAddress),
+        PKT_FIELD(ConnectToWorldMessage, serverPort)> Schema;
+
+    size_t maxEncodedBits() const {
+        return 8 + Schema::encodedBits(*this);
+    }
+
     void encode(BitStream& bitStream) {
         uint8_t opcode = OP_ConnectToWorldMessage;
         bitStream.write(opcode);
 
-        bitStream.write(serverName);
-        bitStream.write(serverAddress);
-        bitStream.write(serverPort);
+        Schema::encode(bitStream, *this);
     }
 };
@@ -3,6 +3,7 @@
 #include <array>
 #include <string>
 #include "common/bitstream.h"
+#include "common/packet/pkt_schema.h"
 #include "common/util.h"
 
 class ConnectToWorldRequestMessage {
@@ -15,15 +16,18 @@ public:
     std::string buildDate;
     uint16_t unk0;
     
+    typedef PacketSchema<ConnectToWorldRequestMessage,
+        PKT_FIELD(ConnectToWorldRequestMessage, serverName),
+        PKT_FIELD(ConnectToWorldRequestMessage, token),
+        PKT_FIELD(ConnectToWorldRequestMessage, majorVersion),
+        PKT_FIELD(ConnectToWorldRequestMessage, minorVersion),
+        PKT_FIELD(ConnectToWorldRequestMessage, revision),
+        PKT_FIELD(ConnectToWorldRequestMessage, buildDate),
+        PKT_FIELD(ConnectToWorldRequestMessage, unk0)> Schema;
+
     static ConnectToWorldRequestMessage decode(BitStream& bitStream) {
         ConnectToWorldRequestMessage packet;
-        bitStream.read(packet.serverName);
-        bitStream.read(packet.token);
-        bitStream.read(packet.majorVersion);
-        bitStream.read(packet.minorVersion);
-        bitStream.read(packet.revision);
-        bitStream.read(packet.buildDate);
-        bitStream.read(packet.unk0);
+        Schema::decode(bitStream, packet);
         return packet;
     }
 };
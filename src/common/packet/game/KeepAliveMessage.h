@@ -2,21 +2,29 @@
 
 #include "opcodes.h"
 #include "common/bitstream.h"
+#include "common/packet/pkt_schema.h"
 
 class KeepAliveMessage {
 public:
     uint16_t keepAliveCode;
 
+    typedef PacketSchema<KeepAliveMessage,
+        PKT_FIELD(KeepAliveMessage, keepAliveCode)> Schema;
+
     static KeepAliveMessage decode(BitStream& bitStream) {
         KeepAliveMessage packet;
-        bitStream.read(packet.keepAliveCode);
+        Schema::decode(bitStream, packet);
         return packet;
     }
 
+    size_t maxEncodedBits() const {
+        return 8 + Schema::encodedBits(*this);
+    }
+
     void encode(BitStream& bitStream) {
         uint8_t opcode = OP_KeepAliveMessage;
         bitStream.write(opcode);
 
-        bitStream.write(keepAliveCode);
+        Schema::encode(bitStream, *this);
     }
 };
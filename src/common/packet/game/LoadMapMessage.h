@@ -3,6 +3,7 @@
 #include <string>
 #include "opcodes.h"
 #include "common/bitstream.h"
+#include "common/packet/pkt_schema.h"
 #include "common/util.h"
 
 class LoadMapMessage {
@@ -14,15 +15,22 @@ public:
     bool weaponsUnlocked;
     uint32_t checksum;
 
+    typedef PacketSchema<LoadMapMessage,
+        PKT_FIELD(LoadMapMessage, mapName),
+        PKT_FIELD(LoadMapMessage, navMapName),
+        PKT_FIELD(LoadMapMessage, unk1),
+        PKT_FIELD(LoadMapMessage, unk2),
+        PKT_FIELD(LoadMapMessage, weaponsUnlocked),
+        PKT_FIELD(LoadMapMessage, checksum)> Schema;
+
+    size_t maxEncodedBits() const {
+        return 8 + Schema::encodedBits(*this);
+    }
+
     void encode(BitStream& bitStream) {
         uint8_t opcode = OP_LoadMapMessage;
         bitStream.write(opcode);
 
-        bitStream.write(mapName);
-        bitStream.write(navMapName);
-        bitStream.write(unk1);
-        bitStream.write(unk2);
-        bitStream.writeBit(weaponsUnlocked);
-        bitStream.write(checksum);
+        Schema::encode(bitStream, *this);
     }
 };
@@ -17,6 +17,13 @@ public:
     std::string username;
     uint32_t privilege;
 
+    size_t maxEncodedBits() const {
+        return 8 +
+            BitStream::maxEncodedBits(token) + BitStream::maxEncodedBits(unk0) +
+            BitStream::maxEncodedBits(error) + BitStream::maxEncodedBits(stationError) + BitStream::maxEncodedBits(subscriptionStatus) + BitStream::maxEncodedBits(unk1) +
+            BitStream::maxEncodedBits(username) + BitStream::maxEncodedBits(privilege) + 1;
+    }
+
     void encode(BitStream& bitStream) {
         uint8_t opcode = OP_LoginRespMessage;
         bitStream.write(opcode);
@@ -2,6 +2,7 @@
 
 #include "opcodes.h"
 #include "common/bitstream.h"
+#include "common/packet/pkt_schema.h"
 
 class SetCurrentAvatarMessage {
 public:
@@ -9,12 +10,19 @@ public:
     uint8_t unk1;
     uint8_t unk2;
 
+    typedef PacketSchema<SetCurrentAvatarMessage,
+        PKT_FIELD(SetCurrentAvatarMessage, guid),
+        PKT_BITS(SetCurrentAvatarMessage, unk1, 3),
+        PKT_BITS(SetCurrentAvatarMessage, unk2, 3)> Schema;
+
+    size_t maxEncodedBits() const {
+        return 8 + Schema::encodedBits(*this);
+    }
+
     void encode(BitStream& bitStream) {
         uint8_t opcode = OP_SetCurrentAvatarMessage;
         bitStream.write(opcode);
 
-        bitStream.write(guid);
-        bitStream.writeBits(&unk1, 3);
-        bitStream.writeBits(&unk2, 3);
+        Schema::encode(bitStream, *this);
     }
 };
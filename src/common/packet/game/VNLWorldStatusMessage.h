@@ -25,6 +25,9 @@ public:
     // TODO: Fill this out
     class ConnectionInfo {
     public:
+        size_t maxEncodedBits() const {
+            return 0;
+        }
 
         void encode(BitStream& bitStream) const {
 
@@ -40,6 +43,14 @@ public:
         std::vector<ConnectionInfo> connections;
         uint8_t empireNeed;
 
+        size_t maxEncodedBits() const {
+            size_t bits = BitStream::maxEncodedBits(name) + BitStream::maxEncodedBits(status2) + BitStream::maxEncodedBits(serverType) + BitStream::maxEncodedBits(status1) + 8;
+            for (auto const &connection : connections) {
+                bits += connection.maxEncodedBits();
+            }
+            return bits + 2;
+        }
+
         void encode(BitStream& bitStream) const {
             bitStream.write(name);
             bitStream.write(status2);
@@ -57,6 +68,14 @@ public:
     std::wstring welcomeMessage;
     std::vector<WorldInfo> worlds;
 
+    size_t maxEncodedBits() const {
+        size_t bits = 8 + BitStream::maxEncodedBits(welcomeMessage) + 8;
+        for (auto const &world : worlds) {
+            bits += world.maxEncodedBits();
+        }
+        return bits;
+    }
+
     void encode(BitStream& bitStream) {
         uint8_t opcode = OP_VNLWorldStatusMessage;
         bitStream.write(opcode);
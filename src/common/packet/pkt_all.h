@@ -5,8 +5,10 @@
 #include "control/ClientStart.h"
 #include "control/ControlSync.h"
 #include "control/ControlSyncResp.h"
+#include "control/MultiPacketEx.h"
 #include "control/ServerStart.h"
 #include "control/SlottedMetaAck.h"
+#include "control/SlottedMetaNack.h"
 #include "control/SlottedMetaPacket.h"
 #include "crypto/ClientChallengeXchg.h"
 #include "crypto/ClientFinished.h"
@@ -2,6 +2,7 @@
 
 #include <vector>
 #include "common/bitstream.h"
+#include "common/packet/pkt_schema.h"
 
 class PacketHeader {
 public:
@@ -12,28 +13,25 @@ public:
     bool lenSpecified;
     uint16_t seqNum;
 
+    typedef PacketSchema<PacketHeader,
+        PKT_BITS(PacketHeader, packetType, 4),
+        PKT_FIELD(PacketHeader, unused),
+        PKT_FIELD(PacketHeader, secured),
+        PKT_FIELD(PacketHeader, advanced),
+        PKT_FIELD(PacketHeader, lenSpecified),
+        PKT_FIELD(PacketHeader, seqNum)> Schema;
+
     static PacketHeader decode(BitStream& bitStream) {
         PacketHeader header;
-        uint8_t flags;
-        bitStream.read(flags);
-        header.packetType = (flags & 0b11110000) >> 4;
-        header.unused = (flags & 0b1000) >> 3;
-        header.secured = (flags & 0b100) >> 2;
-        header.advanced = (flags & 0b10) >> 1;
-        header.lenSpecified = (flags & 0b1);
-        bitStream.read(header.seqNum);
+        Schema::decode(bitStream, header);
         return header;
     }
 
-    void encode(BitStream& bitStream) {
-        uint8_t flags = 0;
-        flags |= (packetType & 0b1111) << 4;
-        flags |= ((uint8_t)unused) << 3;
-        flags |= ((uint8_t)secured) << 2;
-        flags |= ((uint8_t)advanced) << 1;
-        flags |= ((uint8_t)lenSpecified);
+    size_t maxEncodedBits() const {
+        return Schema::encodedBits(*this);
+    }
 
-        bitStream.write(flags);
-        bitStream.write(seqNum);
+    void encode(BitStream& bitStream) {
+        Schema::encode(bitStream, *this);
     }
 };
@@ -0,0 +1,375 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include <type_traits>
+#include "common/bitstream.h"
+
+/**
+ * Declarative packet layouts.
+ *
+ * A packet lists its fields once as a PacketSchema, and gets decode, encode, its exact encoded size and validation from it:
+ *
+ *     typedef PacketSchema<ClientStart,
+ *         PKT_FIELD(ClientStart, unk0),
+ *         PKT_FIELD(ClientStart, clientNonce)> Schema;
+ *
+ * Fields are serialized in order, the same way as the matching BitStream read/write functions.
+ * Opcodes aren't part of the schema, since decoding starts after the dispatcher has already read them.
+ * When every field has a fixed size, decoding does a single bounds check for the whole packet
+ * followed by unchecked reads, and encoding reserves room for the whole packet once.
+ *
+ * Packets that get sent also have maxEncodedBits(), an upper bound on their encoded size including the opcode,
+ * which senders pass to BitStream::reserve to size the send buffer up front.
+ */
+
+/**
+ * How a value of some type is serialized. Every type that can be a field has a specialization.
+ * IS_FIXED types always take FIXED_BITS bits, and the others (such as strings) depend on the value.
+ */
+template<typename T, typename Enable = void>
+class FieldCoding;
+
+/**
+ * Numbers are copied byte for byte in memory order, like BitStream::read/write.
+ */
+template<typename T>
+class FieldCoding<T, typename std::enable_if<std::is_arithmetic<T>::value && !std::is_same<T, bool>::value>::type> {
+public:
+    static const bool IS_FIXED = true;
+    static const size_t FIXED_BITS = sizeof(T) * 8;
+
+    static size_t encodedBits(const T& value, size_t bitPos) {
+        return FIXED_BITS;
+    }
+
+    static void read(BitStream& bitStream, T& value) {
+        bitStream.read(value);
+    }
+
+    static void readUnchecked(BitStream& bitStream, T& value) {
+        bitStream.readBytesUnchecked((uint8_t*)&value, sizeof(T));
+    }
+
+    static void write(BitStream& bitStream, const T& value) {
+        bitStream.write(value);
+    }
+
+    static void writeUnchecked(BitStream& bitStream, const T& value) {
+        bitStream.writeBytesUnchecked((const uint8_t*)&value, sizeof(T));
+    }
+};
+
+/**
+ * Flags are a single bit, like BitStream::readBit/writeBit.
+ */
+template<>
+class FieldCoding<bool> {
+public:
+    static const bool IS_FIXED = true;
+    static const size_t FIXED_BITS = 1;
+
+    static size_t encodedBits(const bool& value, size_t bitPos) {
+        return FIXED_BITS;
+    }
+
+    static void read(BitStream& bitStream, bool& value) {
+        value = bitStream.readBit();
+    }
+
+    static void readUnchecked(BitStream& bitStream, bool& value) {
+        value = bitStream.readBitFieldUnchecked(1) != 0;
+    }
+
+    static void write(BitStream& bitStream, const bool& value) {
+        bitStream.writeBit(value);
+    }
+
+    static void writeUnchecked(BitStream& bitStream, const bool& value) {
+        bitStream.writeBitFieldUnchecked(value ? 1 : 0, 1);
+    }
+};
+
+template<size_t arraySize>
+class FieldCoding<std::array<uint8_t, arraySize>> {
+public:
+    static const bool IS_FIXED = true;
+    static const size_t FIXED_BITS = arraySize * 8;
+
+    static size_t encodedBits(const std::array<uint8_t, arraySize>& value, size_t bitPos) {
+        return FIXED_BITS;
+    }
+
+    static void read(BitStream& bitStream, std::array<uint8_t, arraySize>& value) {
+        bitStream.read(value);
+    }
+
+    static void readUnchecked(BitStream& bitStream, std::array<uint8_t, arraySize>& value) {
+        bitStream.readBytesUnchecked(value.data(), arraySize);
+    }
+
+    static void write(BitStream& bitStream, const std::array<uint8_t, arraySize>& value) {
+        bitStream.write(value);
+    }
+
+    static void writeUnchecked(BitStream& bitStream, const std::array<uint8_t, arraySize>& value) {
+        bitStream.writeBytesUnchecked(value.data(), arraySize);
+    }
+};
+
+/**
+ * Strings are a length followed by the characters, which start on a byte boundary. See BitStream::write(std::string).
+ */
+template<typename CharT>
+class FieldCoding<std::basic_string<CharT>> {
+public:
+    static const bool IS_FIXED = false;
+    static const size_t FIXED_BITS = 0;
+
+    // Wide strings are written 2 bytes a character, whatever the size of wchar_t
+    static const size_t BYTES_PER_CHAR = sizeof(CharT) == 1 ? 1 : 2;
+
+    static size_t encodedBits(const std::basic_string<CharT>& value, size_t bitPos) {
+        size_t lengthBits = value.length() < 128 ? 8 : 16;
+        size_t alignBits = (8 - ((bitPos + lengthBits) & 0x7)) & 0x7;
+        return lengthBits + alignBits + value.length() * BYTES_PER_CHAR * 8;
+    }
+
+    static void read(BitStream& bitStream, std::basic_string<CharT>& value) {
+        bitStream.read(value);
+    }
+
+    static void write(BitStream& bitStream, const std::basic_string<CharT>& value) {
+        bitStream.write(value);
+    }
+};
+
+/**
+ * A packet member serialized as its whole type.
+ */
+template<typename Packet, typename T, T Packet::*member>
+class Field {
+public:
+    typedef FieldCoding<T> Coding;
+
+    static const bool IS_FIXED = Coding::IS_FIXED;
+    static const size_t FIXED_BITS = Coding::FIXED_BITS;
+
+    static size_t encodedBits(const Packet& packet, size_t bitPos) {
+        return Coding::encodedBits(packet.*member, bitPos);
+    }
+
+    static void read(BitStream& bitStream, Packet& packet) {
+        Coding::read(bitStream, packet.*member);
+    }
+
+    static void readUnchecked(BitStream& bitStream, Packet& packet) {
+        Coding::readUnchecked(bitStream, packet.*member);
+    }
+
+    static void write(BitStream& bitStream, const Packet& packet) {
+        Coding::write(bitStream, packet.*member);
+    }
+
+    static void writeUnchecked(BitStream& bitStream, const Packet& packet) {
+        Coding::writeUnchecked(bitStream, packet.*member);
+    }
+};
+
+/**
+ * A packet member serialized as just its low numBits bits, such as a 3-bit enum stored in a uint8_t.
+ */
+template<typename Packet, typename T, T Packet::*member, size_t numBits>
+class BitsField {
+public:
+    static_assert(std::is_integral<T>::value, "Bit fields must be integers.");
+    static_assert(numBits > 0 && numBits <= BitStream::MAX_FIELD_BITS && numBits <= sizeof(T) * 8, "Bit field width out of range.");
+
+    static const bool IS_FIXED = true;
+    static const size_t FIXED_BITS = numBits;
+
+    static size_t encodedBits(const Packet& packet, size_t bitPos) {
+        return FIXED_BITS;
+    }
+
+    static void read(BitStream& bitStream, Packet& packet) {
+        packet.*member = (T)bitStream.readBitField(numBits);
+    }
+
+    static void readUnchecked(BitStream& bitStream, Packet& packet) {
+        packet.*member = (T)bitStream.readBitFieldUnchecked(numBits);
+    }
+
+    static void write(BitStream& bitStream, const Packet& packet) {
+        bitStream.writeBitField(maskedValue(packet), numBits);
+    }
+
+    static void writeUnchecked(BitStream& bitStream, const Packet& packet) {
+        bitStream.writeBitFieldUnchecked(maskedValue(packet), numBits);
+    }
+
+private:
+    static uint64_t maskedValue(const Packet& packet) {
+        return (uint64_t)(packet.*member) & (~0ULL >> (64 - numBits));
+    }
+};
+
+/**
+ * A packet member that only has one valid value, such as the length of a fixed-size key.
+ * Decoding any other value is an INVALID_VALUE error. Encoding writes the member as is.
+ */
+template<typename Packet, typename T, T Packet::*member, T expectedValue>
+class ExpectedField : public Field<Packet, T, member> {
+public:
+    static void read(BitStream& bitStream, Packet& packet) {
+        Field<Packet, T, member>::read(bitStream, packet);
+        validate(bitStream, packet);
+    }
+
+    static void readUnchecked(BitStream& bitStream, Packet& packet) {
+        Field<Packet, T, member>::readUnchecked(bitStream, packet);
+        validate(bitStream, packet);
+    }
+
+private:
+    static void validate(BitStream& bitStream, const Packet& packet) {
+        if (packet.*member != expectedValue) {
+            bitStream.setError(BitStream::Error::INVALID_VALUE);
+        }
+    }
+};
+
+#define PKT_FIELD(Packet, member) Field<Packet, decltype(Packet::member), &Packet::member>
+#define PKT_BITS(Packet, member, numBits) BitsField<Packet, decltype(Packet::member), &Packet::member, numBits>
+#define PKT_EXPECT(Packet, member, expectedValue) ExpectedField<Packet, decltype(Packet::member), &Packet::member, expectedValue>
+
+/**
+ * Applies each step to a run of fields in order.
+ */
+template<typename Packet, typename... Fields>
+class FieldList;
+
+template<typename Packet>
+class FieldList<Packet> {
+public:
+    static const bool IS_FIXED = true;
+    static const size_t FIXED_BITS = 0;
+
+    static size_t encodedBits(const Packet& packet, size_t bitPos) {
+        return 0;
+    }
+
+    static void read(BitStream& bitStream, Packet& packet) {
+
+    }
+
+    static void readUnchecked(BitStream& bitStream, Packet& packet) {
+
+    }
+
+    static void write(BitStream& bitStream, const Packet& packet) {
+
+    }
+
+    static void writeUnchecked(BitStream& bitStream, const Packet& packet) {
+
+    }
+};
+
+template<typename Packet, typename First, typename... Rest>
+class FieldList<Packet, First, Rest...> {
+public:
+    typedef FieldList<Packet, Rest...> RestList;
+
+    static const bool IS_FIXED = First::IS_FIXED && RestList::IS_FIXED;
+    static const size_t FIXED_BITS = First::FIXED_BITS + RestList::FIXED_BITS;
+
+    static size_t encodedBits(const Packet& packet, size_t bitPos) {
+        size_t firstBits = First::encodedBits(packet, bitPos);
+        return firstBits + RestList::encodedBits(packet, bitPos + firstBits);
+    }
+
+    static void read(BitStream& bitStream, Packet& packet) {
+        First::read(bitStream, packet);
+        RestList::read(bitStream, packet);
+    }
+
+    static void readUnchecked(BitStream& bitStream, Packet& packet) {
+        First::readUnchecked(bitStream, packet);
+        RestList::readUnchecked(bitStream, packet);
+    }
+
+    static void write(BitStream& bitStream, const Packet& packet) {
+        First::write(bitStream, packet);
+        RestList::write(bitStream, packet);
+    }
+
+    static void writeUnchecked(BitStream& bitStream, const Packet& packet) {
+        First::writeUnchecked(bitStream, packet);
+        RestList::writeUnchecked(bitStream, packet);
+    }
+};
+
+/**
+ * The layout of a packet type, as the list of its fields.
+ */
+template<typename Packet, typename... Fields>
+class PacketSchema {
+public:
+    typedef FieldList<Packet, Fields...> AllFields;
+
+    // Whether every packet of this type has the same size, FIXED_BITS
+    static const bool IS_FIXED = AllFields::IS_FIXED;
+    static const size_t FIXED_BITS = AllFields::FIXED_BITS;
+
+    /**
+     * @return The exact number of bits the packet encodes to, when encoding starts on a byte boundary
+     */
+    static size_t encodedBits(const Packet& packet) {
+        return IS_FIXED ? FIXED_BITS : AllFields::encodedBits(packet, 0);
+    }
+
+    /**
+     * Decodes every field in order. Errors (including INVALID_VALUE from fields that validate) are left in the stream.
+     */
+    static void decode(BitStream& bitStream, Packet& packet) {
+        decode(bitStream, packet, std::integral_constant<bool, IS_FIXED>());
+    }
+
+    /**
+     * Encodes every field in order, growing the stream's buffer at most once.
+     */
+    static void encode(BitStream& bitStream, const Packet& packet) {
+        encode(bitStream, packet, std::integral_constant<bool, IS_FIXED>());
+    }
+
+private:
+    static void decode(BitStream& bitStream, Packet& packet, std::true_type isFixed) {
+        if (bitStream.getRemainingBits() < FIXED_BITS) {
+            bitStream.setError(BitStream::Error::READ_TOO_MUCH);
+            return;
+        }
+
+        AllFields::readUnchecked(bitStream, packet);
+    }
+
+    static void decode(BitStream& bitStream, Packet& packet, std::false_type isFixed) {
+        AllFields::read(bitStream, packet);
+    }
+
+    static void encode(BitStream& bitStream, const Packet& packet, std::true_type isFixed) {
+        if (!bitStream.reserve(FIXED_BITS)) {
+            return;
+        }
+
+        AllFields::writeUnchecked(bitStream, packet);
+    }
+
+    static void encode(BitStream& bitStream, const Packet& packet, std::false_type isFixed) {
+        // Strings align to the next byte from wherever they land, so size from the actual stream pos
+        size_t startBitInByte = bitStream.getPos() & 0x7;
+        bitStream.reserve(AllFields::encodedBits(packet, startBitInByte));
+        AllFields::write(bitStream, packet);
+    }
+};
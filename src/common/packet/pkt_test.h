@@ -13,6 +13,12 @@
     assertOpcode(bitStream, expectedOpcode);\
 } while (0)
 
+#define assertMaxEncodedBits(packet, encodedBuf) do {\
+    assertEqual((BITS_TO_BYTES((packet).maxEncodedBits()) >= (encodedBuf).size()), true);\
+} while (0)
+
 void testPacketCodingControl();
 void testPacketCodingCrypto();
 void testPacketCodingGame();
+void testPacketSchema();
+void benchPacketCoding();
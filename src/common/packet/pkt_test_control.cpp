@@ -41,6 +41,7 @@ void testControlSyncResp() {
     std::vector<uint8_t> testEncodingBuf;
     encodePacket.encode(BitStream(testEncodingBuf));
     assertBuffersEqual(testEncodingBuf, encodedBuf);
+    assertMaxEncodedBits(encodePacket, testEncodingBuf);
 }
 
 void testClientStart() {
@@ -69,6 +70,7 @@ void testServerStart() {
     std::vector<uint8_t> testEncodingBuf;
     encodePacket.encode(BitStream(testEncodingBuf));
     assertBuffersEqual(testEncodingBuf, encodedBuf);
+    assertMaxEncodedBits(encodePacket, testEncodingBuf);
 }
 
 void testSlottedMetaAck() {
@@ -86,6 +88,88 @@ void testSlottedMetaAck() {
     std::vector<uint8_t> testEncodingBuf;
     encodePacket.encode(BitStream(testEncodingBuf));
     assertBuffersEqual(testEncodingBuf, encodedBuf);
+    assertMaxEncodedBits(encodePacket, testEncodingBuf);
+
+    // Decode
+    BitStream decodeBitStream(encodedBuf);
+    assertControlOpcode(decodeBitStream, expectedOpcode);
+    SlottedMetaAck decodePacket = SlottedMetaAck::decode(decodeBitStream, expectedSlot);
+    assertEqual(decodePacket.slot, expectedSlot);
+    assertEqual(decodePacket.subslot, 0x1234);
+}
+
+void testSlottedMetaNack() {
+    uint8_t expectedSlot = 1;
+    uint8_t expectedOpcode = OP_RelatedA0 + expectedSlot % 4;
+    static std::vector<uint8_t> encodedBuf = std::vector<uint8_t>({
+        0x00, expectedOpcode, 0x05, 0x00
+    });
+
+    // Decode
+    BitStream decodeBitStream(encodedBuf);
+    assertControlOpcode(decodeBitStream, expectedOpcode);
+    SlottedMetaNack decodePacket = SlottedMetaNack::decode(decodeBitStream, expectedSlot);
+    assertEqual(decodePacket.slot, expectedSlot);
+    assertEqual(decodePacket.subslot, 5);
+
+    // Encode
+    std::vector<uint8_t> testEncodingBuf;
+    decodePacket.encode(BitStream(testEncodingBuf));
+    assertBuffersEqual(testEncodingBuf, encodedBuf);
+    assertMaxEncodedBits(decodePacket, testEncodingBuf);
+}
+
+void testSlottedMetaPacket() {
+    static std::vector<uint8_t> encodedBuf = hexToBytes(
+        "0009 0200 1F00000000");
+
+    // Decode
+    BitStream decodeBitStream(encodedBuf);
+    assertControlOpcode(decodeBitStream, OP_SlottedMetaPacket0);
+    SlottedMetaPacket decodePacket = SlottedMetaPacket::decode(decodeBitStream, 0);
+    assertEqual(decodePacket.slot, 0);
+    assertEqual(decodePacket.subslot, 2);
+    assertEqual(decodePacket.restSize, 5);
+    assertEqual((decodePacket.rest == encodedBuf.data() + 4), true);
+
+    // Encode
+    std::vector<uint8_t> testEncodingBuf;
+    decodePacket.encode(BitStream(testEncodingBuf));
+    assertBuffersEqual(testEncodingBuf, encodedBuf);
+    assertMaxEncodedBits(decodePacket, testEncodingBuf);
+}
+
+void testMultiPacketEx() {
+    std::vector<uint8_t> longPacket(300, 0xAB);
+    std::vector<uint8_t> encodedBuf = hexToBytes("0019 03 010203 00 FF2C01");
+    encodedBuf.insert(encodedBuf.end(), longPacket.begin(), longPacket.end());
+    encodedBuf.push_back(0x01);
+    encodedBuf.push_back(0x04);
+
+    // Decode
+    BitStream decodeBitStream(encodedBuf);
+    assertControlOpcode(decodeBitStream, OP_MultiPacketEx);
+    MultiPacketEx decodePacket = MultiPacketEx::decode(decodeBitStream);
+    assertEqual((int)decodeBitStream.getLastError(), (int)BitStream::Error::NONE);
+    assertEqual(decodePacket.packets.size(), 4);
+    assertEqual(decodePacket.packets[0].size, 3);
+    assertEqual(decodePacket.packets[0].data[2], 0x03);
+    assertEqual(decodePacket.packets[1].size, 0);
+    assertEqual(decodePacket.packets[2].size, 300);
+    assertEqual(decodePacket.packets[2].data[299], 0xAB);
+    assertEqual(decodePacket.packets[3].size, 1);
+    assertEqual(decodePacket.packets[3].data[0], 0x04);
+
+    // Sizes
+    std::vector<uint8_t> testEncodingBuf;
+    BitStream encodeBitStream(testEncodingBuf);
+    MultiPacketEx::writeSize(encodeBitStream, 3);
+    MultiPacketEx::writeSize(encodeBitStream, 300);
+    MultiPacketEx::writeSize(encodeBitStream, 0x10000);
+    assertBuffersEqual(testEncodingBuf, hexToBytes("03 FF2C01 FFFFFF00000100"));
+    assertEqual(MultiPacketEx::encodedSizeBytes(3), 1);
+    assertEqual(MultiPacketEx::encodedSizeBytes(300), 3);
+    assertEqual(MultiPacketEx::encodedSizeBytes(0x10000), 7);
 }
 
 void testPacketCodingControl() {
@@ -94,5 +178,7 @@ void testPacketCodingControl() {
     testClientStart();
     testServerStart();
     testSlottedMetaAck();
-    // TODO: Test SlottedMetaPacket
+    testSlottedMetaNack();
+    testSlottedMetaPacket();
+    testMultiPacketEx();
 }
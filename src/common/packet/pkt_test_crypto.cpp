@@ -58,6 +58,7 @@ void testServerChallengeXchg() {
     std::vector<uint8_t> testEncodingBuf;
     encodePacket.encode(BitStream(testEncodingBuf));
     assertBuffersEqual(testEncodingBuf, encodedBuf);
+    assertMaxEncodedBits(encodePacket, testEncodingBuf);
 }
 
 void testServerFinished() {
@@ -72,6 +73,7 @@ void testServerFinished() {
     std::vector<uint8_t> testEncodingBuf;
     encodePacket.encode(BitStream(testEncodingBuf));
     assertBuffersEqual(testEncodingBuf, encodedBuf);
+    assertMaxEncodedBits(encodePacket, testEncodingBuf);
 }
 
 void testPacketCodingCrypto() {
@@ -22,6 +22,7 @@ void testCharacterInfoMessage() {
     std::vector<uint8_t> testEncodingBuf;
     encodePacket.encode(BitStream(testEncodingBuf));
     assertBuffersEqual(testEncodingBuf, encodedBuf);
+    assertMaxEncodedBits(encodePacket, testEncodingBuf);
 }
 
 void testCharacterRequestMessage() {
@@ -50,6 +51,7 @@ void testConnectToWorldMessage() {
     std::vector<uint8_t> testEncodingBuf;
     encodePacket.encode(BitStream(testEncodingBuf));
     assertBuffersEqual(testEncodingBuf, encodedBuf);
+    assertMaxEncodedBits(encodePacket, testEncodingBuf);
 }
 
 void testConnectToWorldRequestMessage() {
@@ -82,6 +84,7 @@ void testKeepAliveMessage() {
     std::vector<uint8_t> testEncodingBuf;
     encodePacket.encode(BitStream(testEncodingBuf));
     assertBuffersEqual(testEncodingBuf, encodedBuf);
+    assertMaxEncodedBits(encodePacket, testEncodingBuf);
 
     // Decode
     BitStream decodeBitStream(encodedBuf);
@@ -106,6 +109,7 @@ void testLoadMapMessage() {
     std::vector<uint8_t> testEncodingBuf;
     encodePacket.encode(BitStream(testEncodingBuf));
     assertBuffersEqual(testEncodingBuf, encodedBuf);
+    assertMaxEncodedBits(encodePacket, testEncodingBuf);
 }
 
 void testLoginMessage() {
@@ -145,6 +149,7 @@ void testLoginRespMessage() {
     std::vector<uint8_t> testEncodingBuf;
     encodePacket.encode(BitStream(testEncodingBuf));
     assertBuffersEqual(testEncodingBuf, encodedBuf);
+    assertMaxEncodedBits(encodePacket, testEncodingBuf);
 }
 
 void testSetCurrentAvatarMessage() {
@@ -161,6 +166,7 @@ void testSetCurrentAvatarMessage() {
     std::vector<uint8_t> testEncodingBuf;
     encodePacket.encode(BitStream(testEncodingBuf));
     assertBuffersEqual(testEncodingBuf, encodedBuf);
+    assertMaxEncodedBits(encodePacket, testEncodingBuf);
 }
 
 void testAvatarFirstTimeEventMessage() {
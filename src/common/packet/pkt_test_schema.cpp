@@ -0,0 +1,146 @@
+#include <vector>
+#include "pkt_all.h"
+#include "pkt_test.h"
+#include "common/bench.h"
+#include "common/bitstream.h"
+#include "common/log.h"
+#include "common/test.h"
+
+/**
+ * ClientChallengeXchg's decode as it was before the schema, one checked read per field. For comparison in the benchmark.
+ */
+ClientChallengeXchg decodeClientChallengeXchgPerField(BitStream& bitStream) {
+    ClientChallengeXchg packet;
+    bitStream.read(packet.unk0);
+    bitStream.read(packet.unk1);
+    bitStream.read(packet.clientTime);
+    bitStream.read(packet.challenge);
+    bitStream.read(packet.unkEndChallenge);
+    bitStream.read(packet.unkObjects0);
+    bitStream.read(packet.unkObjectType);
+    bitStream.read(packet.unk2);
+    bitStream.read(packet.pLen);
+    bitStream.read(packet.p);
+    bitStream.read(packet.gLen);
+    bitStream.read(packet.g);
+    bitStream.read(packet.unkEnd0);
+    bitStream.read(packet.unkEnd1);
+    bitStream.read(packet.unkObjects1);
+    bitStream.read(packet.unk3);
+    bitStream.read(packet.unkEnd2);
+    return packet;
+}
+
+std::vector<uint8_t> getClientChallengeXchgBuf() {
+    return hexToBytes(
+        "0101962D845324F5997CC7D16031D1F5 67E900010002FF2400001000F57511EB 8E5D1EFB8B7F3287D5A18B1710000000 00000000000000000000000000020000 010307000000");
+}
+
+void testPacketSchemaFixed() {
+    assertEqual((bool)ClientChallengeXchg::Schema::IS_FIXED, true);
+    assertEqual(ClientChallengeXchg::Schema::FIXED_BITS, getClientChallengeXchgBuf().size() * 8);
+    assertEqual(PacketHeader::Schema::FIXED_BITS, 24);
+
+    // The whole packet is bounds checked up front, so a short one fails before anything is read
+    std::vector<uint8_t> encodedBuf = getClientChallengeXchgBuf();
+    encodedBuf.pop_back();
+    BitStream truncatedBitStream(encodedBuf);
+    ClientChallengeXchg::decode(truncatedBitStream);
+    assertEqual((int)truncatedBitStream.getLastError(), (int)BitStream::Error::READ_TOO_MUCH);
+    assertEqual(truncatedBitStream.getPos(), 0);
+}
+
+void testPacketSchemaUnaligned() {
+    PacketHeader header;
+    header.packetType = 0xA;
+    header.unused = false;
+    header.secured = true;
+    header.advanced = false;
+    header.lenSpecified = true;
+    header.seqNum = 0x1234;
+
+    // Fixed-size fields still work when the packet doesn't start on a byte boundary
+    std::vector<uint8_t> buf;
+    BitStream bitStream(buf);
+    bitStream.writeBitField(0x5, 3);
+    header.encode(bitStream);
+    assertEqual(bitStream.getPos(), 3 + 24);
+
+    bitStream.setPos(3);
+    PacketHeader decodedHeader = PacketHeader::decode(bitStream);
+    assertEqual((int)bitStream.getLastError(), (int)BitStream::Error::NONE);
+    assertEqual((int)decodedHeader.packetType, 0xA);
+    assertEqual(decodedHeader.unused, false);
+    assertEqual(decodedHeader.secured, true);
+    assertEqual(decodedHeader.advanced, false);
+    assertEqual(decodedHeader.lenSpecified, true);
+    assertEqual(decodedHeader.seqNum, 0x1234);
+}
+
+void testPacketSchemaValidation() {
+    // pLen must match the 16 bytes of p
+    std::vector<uint8_t> encodedBuf = getClientChallengeXchgBuf();
+    encodedBuf[26] = 0x0F;
+    BitStream bitStream(encodedBuf);
+    ClientChallengeXchg::decode(bitStream);
+    assertEqual((int)bitStream.getLastError(), (int)BitStream::Error::INVALID_VALUE);
+}
+
+void testPacketSchemaVariable() {
+    assertEqual((bool)ConnectToWorldMessage::Schema::IS_FIXED, false);
+
+    ConnectToWorldMessage packet;
+    packet.serverName = "gemini";
+    packet.serverAddress = std::string(200, 'a');
+    packet.serverPort = 51001;
+
+    // The size accounts for the long length prefix and the padding before each string
+    std::vector<uint8_t> buf;
+    BitStream bitStream(buf);
+    ConnectToWorldMessage::Schema::encode(bitStream, packet);
+    assertEqual(ConnectToWorldMessage::Schema::encodedBits(packet), bitStream.getPos());
+    assertEqual(buf.size(), BITS_TO_BYTES(bitStream.getPos()));
+
+    // Wide strings take 2 bytes a character, as the writer sends them, even where wchar_t is bigger
+    std::wstring wideString = L"hello";
+    std::vector<uint8_t> wideBuf;
+    BitStream wideBitStream(wideBuf);
+    wideBitStream.writeBitField(0, 3);
+    wideBitStream.write(wideString);
+    assertEqual(FieldCoding<std::wstring>::encodedBits(wideString, 3), wideBitStream.getPos() - 3);
+}
+
+void testPacketSchema() {
+    testPacketSchemaFixed();
+    testPacketSchemaUnaligned();
+    testPacketSchemaValidation();
+    testPacketSchemaVariable();
+}
+
+/**
+ * Uses fields from all over the packet, so the benchmark can't skip decoding most of it.
+ */
+uint32_t sumClientChallengeXchg(const ClientChallengeXchg& packet) {
+    return packet.clientTime + packet.challenge[11] + packet.unk2 + packet.pLen + packet.p[15] + packet.g[15] + packet.unk3 + packet.unkEnd2;
+}
+
+void benchPacketCoding() {
+    std::vector<uint8_t> encodedBuf = getClientChallengeXchgBuf();
+    size_t numIters = 1000000;
+    uint32_t checksum = 0;
+
+    std::cout << "Packet coding, ClientChallengeXchg decode" << std::endl;
+    // Changing the packet each time keeps the decode from being hoisted out of the loop
+    benchmark("  schema", numIters, {
+        encodedBuf[2] = (uint8_t)benchIter;
+        BitStream bitStream(encodedBuf);
+        checksum += sumClientChallengeXchg(ClientChallengeXchg::decode(bitStream));
+    });
+    benchmark("  per field (old)", numIters, {
+        encodedBuf[2] = (uint8_t)benchIter;
+        BitStream bitStream(encodedBuf);
+        checksum += sumClientChallengeXchg(decodeClientChallengeXchgPerField(bitStream));
+    });
+
+    benchKeep(checksum);
+}
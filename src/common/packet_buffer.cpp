@@ -0,0 +1,86 @@
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "packet_buffer.h"
+
+void PacketBufferReleaser::operator()(PacketBuffer* buf) const {
+    PacketBufferPool::release(buf);
+}
+
+class PacketBufferPool::SharedState {
+public:
+    std::mutex mutex;
+    FreeList freeList;
+    std::vector<std::unique_ptr<PacketBuffer[]>> slabs;
+};
+
+PacketBufferPool::ThreadFreeList::~ThreadFreeList() {
+    if (count == 0) {
+        return;
+    }
+
+    SharedState& shared = getSharedState();
+    std::lock_guard<std::mutex> lock(shared.mutex);
+    moveTo(shared.freeList, count);
+}
+
+void PacketBufferPool::FreeList::moveTo(FreeList& other, size_t numBuffers) {
+    while (numBuffers > 0 && count > 0) {
+        other.push(pop());
+        numBuffers--;
+    }
+}
+
+PacketBufferHandle PacketBufferPool::acquire() {
+    FreeList& threadFreeList = getThreadFreeList();
+    if (threadFreeList.count == 0) {
+        refill(threadFreeList);
+    }
+
+    PacketBuffer* buf = threadFreeList.pop();
+    buf->size = 0;
+    return PacketBufferHandle(buf);
+}
+
+void PacketBufferPool::release(PacketBuffer* buf) {
+    FreeList& threadFreeList = getThreadFreeList();
+    threadFreeList.push(buf);
+
+    if (threadFreeList.count > MAX_THREAD_FREE_BUFFERS) {
+        SharedState& shared = getSharedState();
+        std::lock_guard<std::mutex> lock(shared.mutex);
+        threadFreeList.moveTo(shared.freeList, BUFFERS_PER_SLAB);
+    }
+}
+
+size_t PacketBufferPool::getNumAllocated() {
+    SharedState& shared = getSharedState();
+    std::lock_guard<std::mutex> lock(shared.mutex);
+    return shared.slabs.size() * BUFFERS_PER_SLAB;
+}
+
+void PacketBufferPool::refill(FreeList& threadFreeList) {
+    SharedState& shared = getSharedState();
+    std::lock_guard<std::mutex> lock(shared.mutex);
+
+    if (shared.freeList.count > 0) {
+        shared.freeList.moveTo(threadFreeList, BUFFERS_PER_SLAB);
+        return;
+    }
+
+    shared.slabs.emplace_back(new PacketBuffer[BUFFERS_PER_SLAB]);
+    PacketBuffer* slab = shared.slabs.back().get();
+    for (size_t i = 0; i < BUFFERS_PER_SLAB; ++i) {
+        threadFreeList.push(&slab[i]);
+    }
+}
+
+PacketBufferPool::FreeList& PacketBufferPool::getThreadFreeList() {
+    thread_local ThreadFreeList threadFreeList;
+    return threadFreeList;
+}
+
+PacketBufferPool::SharedState& PacketBufferPool::getSharedState() {
+    static SharedState shared;
+    return shared;
+}
@@ -0,0 +1,149 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <memory>
+
+/**
+ * A buffer for one outgoing datagram, sized so that a datagram always fits in a single Ethernet frame.
+ * Buffers come from PacketBufferPool, and go back to it when their handle is destroyed.
+ */
+class PacketBuffer {
+public:
+    // 1500 byte Ethernet MTU, minus the IPv4 and UDP headers
+    static const size_t CAPACITY = 1472;
+
+    /**
+     * @return A pointer to the start of the buffer
+     */
+    uint8_t* getData() {
+        return data.data();
+    }
+
+    const uint8_t* getData() const {
+        return data.data();
+    }
+
+    /**
+     * @return The number of bytes in use
+     */
+    size_t getSize() const {
+        return size;
+    }
+
+    /**
+     * Sets the number of bytes in use, up to CAPACITY.
+     */
+    void setSize(size_t newSize) {
+        size = newSize;
+    }
+
+private:
+    friend class PacketBufferPool;
+
+    std::array<uint8_t, CAPACITY> data;
+    size_t size;
+    // Next buffer in whichever free list this buffer is on
+    PacketBuffer* nextFree;
+};
+
+/**
+ * Returns a buffer to the pool. Used as the deleter of PacketBufferHandle.
+ */
+class PacketBufferReleaser {
+public:
+    void operator()(PacketBuffer* buf) const;
+};
+
+/**
+ * Owns a pooled buffer. Moving the handle moves the buffer (such as from the encoder into the server's send batch),
+ * and destroying it returns the buffer to the pool.
+ */
+typedef std::unique_ptr<PacketBuffer, PacketBufferReleaser> PacketBufferHandle;
+
+/**
+ * Hands out PacketBuffers without touching the heap once the pool has warmed up.
+ *
+ * Each thread keeps its own free list, so acquiring and releasing is usually a couple of pointer swaps.
+ * Buffers are allocated in slabs, and whole slabs' worth of buffers move between the thread lists and a shared list
+ * under a mutex only when a thread runs out or has too many (such as when buffers are released by another thread).
+ * Slabs are never freed, so the pool stays at its high water mark.
+ */
+class PacketBufferPool {
+public:
+    /**
+     * @return An empty buffer. The contents are left over from its previous use.
+     */
+    static PacketBufferHandle acquire();
+
+    /**
+     * Returns a buffer to the calling thread's free list.
+     */
+    static void release(PacketBuffer* buf);
+
+    /**
+     * @return The total number of buffers allocated, whether in use or free.
+     */
+    static size_t getNumAllocated();
+
+private:
+    static const size_t BUFFERS_PER_SLAB = 64;
+
+    // A thread with more free buffers than this hands a slab's worth back to the shared list
+    static const size_t MAX_THREAD_FREE_BUFFERS = 4 * BUFFERS_PER_SLAB;
+
+    class FreeList {
+    public:
+        FreeList() :
+            head(nullptr),
+            count(0) {
+
+        }
+
+        void push(PacketBuffer* buf) {
+            buf->nextFree = head;
+            head = buf;
+            count++;
+        }
+
+        PacketBuffer* pop() {
+            PacketBuffer* buf = head;
+            head = buf->nextFree;
+            count--;
+            return buf;
+        }
+
+        /**
+         * Moves up to numBuffers buffers from the front of this list onto another.
+         */
+        void moveTo(FreeList& other, size_t numBuffers);
+
+        PacketBuffer* head;
+        size_t count;
+    };
+
+    /**
+     * A thread's own free list, which hands its buffers back to the shared list when the thread exits.
+     */
+    class ThreadFreeList : public FreeList {
+    public:
+        ~ThreadFreeList();
+    };
+
+    class SharedState;
+
+    /**
+     * Fills the calling thread's empty free list from the shared list, or with a new slab if that is empty too.
+     */
+    static void refill(FreeList& threadFreeList);
+
+    /**
+     * @return The calling thread's free list
+     */
+    static FreeList& getThreadFreeList();
+
+    /**
+     * @return The shared free list and the slabs, behind their mutex
+     */
+    static SharedState& getSharedState();
+};
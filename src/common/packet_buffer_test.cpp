@@ -0,0 +1,111 @@
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+#include "bench.h"
+#include "bitstream.h"
+#include "log.h"
+#include "packet_buffer.h"
+#include "packet_buffer_test.h"
+#include "test.h"
+
+void testPacketBufferPoolReuse() {
+    PacketBufferHandle buf = PacketBufferPool::acquire();
+    assertEqual(buf->getSize(), 0);
+    buf->setSize(PacketBuffer::CAPACITY);
+
+    // The most recently released buffer is the next one handed out, since it's the likeliest to still be in cache
+    PacketBuffer* released = buf.get();
+    buf.reset();
+    buf = PacketBufferPool::acquire();
+    assertEqual((void*)buf.get(), (void*)released);
+    assertEqual(buf->getSize(), 0);
+}
+
+void testPacketBufferPoolSteadyState() {
+    const size_t numBufs = 300;
+
+    std::vector<PacketBufferHandle> bufs;
+    for (size_t i = 0; i < numBufs; ++i) {
+        bufs.push_back(PacketBufferPool::acquire());
+    }
+    for (size_t i = 1; i < numBufs; ++i) {
+        assertEqual((bufs[i].get() != bufs[i - 1].get()), true);
+    }
+    size_t numAllocated = PacketBufferPool::getNumAllocated();
+    bufs.clear();
+
+    // Once warmed up, the same traffic doesn't allocate more
+    for (size_t i = 0; i < numBufs; ++i) {
+        bufs.push_back(PacketBufferPool::acquire());
+    }
+    bufs.clear();
+    assertEqual(PacketBufferPool::getNumAllocated(), numAllocated);
+}
+
+void testPacketBufferPoolCrossThread() {
+    const size_t numBufs = 300;
+
+    std::vector<PacketBufferHandle> bufs;
+    for (size_t i = 0; i < numBufs; ++i) {
+        bufs.push_back(PacketBufferPool::acquire());
+    }
+    size_t numAllocated = PacketBufferPool::getNumAllocated();
+
+    // Released on another thread, and handed back to the shared list when that thread exits
+    std::thread releaseThread([&bufs]() {
+        bufs.clear();
+    });
+    releaseThread.join();
+
+    for (size_t i = 0; i < numBufs; ++i) {
+        bufs.push_back(PacketBufferPool::acquire());
+    }
+    bufs.clear();
+    assertEqual(PacketBufferPool::getNumAllocated(), numAllocated);
+}
+
+void testPacketBufferPoolStringPadding() {
+    PacketBufferHandle buf = PacketBufferPool::acquire();
+
+    // Left over from some earlier packet
+    memset(buf->getData(), 0xFF, PacketBuffer::CAPACITY);
+
+    // Strings are byte aligned after their length, and the bits skipped to get there are zeroed rather than kept
+    BitStream stream(buf->getData(), PacketBuffer::CAPACITY);
+    stream.writeBitField(0x7, 3);
+    stream.write(std::string("ab"));
+    stream.writeBitField(0x7, 3);
+    stream.write(std::wstring(L"a"));
+
+    std::vector<uint8_t> encoded(buf->getData(), buf->getData() + BITS_TO_BYTES(stream.getPos()));
+    assertBuffersEqual(encoded, std::vector<uint8_t>({ 0xF0, 0x40, 0x61, 0x62, 0xF0, 0x20, 0x61, 0x00 }));
+}
+
+void testPacketBufferPool() {
+    testPacketBufferPoolReuse();
+    testPacketBufferPoolSteadyState();
+    testPacketBufferPoolCrossThread();
+    testPacketBufferPoolStringPadding();
+}
+
+void benchPacketBufferPool() {
+    size_t numIters = 1000000;
+    size_t bytesWritten = 0;
+
+    std::cout << "PacketBufferPool" << std::endl;
+    benchmark("  acquire + release", numIters, {
+        PacketBufferHandle buf = PacketBufferPool::acquire();
+        buf->getData()[0] = (uint8_t)benchIter;
+        buf->setSize(1);
+        bytesWritten += buf->getSize();
+    });
+    benchmark("  vector per send", numIters, {
+        std::vector<uint8_t> buf;
+        buf.reserve(PacketBuffer::CAPACITY);
+        buf.push_back((uint8_t)benchIter);
+        bytesWritten += buf.size();
+    });
+
+    benchKeep(bytesWritten);
+}
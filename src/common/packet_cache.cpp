@@ -0,0 +1,12 @@
+#include "packet_cache.h"
+
+PacketCache::PacketCache() :
+    version(0) {
+
+}
+
+void PacketCache::invalidate() {
+    std::lock_guard<std::mutex> lock(mutex);
+    std::atomic_store(&current, EntryHandle());
+    version.fetch_add(1, std::memory_order_relaxed);
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "bitstream.h"
+
+/**
+ * One packet that every client gets the same copy of (such as the world list), kept encoded so it isn't rebuilt per send.
+ *
+ * The packet is encoded on the first get after it's invalidated, and each encoding gets a new version number.
+ * Readers hold a reference to the encoding they got, so invalidating never pulls bytes out from under a send in progress,
+ * and gets from several server shards at once only ever encode it once.
+ */
+class PacketCache {
+public:
+    class Entry {
+    public:
+        // The encoded packet, starting with its opcode
+        std::vector<uint8_t> data;
+        uint64_t version;
+    };
+
+    typedef std::shared_ptr<const Entry> EntryHandle;
+
+    PacketCache();
+
+    /**
+     * Gets the encoded packet, calling encode(bitStream) to encode it first if it was invalidated.
+     * An encode that leaves the stream with an error isn't cached, so the next get tries again.
+     * @return The encoding, which stays valid for as long as the handle is held, or an empty handle if encoding failed
+     */
+    template<typename EncodeFunc>
+    EntryHandle get(EncodeFunc encode) {
+        EntryHandle entry = std::atomic_load(&current);
+        if (entry) {
+            return entry;
+        }
+
+        std::lock_guard<std::mutex> lock(mutex);
+
+        // Another thread may have encoded it while this one waited for the lock
+        entry = std::atomic_load(&current);
+        if (entry) {
+            return entry;
+        }
+
+        std::shared_ptr<Entry> newEntry = std::make_shared<Entry>();
+        BitStream encodeStream(newEntry->data);
+        encode(encodeStream);
+        if (encodeStream.getLastError() != BitStream::Error::NONE) {
+            return EntryHandle();
+        }
+
+        encodeStream.trimToPos();
+        newEntry->version = version.load(std::memory_order_relaxed);
+
+        entry = newEntry;
+        std::atomic_store(&current, entry);
+        return entry;
+    }
+
+    /**
+     * Drops the encoded packet, so that the next get encodes it again with the new contents.
+     */
+    void invalidate();
+
+    /**
+     * @return The version the next encoding gets (or the current one has, if it hasn't been invalidated since)
+     */
+    uint64_t getVersion() const {
+        return version.load(std::memory_order_relaxed);
+    }
+
+private:
+    // Taken when encoding and invalidating, so an encoding of the old contents can't land after an invalidate
+    std::mutex mutex;
+    EntryHandle current;
+    std::atomic<uint64_t> version;
+};
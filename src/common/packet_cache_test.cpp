@@ -0,0 +1,129 @@
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <thread>
+#include <vector>
+#include "bench.h"
+#include "enums.h"
+#include "log.h"
+#include "packet_cache.h"
+#include "packet_cache_test.h"
+#include "test.h"
+#include "packet/game/VNLWorldStatusMessage.h"
+
+void testPacketCacheInvalidate() {
+    PacketCache cache;
+    size_t numEncodes = 0;
+    uint8_t contents = 0x11;
+    auto encode = [&numEncodes, &contents](BitStream& bitStream) {
+        numEncodes++;
+        bitStream.write(contents);
+        bitStream.write((uint16_t)0x2233);
+    };
+
+    PacketCache::EntryHandle first = cache.get(encode);
+    assertBuffersEqual(first->data, std::vector<uint8_t>({ 0x11, 0x33, 0x22 }));
+    assertEqual(first->version, 0);
+    assertEqual((cache.get(encode) == first), true);
+    assertEqual(numEncodes, 1);
+
+    // Encoded again with the new contents, while the old encoding stays valid for whoever still holds it
+    contents = 0x44;
+    cache.invalidate();
+    assertEqual(cache.getVersion(), 1);
+    PacketCache::EntryHandle second = cache.get(encode);
+    assertBuffersEqual(second->data, std::vector<uint8_t>({ 0x44, 0x33, 0x22 }));
+    assertEqual(second->version, 1);
+    assertEqual(numEncodes, 2);
+    assertBuffersEqual(first->data, std::vector<uint8_t>({ 0x11, 0x33, 0x22 }));
+}
+
+void testPacketCacheEncodeError() {
+    PacketCache cache;
+    bool fail = true;
+    auto encode = [&fail](BitStream& bitStream) {
+        bitStream.write((uint8_t)0x66);
+        if (fail) {
+            bitStream.setError(BitStream::Error::INVALID_VALUE);
+        }
+    };
+
+    // A failed encode isn't kept, so the next get tries again
+    assertEqual((cache.get(encode) == nullptr), true);
+    fail = false;
+    PacketCache::EntryHandle entry = cache.get(encode);
+    assertEqual((entry != nullptr), true);
+    assertBuffersEqual(entry->data, std::vector<uint8_t>({ 0x66 }));
+}
+
+void testPacketCacheThreads() {
+    PacketCache cache;
+    std::atomic<size_t> numEncodes(0);
+    auto encode = [&numEncodes](BitStream& bitStream) {
+        numEncodes++;
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        bitStream.write((uint8_t)0x55);
+    };
+
+    // Every thread asks at once, and only the first one in encodes
+    std::vector<std::thread> threads;
+    std::vector<PacketCache::EntryHandle> entries(8);
+    for (size_t i = 0; i < entries.size(); ++i) {
+        threads.emplace_back([&cache, &encode, &entries, i]() {
+            entries[i] = cache.get(encode);
+        });
+    }
+
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+
+    assertEqual(numEncodes.load(), 1);
+    for (const PacketCache::EntryHandle& entry : entries) {
+        assertEqual((entry == entries[0]), true);
+    }
+}
+
+void testPacketCache() {
+    testPacketCacheInvalidate();
+    testPacketCacheEncodeError();
+    testPacketCacheThreads();
+}
+
+void encodeBenchWorldStatus(BitStream& bitStream) {
+    VNLWorldStatusMessage::WorldInfo world;
+    world.name = "hello_c++";
+    world.status2 = VNLWorldStatusMessage::WS_Up;
+    world.serverType = VNLWorldStatusMessage::ST_Released;
+    world.status1 = VNLWorldStatusMessage::WS_Up;
+    world.empireNeed = EM_NC;
+
+    VNLWorldStatusMessage packet;
+    packet.welcomeMessage = L"ASDF";
+    packet.worlds.push_back(world);
+
+    bitStream.reserve(packet.maxEncodedBits());
+    packet.encode(bitStream);
+}
+
+void benchPacketCache() {
+    size_t numIters = 1000000;
+    size_t bytesCopied = 0;
+    std::vector<uint8_t> sendBuf(1024);
+
+    PacketCache cache;
+    std::cout << "PacketCache" << std::endl;
+    benchmark("  build + encode world status", numIters, {
+        BitStream sendStream(sendBuf.data(), sendBuf.size());
+        encodeBenchWorldStatus(sendStream);
+        bytesCopied += sendStream.getPos();
+    });
+
+    benchmark("  get + copy world status", numIters, {
+        PacketCache::EntryHandle entry = cache.get(encodeBenchWorldStatus);
+        memcpy(sendBuf.data(), entry->data.data(), entry->data.size());
+        bytesCopied += entry->data.size();
+    });
+
+    benchKeep(bytesCopied);
+}
@@ -0,0 +1,66 @@
+#include "packet_coalescer.h"
+#include "packet/opcodes.h"
+#include "packet/control/MultiPacketEx.h"
+
+PacketCoalescer::PacketCoalescer() :
+    entriesSize(0),
+    numPackets(0),
+    firstPrefixSize(0),
+    hasLongPacket(false) {
+
+}
+
+bool PacketCoalescer::fits(size_t size) const {
+    if (numPackets == 0) {
+        return size <= MAX_FRAME_SIZE;
+    }
+
+    return MULTI_PACKET_HEADER_SIZE + entriesSize + MultiPacketEx::encodedSizeBytes(size) + size <= MAX_FRAME_SIZE;
+}
+
+void PacketCoalescer::add(const uint8_t* data, size_t size) {
+    if (!entries) {
+        entries = PacketBufferPool::acquire();
+    }
+
+    BitStream entriesStream(entries->getData() + entriesSize, PacketBuffer::CAPACITY - entriesSize);
+    MultiPacketEx::writeSize(entriesStream, size);
+    entriesStream.writeBytes(data, size);
+
+    size_t prefixSize = MultiPacketEx::encodedSizeBytes(size);
+    if (numPackets == 0) {
+        firstPrefixSize = prefixSize;
+    }
+
+    entriesSize += prefixSize + size;
+    numPackets++;
+    hasLongPacket |= prefixSize > 1;
+}
+
+size_t PacketCoalescer::getFrameSize() const {
+    if (numPackets <= 1) {
+        return entriesSize - firstPrefixSize;
+    }
+
+    return MULTI_PACKET_HEADER_SIZE + entriesSize;
+}
+
+void PacketCoalescer::take(BitStream& bitStream) {
+    if (numPackets == 1) {
+        bitStream.writeBytes(entries->getData() + firstPrefixSize, entriesSize - firstPrefixSize);
+    } else if (numPackets > 1) {
+        uint8_t opcode = 0x00;
+        bitStream.write(opcode);
+        uint8_t controlOpcode = hasLongPacket ? OP_MultiPacketEx : OP_MultiPacket;
+        bitStream.write(controlOpcode);
+
+        bitStream.writeBytes(entries->getData(), entriesSize);
+    }
+
+    // Hand the buffer back rather than holding one per idle session
+    entries.reset();
+    entriesSize = 0;
+    numPackets = 0;
+    firstPrefixSize = 0;
+    hasLongPacket = false;
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstdint>
+#include "bitstream.h"
+#include "packet_buffer.h"
+
+/**
+ * Packs a session's outgoing packets into as few datagrams as possible.
+ *
+ * Packets are added to a pending frame until the next one wouldn't fit in a datagram, or the frame is taken
+ * when the server flushes. A frame of several packets is sent as one OP_MultiPacket (or OP_MultiPacketEx),
+ * so it pays for one header, MAC, padding and syscall rather than one each.
+ */
+class PacketCoalescer {
+public:
+    // Largest frame, leaving room in a PacketBuffer for the encrypted header (4 bytes), MAC (16) and padding (up to 8)
+    static const size_t MAX_FRAME_SIZE = PacketBuffer::CAPACITY - 32;
+
+    PacketCoalescer();
+
+    /**
+     * @return Whether a packet of the given size fits in the pending frame
+     */
+    bool fits(size_t size) const;
+
+    /**
+     * Appends a packet to the pending frame. It must fit.
+     */
+    void add(const uint8_t* data, size_t size);
+
+    /**
+     * @return The number of packets in the pending frame
+     */
+    size_t getNumPackets() const {
+        return numPackets;
+    }
+
+    /**
+     * @return The encoded size of the pending frame, in bytes
+     */
+    size_t getFrameSize() const;
+
+    /**
+     * Writes the pending frame and empties it. A lone packet is written as is, and several are wrapped in
+     * an OP_MultiPacket, or an OP_MultiPacketEx if any of them is too big for a one byte size.
+     */
+    void take(BitStream& bitStream);
+
+private:
+    // Zero byte and opcode of the multi packet
+    static const size_t MULTI_PACKET_HEADER_SIZE = 2;
+
+    // The packets so far, each prefixed by its size, or empty if there are none
+    PacketBufferHandle entries;
+    size_t entriesSize;
+    size_t numPackets;
+    // Size of the first packet's prefix, to skip when it's sent alone
+    size_t firstPrefixSize;
+    bool hasLongPacket;
+};
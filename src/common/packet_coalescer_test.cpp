@@ -0,0 +1,94 @@
+#include <vector>
+#include "bench.h"
+#include "log.h"
+#include "packet_coalescer.h"
+#include "packet_coalescer_test.h"
+#include "test.h"
+#include "util.h"
+
+/**
+ * Takes the coalescer's pending frame into a vector.
+ */
+std::vector<uint8_t> takeFrame(PacketCoalescer& coalescer) {
+    size_t frameSize = coalescer.getFrameSize();
+
+    std::vector<uint8_t> frame;
+    BitStream frameStream(frame);
+    coalescer.take(frameStream);
+    assertEqual(frame.size(), frameSize);
+    assertEqual(coalescer.getNumPackets(), 0);
+    return frame;
+}
+
+void testPacketCoalescerSingle() {
+    PacketCoalescer coalescer;
+    std::vector<uint8_t> packet = hexToBytes("0102030405");
+    coalescer.add(packet.data(), packet.size());
+
+    // A lone packet goes out as is
+    assertBuffersEqual(takeFrame(coalescer), packet);
+}
+
+void testPacketCoalescerMulti() {
+    PacketCoalescer coalescer;
+    std::vector<uint8_t> packet1 = hexToBytes("0102");
+    std::vector<uint8_t> packet2 = hexToBytes("000D0300AA");
+    coalescer.add(packet1.data(), packet1.size());
+    coalescer.add(packet2.data(), packet2.size());
+    assertEqual(coalescer.getNumPackets(), 2);
+    assertBuffersEqual(takeFrame(coalescer), hexToBytes("0003 02 0102 05 000D0300AA"));
+
+    // Long packets need the extended sizes
+    std::vector<uint8_t> longPacket(300, 0xAB);
+    coalescer.add(packet1.data(), packet1.size());
+    coalescer.add(longPacket.data(), longPacket.size());
+    std::vector<uint8_t> expected = hexToBytes("0019 02 0102 FF2C01");
+    expected.insert(expected.end(), longPacket.begin(), longPacket.end());
+    assertBuffersEqual(takeFrame(coalescer), expected);
+}
+
+void testPacketCoalescerFits() {
+    PacketCoalescer coalescer;
+    assertEqual(coalescer.fits(PacketCoalescer::MAX_FRAME_SIZE), true);
+    assertEqual(coalescer.fits(PacketCoalescer::MAX_FRAME_SIZE + 1), false);
+
+    // Fill the frame exactly: multi packet header, the first packet and its 3 byte size, then a 1 byte packet and its size
+    std::vector<uint8_t> packet(PacketCoalescer::MAX_FRAME_SIZE - 2 - 3 - 2, 0x11);
+    coalescer.add(packet.data(), packet.size());
+    assertEqual(coalescer.fits(1), true);
+    assertEqual(coalescer.fits(2), false);
+    coalescer.add(packet.data(), 1);
+    assertEqual(coalescer.getFrameSize(), PacketCoalescer::MAX_FRAME_SIZE);
+    assertEqual(coalescer.fits(0), false);
+
+    takeFrame(coalescer);
+    assertEqual(coalescer.fits(PacketCoalescer::MAX_FRAME_SIZE), true);
+}
+
+void testPacketCoalescer() {
+    testPacketCoalescerSingle();
+    testPacketCoalescerMulti();
+    testPacketCoalescerFits();
+}
+
+void benchPacketCoalescer() {
+    size_t numIters = 1000000;
+    size_t bytesTaken = 0;
+
+    // Zone entry sized messages
+    std::vector<uint8_t> packet(40, 0x22);
+    std::array<uint8_t, PacketBuffer::CAPACITY> frameBuf;
+
+    PacketCoalescer coalescer;
+    std::cout << "PacketCoalescer" << std::endl;
+    benchmark("  add 4 + take", numIters, {
+        for (int i = 0; i < 4; ++i) {
+            coalescer.add(packet.data(), packet.size());
+        }
+        BitStream frameStream(frameBuf.data(), frameBuf.size());
+        coalescer.take(frameStream);
+        bytesTaken += frameStream.getPos() / 8;
+    });
+
+    benchKeep(bytesTaken);
+}
@@ -0,0 +1,76 @@
+#include <algorithm>
+#include "reliable_channel.h"
+
+ReliableChannel::ReliableChannel() :
+    baseSubslot(0),
+    nextSubslot(0),
+    hasRttSample(false),
+    smoothedRttMS(0),
+    rttVarianceMS(0),
+    rtoMS(INITIAL_RTO_MS) {
+
+}
+
+void ReliableChannel::queue(PacketBufferHandle payload, uint8_t slot) {
+    QueuedPacket queuedPacket;
+    queuedPacket.payload = std::move(payload);
+    queuedPacket.slot = slot;
+    queued.push_back(std::move(queuedPacket));
+}
+
+void ReliableChannel::ack(uint16_t subslot, size_t nowMS) {
+    if ((uint16_t)(subslot - baseSubslot) >= numInFlight()) {
+        return;
+    }
+
+    Entry& entry = getEntry(subslot);
+    if (!entry.payload) {
+        return;
+    }
+
+    // Only packets sent once give a clean sample, since an ack for a resent one could be for either send (Karn's algorithm)
+    if (entry.numSends == 1) {
+        addRttSample(nowMS - entry.firstSentMS);
+    }
+
+    entry.payload.reset();
+
+    // Slide the window past everything acked at its start
+    while (baseSubslot != nextSubslot && !getEntry(baseSubslot).payload) {
+        baseSubslot++;
+    }
+}
+
+void ReliableChannel::nack(uint16_t subslot) {
+    if ((uint16_t)(subslot - baseSubslot) >= numInFlight()) {
+        return;
+    }
+
+    Entry& entry = getEntry(subslot);
+    if (entry.payload && entry.numSends > 0) {
+        entry.dueMS = 0;
+    }
+}
+
+bool ReliableChannel::receive(uint16_t subslot) {
+    if (!recvSubslots.check(subslot)) {
+        return false;
+    }
+
+    recvSubslots.accept(subslot);
+    return true;
+}
+
+void ReliableChannel::addRttSample(size_t rttMS) {
+    if (!hasRttSample) {
+        hasRttSample = true;
+        smoothedRttMS = rttMS;
+        rttVarianceMS = rttMS / 2;
+    } else {
+        size_t deviationMS = smoothedRttMS > rttMS ? smoothedRttMS - rttMS : rttMS - smoothedRttMS;
+        rttVarianceMS = (3 * rttVarianceMS + deviationMS) / 4;
+        smoothedRttMS = (7 * smoothedRttMS + rttMS) / 8;
+    }
+
+    rtoMS = std::min(std::max(smoothedRttMS + 4 * rttVarianceMS, (size_t)MIN_RTO_MS), (size_t)MAX_RTO_MS);
+}
@@ -0,0 +1,164 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <deque>
+#include "packet_buffer.h"
+#include "sequence_window.h"
+
+/**
+ * Reliable delivery of inner packets over slotted packets (OP_SlottedMetaPacket*), for one session.
+ *
+ * Outbound packets are numbered with consecutive subslots and kept in a ring of unacked packets
+ * until the client acks them by subslot (OP_RelatedB*). Each ack covers only its own subslot, so
+ * losing one packet doesn't hold up acking the ones after it. Packets still unacked after the
+ * retransmit timeout are sent again, with the timeout doubling on every resend, and a nack from the
+ * client (OP_RelatedA*) resends its packet on the next poll. The timeout follows measured round
+ * trips, in the style of TCP (RFC 6298).
+ *
+ * Inbound, the channel remembers which recent subslots have arrived, so that packets the client
+ * resends (because our ack was lost) are acked again but only handled once.
+ */
+class ReliableChannel {
+public:
+    // Most packets that can be unacked at once. More wait in a queue until acks make room
+    static const size_t WINDOW_SIZE = 64;
+
+    static const size_t INITIAL_RTO_MS = 500;
+    static const size_t MIN_RTO_MS = 100;
+    static const size_t MAX_RTO_MS = 4000;
+
+    // Sends of one packet (including the first) before giving up on the client
+    static const uint8_t MAX_SENDS = 8;
+
+    ReliableChannel();
+
+    /**
+     * Queues an inner packet for delivery in the given slot. It's first sent by the next poll that has room in the window.
+     * All slots share one run of subslots, so packets queued together get consecutive subslots.
+     */
+    void queue(PacketBufferHandle payload, uint8_t slot);
+
+    /**
+     * Sends whatever is due: queued packets that fit in the window, then unacked packets whose timeout passed or that were nacked.
+     * Calls send(slot, subslot, payload) for each, where payload is the inner packet to wrap in a slotted packet.
+     * @return Whether every unacked packet is still within MAX_SENDS. If not, the client is unreachable and the session should be closed
+     */
+    template<typename SendFunc>
+    bool poll(size_t nowMS, SendFunc send) {
+        while (!queued.empty() && numInFlight() < WINDOW_SIZE) {
+            Entry& entry = getEntry(nextSubslot);
+            entry.payload = std::move(queued.front().payload);
+            entry.slot = queued.front().slot;
+            entry.firstSentMS = nowMS;
+            entry.numSends = 0;
+            entry.dueMS = nowMS;
+            queued.pop_front();
+            nextSubslot++;
+        }
+
+        for (uint16_t subslot = baseSubslot; subslot != nextSubslot; ++subslot) {
+            Entry& entry = getEntry(subslot);
+            if (!entry.payload || entry.dueMS > nowMS) {
+                continue;
+            }
+
+            if (entry.numSends >= MAX_SENDS) {
+                return false;
+            }
+
+            send(entry.slot, subslot, *entry.payload);
+
+            // Back off exponentially, in case the loss is from congestion
+            entry.numSends++;
+            entry.dueMS = nowMS + std::min(rtoMS << (entry.numSends - 1), (size_t)MAX_RTO_MS);
+        }
+
+        return true;
+    }
+
+    /**
+     * Handles an ack from the client, freeing the packet and taking a round trip sample from it.
+     * Acks for subslots that aren't unacked (such as a second ack for the same packet) are ignored.
+     */
+    void ack(uint16_t subslot, size_t nowMS);
+
+    /**
+     * Handles a nack from the client, making the packet due to be resent on the next poll.
+     */
+    void nack(uint16_t subslot);
+
+    /**
+     * @return Whether a slotted packet from the client would be new, without recording it as receive does
+     */
+    bool isNew(uint16_t subslot) const {
+        return recvSubslots.check(subslot);
+    }
+
+    /**
+     * Records that a slotted packet arrived from the client.
+     * @return Whether it is new. Duplicates, and packets too old to tell apart from duplicates, should still be acked but not handled
+     */
+    bool receive(uint16_t subslot);
+
+    /**
+     * @return The number of packets sent but not yet acked
+     */
+    size_t numInFlight() const {
+        return (uint16_t)(nextSubslot - baseSubslot);
+    }
+
+    /**
+     * @return The number of packets waiting for room in the window
+     */
+    size_t numQueued() const {
+        return queued.size();
+    }
+
+    /**
+     * @return The current retransmit timeout, before any backoff
+     */
+    size_t getRtoMS() const {
+        return rtoMS;
+    }
+
+private:
+    class Entry {
+    public:
+        // Empty once acked
+        PacketBufferHandle payload;
+        uint8_t slot;
+        size_t firstSentMS;
+        size_t dueMS;
+        uint8_t numSends;
+    };
+
+    class QueuedPacket {
+    public:
+        PacketBufferHandle payload;
+        uint8_t slot;
+    };
+
+    Entry& getEntry(uint16_t subslot) {
+        return sendRing[subslot % WINDOW_SIZE];
+    }
+
+    /**
+     * Updates the round trip estimates and timeout with a new sample.
+     */
+    void addRttSample(size_t rttMS);
+
+    std::array<Entry, WINDOW_SIZE> sendRing;
+    std::deque<QueuedPacket> queued;
+    // Oldest unacked subslot, and the subslot the next packet sent gets
+    uint16_t baseSubslot;
+    uint16_t nextSubslot;
+
+    bool hasRttSample;
+    size_t smoothedRttMS;
+    size_t rttVarianceMS;
+    size_t rtoMS;
+
+    SequenceWindow recvSubslots;
+};
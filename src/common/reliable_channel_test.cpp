@@ -0,0 +1,178 @@
+#include <vector>
+#include "bench.h"
+#include "reliable_channel.h"
+#include "reliable_channel_test.h"
+#include "test.h"
+
+PacketBufferHandle makeTestPayload(uint8_t value) {
+    PacketBufferHandle payload = PacketBufferPool::acquire();
+    payload->getData()[0] = value;
+    payload->setSize(1);
+    return payload;
+}
+
+/**
+ * Polls the channel, collecting the subslots it sends.
+ */
+std::vector<uint16_t> pollSubslots(ReliableChannel& channel, size_t nowMS, bool* keepGoing = nullptr) {
+    std::vector<uint16_t> sent;
+    bool result = channel.poll(nowMS, [&sent](uint8_t slot, uint16_t subslot, const PacketBuffer& payload) {
+        sent.push_back(subslot);
+    });
+
+    if (keepGoing != nullptr) {
+        *keepGoing = result;
+    }
+
+    return sent;
+}
+
+void testReliableChannelAck() {
+    ReliableChannel channel;
+    for (uint8_t i = 0; i < 3; ++i) {
+        channel.queue(makeTestPayload(i), 0);
+    }
+
+    std::vector<uint16_t> sent = pollSubslots(channel, 1000);
+    assertEqual(sent.size(), 3);
+    assertEqual(sent[0], 0);
+    assertEqual(sent[2], 2);
+    assertEqual(channel.numInFlight(), 3);
+
+    // Acks are selective, so the window only slides once its oldest packet is acked
+    channel.ack(1, 1010);
+    assertEqual(channel.numInFlight(), 3);
+    channel.ack(0, 1010);
+    assertEqual(channel.numInFlight(), 1);
+    channel.ack(0, 1010);
+    assertEqual(channel.numInFlight(), 1);
+
+    // Nothing is resent before the timeout, then only the unacked packet
+    assertEqual(pollSubslots(channel, 1010).size(), 0);
+    sent = pollSubslots(channel, 1000 + ReliableChannel::INITIAL_RTO_MS);
+    assertEqual(sent.size(), 1);
+    assertEqual(sent[0], 2);
+
+    channel.ack(2, 1600);
+    assertEqual(channel.numInFlight(), 0);
+}
+
+void testReliableChannelNack() {
+    ReliableChannel channel;
+    channel.queue(makeTestPayload(0), 0);
+    channel.queue(makeTestPayload(1), 0);
+    pollSubslots(channel, 0);
+
+    // A nack resends straight away, rather than waiting out the timeout
+    channel.nack(0);
+    std::vector<uint16_t> sent = pollSubslots(channel, 10);
+    assertEqual(sent.size(), 1);
+    assertEqual(sent[0], 0);
+
+    // Nacks for packets that aren't in flight are ignored
+    channel.nack(5);
+    assertEqual(pollSubslots(channel, 20).size(), 0);
+}
+
+void testReliableChannelSlots() {
+    ReliableChannel channel;
+    channel.queue(makeTestPayload(0), 0);
+    channel.queue(makeTestPayload(1), 4);
+
+    // Slots share one run of subslots
+    std::vector<uint8_t> slots;
+    std::vector<uint16_t> subslots;
+    channel.poll(0, [&slots, &subslots](uint8_t slot, uint16_t subslot, const PacketBuffer& payload) {
+        slots.push_back(slot);
+        subslots.push_back(subslot);
+    });
+    assertEqual(slots.size(), 2);
+    assertEqual(slots[0], 0);
+    assertEqual(slots[1], 4);
+    assertEqual(subslots[0], 0);
+    assertEqual(subslots[1], 1);
+}
+
+void testReliableChannelWindow() {
+    ReliableChannel channel;
+    for (size_t i = 0; i < ReliableChannel::WINDOW_SIZE + 5; ++i) {
+        channel.queue(makeTestPayload((uint8_t)i), 0);
+    }
+
+    assertEqual(pollSubslots(channel, 0).size(), ReliableChannel::WINDOW_SIZE);
+    assertEqual(channel.numQueued(), 5);
+
+    channel.ack(0, 10);
+    std::vector<uint16_t> sent = pollSubslots(channel, 10);
+    assertEqual(sent.size(), 1);
+    assertEqual(sent[0], ReliableChannel::WINDOW_SIZE);
+    assertEqual(channel.numQueued(), 4);
+}
+
+void testReliableChannelGiveUp() {
+    ReliableChannel channel;
+    channel.queue(makeTestPayload(0), 0);
+
+    size_t numSends = 0;
+    bool keepGoing = true;
+    for (size_t nowMS = 0; nowMS < 60000 && keepGoing; nowMS += 50) {
+        numSends += pollSubslots(channel, nowMS, &keepGoing).size();
+    }
+
+    assertEqual(keepGoing, false);
+    assertEqual(numSends, ReliableChannel::MAX_SENDS);
+}
+
+void testReliableChannelRto() {
+    ReliableChannel channel;
+    assertEqual(channel.getRtoMS(), ReliableChannel::INITIAL_RTO_MS);
+
+    channel.queue(makeTestPayload(0), 0);
+    pollSubslots(channel, 0);
+    channel.ack(0, 40);
+    assertEqual(channel.getRtoMS(), 120);
+
+    // Resent packets don't give samples, since the ack could be for either send
+    channel.queue(makeTestPayload(1), 0);
+    pollSubslots(channel, 100);
+    pollSubslots(channel, 100 + 120);
+    channel.ack(1, 2000);
+    assertEqual(channel.getRtoMS(), 120);
+}
+
+void testReliableChannelReceive() {
+    // See SequenceWindow for the details
+    ReliableChannel channel;
+    assertEqual(channel.receive(10), true);
+    assertEqual(channel.receive(10), false);
+    assertEqual(channel.receive(12), true);
+    assertEqual(channel.receive(11), true);
+    assertEqual(channel.receive(11), false);
+}
+
+void testReliableChannel() {
+    testReliableChannelAck();
+    testReliableChannelNack();
+    testReliableChannelSlots();
+    testReliableChannelWindow();
+    testReliableChannelGiveUp();
+    testReliableChannelRto();
+    testReliableChannelReceive();
+}
+
+void benchReliableChannel() {
+    size_t numIters = 1000000;
+    size_t bytesSent = 0;
+
+    ReliableChannel channel;
+    std::cout << "ReliableChannel" << std::endl;
+    benchmark("  queue + send + ack", numIters, {
+        channel.queue(makeTestPayload((uint8_t)benchIter), 0);
+        channel.poll(benchIter, [&bytesSent](uint8_t slot, uint16_t subslot, const PacketBuffer& payload) {
+            bytesSent += payload.getSize();
+        });
+        channel.ack((uint16_t)benchIter, benchIter + 1);
+    });
+
+    benchKeep(bytesSent);
+}
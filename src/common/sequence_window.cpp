@@ -0,0 +1,67 @@
+#include "sequence_window.h"
+
+SequenceWindow::SequenceWindow() :
+    hasSeen(false),
+    newestSeq(0),
+    seenBitmap(0),
+    resetRequested(false) {
+
+}
+
+bool SequenceWindow::check(uint16_t seq) const {
+    if (!hasSeen || resetRequested) {
+        return true;
+    }
+
+    uint16_t ahead = (uint16_t)(seq - newestSeq);
+    if (ahead != 0 && ahead < 0x8000) {
+        return ahead <= MAX_AHEAD;
+    }
+
+    uint16_t behind = (uint16_t)(newestSeq - seq);
+    if (behind >= WINDOW_SIZE) {
+        return false;
+    }
+
+    return (seenBitmap & (1ULL << behind)) == 0;
+}
+
+void SequenceWindow::accept(uint16_t seq) {
+    if (resetRequested) {
+        reset();
+    }
+
+    if (!hasSeen) {
+        hasSeen = true;
+        newestSeq = seq;
+        seenBitmap = 1;
+        return;
+    }
+
+    uint16_t ahead = (uint16_t)(seq - newestSeq);
+    if (ahead != 0 && ahead < 0x8000) {
+        if (ahead > MAX_AHEAD) {
+            return;
+        }
+
+        seenBitmap = ahead < WINDOW_SIZE ? (seenBitmap << ahead) | 1 : 1;
+        newestSeq = seq;
+        return;
+    }
+
+    uint16_t behind = (uint16_t)(newestSeq - seq);
+    if (behind < WINDOW_SIZE) {
+        seenBitmap |= 1ULL << behind;
+    }
+}
+
+void SequenceWindow::requestReset() {
+    resetRequested = true;
+}
+
+void SequenceWindow::reset() {
+    hasSeen = false;
+    newestSeq = 0;
+    seenBitmap = 0;
+    resetRequested = false;
+}
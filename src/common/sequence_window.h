@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * Tracks which recent 16-bit sequence numbers have arrived, to drop duplicates.
+ *
+ * Remembers the newest number seen and a bitmap of the WINDOW_SIZE numbers before it, so checking is a shift and a mask.
+ * Numbers more than half the sequence space ahead of the newest are taken as old ones that wrapped around.
+ *
+ * This suppresses duplicates, it doesn't stop replays: packet headers aren't covered by the MAC, so anyone can resend a
+ * captured datagram under a new number. What it does bound is the harm such a number can do. Numbers more than
+ * MAX_AHEAD past the newest are rejected rather than sliding the window there, so a forged one only makes the real
+ * ones that follow it look stale until they catch up, instead of shutting them out for good.
+ */
+class SequenceWindow {
+public:
+    static const size_t WINDOW_SIZE = 64;
+
+    // Furthest past the newest number that's accepted. Well beyond any run of packets a client loses in one go
+    static const uint16_t MAX_AHEAD = 256;
+
+    SequenceWindow();
+
+    /**
+     * @return Whether the number is new: up to MAX_AHEAD ahead of the newest, or within the window and not seen yet.
+     * Numbers too far behind to tell apart from duplicates are rejected. Anything goes while a reset is requested
+     */
+    bool check(uint16_t seq) const;
+
+    /**
+     * Marks a number as seen, sliding the window forward if it's the newest yet. Does the requested reset first, if any.
+     * Split from check so that datagrams can be checked before decrypting, but only accepted once their MAC matches.
+     */
+    void accept(uint16_t seq);
+
+    /**
+     * Resets the window on the next accept, for when the client says it's numbering from scratch.
+     * Waiting for an accept means the reset only takes effect once a packet with a matching MAC follows, since the
+     * request itself can come from anyone.
+     */
+    void requestReset();
+
+    /**
+     * Forgets every number seen, so the next one is accepted whatever it is.
+     */
+    void reset();
+
+private:
+    bool hasSeen;
+    uint16_t newestSeq;
+    // Bit n is set if newestSeq - n has arrived
+    uint64_t seenBitmap;
+    bool resetRequested;
+};
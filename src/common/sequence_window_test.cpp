@@ -0,0 +1,104 @@
+#include "bench.h"
+#include "sequence_window.h"
+#include "sequence_window_test.h"
+#include "test.h"
+
+/**
+ * Checks a number, and accepts it if it's new.
+ * @return Whether it was new
+ */
+bool checkAndAccept(SequenceWindow& window, uint16_t seq) {
+    if (!window.check(seq)) {
+        return false;
+    }
+
+    window.accept(seq);
+    return true;
+}
+
+void testSequenceWindowOrder() {
+    SequenceWindow window;
+    assertEqual(checkAndAccept(window, 10), true);
+    assertEqual(checkAndAccept(window, 10), false);
+    assertEqual(checkAndAccept(window, 12), true);
+    assertEqual(checkAndAccept(window, 11), true);
+    assertEqual(checkAndAccept(window, 11), false);
+
+    // Too far behind to tell apart from a duplicate
+    assertEqual(checkAndAccept(window, 200), true);
+    assertEqual(checkAndAccept(window, 200 - SequenceWindow::WINDOW_SIZE + 1), true);
+    assertEqual(checkAndAccept(window, 200 - SequenceWindow::WINDOW_SIZE), false);
+    assertEqual(checkAndAccept(window, 100), false);
+
+    // Numbers wrap around
+    SequenceWindow wrapWindow;
+    assertEqual(checkAndAccept(wrapWindow, 0xFFFE), true);
+    assertEqual(checkAndAccept(wrapWindow, 1), true);
+    assertEqual(checkAndAccept(wrapWindow, 0xFFFF), true);
+    assertEqual(checkAndAccept(wrapWindow, 0xFFFE), false);
+    assertEqual(checkAndAccept(wrapWindow, 0), true);
+}
+
+void testSequenceWindowCheckOnly() {
+    SequenceWindow window;
+    window.accept(5);
+
+    // Checking alone doesn't mark anything, such as for packets whose MAC then doesn't match
+    assertEqual(window.check(6), true);
+    assertEqual(window.check(6), true);
+    assertEqual(window.check(5), false);
+
+    window.reset();
+    assertEqual(window.check(5), true);
+}
+
+void testSequenceWindowFarAhead() {
+    SequenceWindow window;
+    window.accept(100);
+
+    // A forged number far ahead, such as on a replayed datagram, can't drag the window along and shut out the real ones
+    assertEqual(checkAndAccept(window, (uint16_t)(100 + 0x7FFF)), false);
+    assertEqual(checkAndAccept(window, 100 + SequenceWindow::MAX_AHEAD + 1), false);
+    assertEqual(checkAndAccept(window, 101), true);
+
+    // Up to MAX_AHEAD moves the window, and the real numbers are accepted again once they catch up
+    assertEqual(checkAndAccept(window, 101 + SequenceWindow::MAX_AHEAD), true);
+    assertEqual(window.check(102), false);
+    assertEqual(window.check(101 + SequenceWindow::MAX_AHEAD - SequenceWindow::WINDOW_SIZE + 1), true);
+}
+
+void testSequenceWindowRequestReset() {
+    SequenceWindow window;
+    window.accept(500);
+
+    // Nothing changes until a packet is accepted, such as one whose MAC matched
+    window.requestReset();
+    assertEqual(window.check(3), true);
+    assertEqual(window.check(500), true);
+
+    window.accept(3);
+    assertEqual(window.check(3), false);
+    assertEqual(window.check(4), true);
+    assertEqual(window.check(500), false);
+}
+
+void testSequenceWindow() {
+    testSequenceWindowOrder();
+    testSequenceWindowCheckOnly();
+    testSequenceWindowFarAhead();
+    testSequenceWindowRequestReset();
+}
+
+void benchSequenceWindow() {
+    size_t numIters = 10000000;
+    size_t numAccepted = 0;
+
+    SequenceWindow window;
+    std::cout << "SequenceWindow" << std::endl;
+    benchmark("  check + accept", numIters, {
+        // Mostly in order, with some reordering and duplicates
+        numAccepted += checkAndAccept(window, (uint16_t)(benchIter ^ (benchIter & 0x3) >> 1));
+    });
+
+    benchKeep(numAccepted);
+}
@@ -0,0 +1,4 @@
+#pragma once
+
+void testSequenceWindow();
+void benchSequenceWindow();
@@ -1,50 +1,404 @@
-#include <iostream>
-#include <map>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
 #include <memory>
 #include <vector>
 #include "asio.hpp"
+#include "log.h"
 #include "server.h"
+#include "util.h"
 
-void Server::poll() {
-    ioService.poll();
+void Server::repeat(size_t intervalMS, void(*handler)(Server&)) {
+    timers.emplace_back(new asio::steady_timer(ioService));
+    asio::steady_timer& timer = *timers.back();
+
+    timer.expires_from_now(std::chrono::milliseconds(intervalMS));
+    scheduleTimer(timer, intervalMS, handler);
+}
+
+#ifdef PSEMU_PLATFORM_LIN
+void DatagramBatch::resize(size_t count, bool ownBufs) {
+    bufs.resize(ownBufs ? count : 0);
+    addrs.resize(count);
+    iovecs.resize(count);
+    msgs.resize(count);
+
+    for (size_t i = 0; i < count; ++i) {
+        iovecs[i].iov_base = ownBufs ? bufs[i].data() : nullptr;
+        iovecs[i].iov_len = ownBufs ? bufs[i].size() : 0;
+
+        memset(&msgs[i], 0, sizeof(mmsghdr));
+        msgs[i].msg_hdr.msg_name = &addrs[i];
+        msgs[i].msg_hdr.msg_namelen = sizeof(sockaddr_storage);
+        msgs[i].msg_hdr.msg_iov = &iovecs[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+}
+#endif
+
+void Server::send(PacketBufferHandle buf, const Session& session) {
+    sendTo(std::move(buf), session.clientEndpoint);
+}
+
+void Server::sendTo(PacketBufferHandle buf, const udp::endpoint& endpoint) {
+#ifdef PSEMU_PLATFORM_LIN
+    if (config.batchSize > 1) {
+        if (!sendBlocked && numQueuedSends == sendBatch.msgs.size()) {
+            flushSends();
+        }
+
+        // Keep the order, so nothing jumps ahead of what's waiting for the socket
+        if (sendBlocked) {
+            queueBlockedSend(std::move(buf), endpoint);
+        } else {
+            queueSend(std::move(buf), endpoint);
+        }
+        return;
+    }
+#endif
+
+    serverSocket.send_to(asio::buffer(buf->getData(), buf->getSize()), endpoint);
+}
+
+#ifdef PSEMU_PLATFORM_LIN
+void Server::queueSend(PacketBufferHandle buf, const udp::endpoint& endpoint) {
+    size_t i = numQueuedSends++;
+    sendBatch.iovecs[i].iov_base = buf->getData();
+    sendBatch.iovecs[i].iov_len = buf->getSize();
+    memcpy(&sendBatch.addrs[i], endpoint.data(), endpoint.size());
+    sendBatch.msgs[i].msg_hdr.msg_namelen = endpoint.size();
+    queuedSendBufs[i] = std::move(buf);
+}
+
+void Server::queueBlockedSend(PacketBufferHandle buf, const udp::endpoint& endpoint) {
+    if (blockedSends.size() >= MAX_BLOCKED_SENDS) {
+        numDroppedSends++;
+        return;
+    }
+
+    BlockedSend blockedSend;
+    blockedSend.buf = std::move(buf);
+    blockedSend.endpoint = endpoint;
+    blockedSends.push_back(std::move(blockedSend));
+}
+
+void Server::waitWritable() {
+    sendBlocked = true;
+
+    serverSocket.async_wait(udp::socket::wait_write, [this](std::error_code errorCode) {
+        sendBlocked = false;
+
+        if (errorCode) {
+            LOG(LC_Server, LL_Error) << "Net error: \"" << errorCode.message() << "\", dropped " << blockedSends.size() << " datagrams";
+            blockedSends.clear();
+            return;
+        }
+
+        if (numDroppedSends > 0) {
+            LOG(LC_Server, LL_Warning) << "Send buffer full, dropped " << numDroppedSends << " datagrams";
+            numDroppedSends = 0;
+        }
+
+        // Until they're all out, or the socket blocks again and this is called again
+        while (!sendBlocked && !blockedSends.empty()) {
+            while (numQueuedSends < sendBatch.msgs.size() && !blockedSends.empty()) {
+                queueSend(std::move(blockedSends.front().buf), blockedSends.front().endpoint);
+                blockedSends.pop_front();
+            }
+
+            flushSends();
+        }
+    });
+}
+#endif
+
+void Server::setFlushHandler(FlushHandler handler) {
+    flushHandler = handler;
+}
+
+void Server::deferFlush(Session& session) {
+    if (!session.flushDeferred) {
+        session.flushDeferred = true;
+        deferredFlushes.push_back(session.handle);
+    }
+}
+
+void Server::flush() {
+    // Indexed, since a handler may defer another flush, which is then handled in this same pass
+    for (size_t i = 0; i < deferredFlushes.size(); ++i) {
+        Session* session = sessions.get(deferredFlushes[i]);
+        if (session == nullptr) {
+            continue;
+        }
+
+        session->flushDeferred = false;
+        if (flushHandler != nullptr) {
+            flushHandler(*this, *session);
+        }
+    }
+    deferredFlushes.clear();
+
+    flushSends();
 }
 
-void Server::send(std::vector<uint8_t>& data, std::shared_ptr<Session> session) {
-    serverSocket.send_to(asio::buffer(data), session->clientEndpoint);
+void Server::flushSends() {
+#ifdef PSEMU_PLATFORM_LIN
+    // Already waiting for the socket, which sends everything held back once it's writable
+    if (sendBlocked) {
+        return;
+    }
+
+    size_t numSent = 0;
+    while (numSent < numQueuedSends) {
+        int result = config.sendBatchFunc(serverSocket.native_handle(), &sendBatch.msgs[numSent], numQueuedSends - numSent, 0);
+        if (result < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            // The socket's send buffer is full, so hold the rest back until there's room.
+            // They go ahead of any already held back, since those were queued after them
+            for (size_t i = numQueuedSends; i-- > numSent; ) {
+                if (blockedSends.size() >= MAX_BLOCKED_SENDS) {
+                    numDroppedSends++;
+                    continue;
+                }
+
+                BlockedSend blockedSend;
+                blockedSend.buf = std::move(queuedSendBufs[i]);
+                memcpy(blockedSend.endpoint.data(), &sendBatch.addrs[i], sendBatch.msgs[i].msg_hdr.msg_namelen);
+                blockedSend.endpoint.resize(sendBatch.msgs[i].msg_hdr.msg_namelen);
+                blockedSends.push_front(std::move(blockedSend));
+            }
+
+            waitWritable();
+            break;
+        }
+
+        if (result <= 0) {
+            // An error with the first datagram, such as an unreachable address, so drop just that one
+            LOG(LC_Server, LL_Error) << "sendmmsg error: \"" << strerror(errno) << "\", dropped a datagram";
+            numSent++;
+            continue;
+        }
+
+        numSent += result;
+    }
+
+    // Everything is either sent, held back, or dropped, so the buffers left can go back to the pool
+    for (size_t i = 0; i < numQueuedSends; ++i) {
+        queuedSendBufs[i].reset();
+    }
+    numQueuedSends = 0;
+#endif
 }
 
 unsigned short Server::getPort() const {
     return serverSocket.local_endpoint().port();
 }
 
-const std::map<asio::ip::address, std::shared_ptr<Session>>& Server::getSessionMap() const {
+SessionTable& Server::getSessions() {
     return sessions;
 }
 
-std::shared_ptr<Session> Server::getOrMakeSession(udp::endpoint endpoint) {
-    // TODO: Only make the session if the incoming packet is an OP_ClientStart control packet, else drop and ignore
-    asio::ip::address addr = endpoint.address();
+void Server::closeSession(Session& session) {
+    closingSessions.push_back(session.handle);
+}
+
+void Server::open(short port) {
+    serverSocket.open(udp::v4());
+
+    if (config.reusePort) {
+#ifdef PSEMU_PLATFORM_LIN
+        serverSocket.set_option(asio::detail::socket_option::boolean<SOL_SOCKET, SO_REUSEPORT>(true));
+#else
+        LOG(LC_Server, LL_Warning) << "SO_REUSEPORT is not supported on this platform!";
+#endif
+    }
+
+    serverSocket.bind(udp::endpoint(udp::v4(), port));
+
+#ifdef PSEMU_PLATFORM_LIN
+    if (config.batchSize > 1) {
+        serverSocket.non_blocking(true);
+        recvBatch.resize(config.batchSize, true);
+        sendBatch.resize(config.batchSize, false);
+        queuedSendBufs.resize(config.batchSize);
+    }
+    numQueuedSends = 0;
+    sendBlocked = false;
+    numDroppedSends = 0;
+#else
+    if (config.batchSize > 1) {
+        LOG(LC_Server, LL_Warning) << "Batched datagram I/O is not supported on this platform!";
+        config.batchSize = 1;
+    }
+#endif
+}
+
+Session* Server::getOrMakeSession(const udp::endpoint& endpoint, uint8_t* data, size_t size) {
+    Session* session = sessions.find(endpoint);
+    if (session != nullptr) {
+        return session;
+    }
+
+    // Admit first, so that stateless replies (such as to OP_ClientStart) keep going out while the server is full
+    if (admitHandler != nullptr && !admitHandler(*this, data, size, endpoint)) {
+        return nullptr;
+    }
+
+    if (numHalfOpenSessions >= config.maxHalfOpenSessions) {
+        return nullptr;
+    }
+
+    session = &sessions.insert(endpoint);
+    session->halfOpen = true;
+    numHalfOpenSessions++;
+
+    sessionTimeouts.schedule(session->handle, getTimeMilliseconds() + config.handshakeTimeoutMS);
+
+    return session;
+}
+
+void Server::dispatch(const udp::endpoint& endpoint, uint8_t* data, size_t size) {
+    Session* session = getOrMakeSession(endpoint, data, size);
+    if (session == nullptr) {
+        return;
+    }
+
+    session->lastRecvMS = getTimeMilliseconds();
+
+    recvHandler(*this, data, size, *session);
+
+    updateHalfOpen(*session);
+}
+
+void Server::updateHalfOpen(Session& session) {
+    if (session.halfOpen && session.cryptoState == Session::CS_Finished) {
+        session.halfOpen = false;
+        numHalfOpenSessions--;
+    }
+}
+
+void Server::expireSessions() {
+    size_t curTimeMS = getTimeMilliseconds();
+
+    expiredSessions.clear();
+    sessionTimeouts.advance(curTimeMS, expiredSessions);
+
+    for (auto& handle : expiredSessions) {
+        Session* session = sessions.get(handle);
+        if (session == nullptr) {
+            // Already removed
+            continue;
+        }
+
+        // Activity only updates lastRecvMS, so the real deadline is worked out lazily here
+        updateHalfOpen(*session);
+        size_t deadlineMS = session->lastRecvMS + (session->halfOpen ? config.handshakeTimeoutMS : config.idleTimeoutMS);
+
+        if (deadlineMS <= curTimeMS) {
+            LOG(LC_Server, LL_Debug) << "Session " << session->clientEndpoint << " timed out";
+            removeSession(*session);
+        } else {
+            sessionTimeouts.schedule(handle, deadlineMS);
+        }
+    }
+}
+
+void Server::reapSessions() {
+    for (auto& handle : closingSessions) {
+        Session* session = sessions.get(handle);
+        if (session != nullptr) {
+            LOG(LC_Server, LL_Debug) << "Session " << session->clientEndpoint << " closed";
+            removeSession(*session);
+        }
+    }
 
-    auto session = sessions.find(addr);
-    if (session == sessions.end()) {
-        session = sessions.emplace(addr, std::make_shared<Session>(endpoint)).first;
+    closingSessions.clear();
+}
+
+void Server::removeSession(Session& session) {
+    if (session.halfOpen) {
+        numHalfOpenSessions--;
     }
 
-    return (*session).second;
+    sessions.remove(session.handle);
 }
 
 void Server::receive() {
+#ifdef PSEMU_PLATFORM_LIN
+    if (config.batchSize > 1) {
+        receiveBatch();
+        return;
+    }
+#endif
+
     serverSocket.async_receive_from(asio::buffer(recvBuf), clientEndpoint,
         [this](std::error_code errorCode, std::size_t bytesReceived) {
         if (!errorCode && bytesReceived > 0) {
-            // TODO: Don't -really- need to copy the buffer here.
-            std::vector<uint8_t> dataBuf(recvBuf.begin(), recvBuf.begin() + bytesReceived);
-            recvHandler(*this, dataBuf, getOrMakeSession(clientEndpoint));
+            // Handled in-place, the buffer isn't reused until the next receive is started below
+            dispatch(clientEndpoint, recvBuf.data(), bytesReceived);
+            flush();
+            reapSessions();
+        } else {
+            LOG(LC_Server, LL_Error) << "Net error: \"" << errorCode.message() << "\", recvd " << bytesReceived << " bytes";
+        }
+
+        // Call receive again to wait for more data.
+        receive();
+    });
+}
+
+#ifdef PSEMU_PLATFORM_LIN
+void Server::receiveBatch() {
+    serverSocket.async_wait(udp::socket::wait_read, [this](std::error_code errorCode) {
+        if (errorCode) {
+            LOG(LC_Server, LL_Error) << "Net error: \"" << errorCode.message() << "\"";
         } else {
-            std::cout << "Net error: \"" << errorCode.message() << "\", recvd " << bytesReceived << " bytes" << std::endl;
+            // recvmmsg overwrites the name lengths, so reset them for every call
+            for (auto& msg : recvBatch.msgs) {
+                msg.msg_hdr.msg_namelen = sizeof(sockaddr_storage);
+            }
+
+            int numReceived = recvmmsg(serverSocket.native_handle(), recvBatch.msgs.data(), recvBatch.msgs.size(), MSG_DONTWAIT, nullptr);
+            if (numReceived < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+                LOG(LC_Server, LL_Error) << "recvmmsg error: \"" << strerror(errno) << "\"";
+            }
+
+            for (int i = 0; i < numReceived; ++i) {
+                mmsghdr& msg = recvBatch.msgs[i];
+                if (msg.msg_len == 0) {
+                    continue;
+                }
+
+                udp::endpoint endpoint;
+                memcpy(endpoint.data(), &recvBatch.addrs[i], msg.msg_hdr.msg_namelen);
+                endpoint.resize(msg.msg_hdr.msg_namelen);
+
+                dispatch(endpoint, recvBatch.bufs[i].data(), msg.msg_len);
+            }
+
+            // Send everything the handlers queued up in as few syscalls as possible, including to sessions they closed
+            flush();
+            reapSessions();
         }
 
         // Call receive again to wait for more data.
         receive();
     });
 }
+#endif
+
+void Server::scheduleTimer(asio::steady_timer& timer, size_t intervalMS, void(*handler)(Server&)) {
+    timer.async_wait([this, &timer, intervalMS, handler](std::error_code errorCode) {
+        if (errorCode) {
+            LOG(LC_Server, LL_Error) << "Timer error: \"" << errorCode.message() << "\"";
+            return;
+        }
+
+        handler(*this);
+        flush();
+        reapSessions();
+
+        // Re-arm relative to the previous expiry so the interval doesn't drift with handler time
+        timer.expires_at(timer.expires_at() + std::chrono::milliseconds(intervalMS));
+        scheduleTimer(timer, intervalMS, handler);
+    });
+}
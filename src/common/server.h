@@ -1,34 +1,154 @@
 #pragma once
 
-#include <map>
+#include <deque>
 #include <memory>
 #include <vector>
 #include "asio.hpp"
+#include "packet_buffer.h"
 #include "session.h"
+#include "session_table.h"
+#include "timer_wheel.h"
+
+#ifdef PSEMU_PLATFORM_LIN
+#include <sys/socket.h>
+#endif
 
 using asio::ip::udp;
 
+/**
+ * Tunable server options.
+ */
+class ServerConfig {
+public:
+    ServerConfig() :
+        reusePort(false),
+        batchSize(1),
+        idleTimeoutMS(30000),
+        handshakeTimeoutMS(5000),
+        maxHalfOpenSessions(1024)
+#ifdef PSEMU_PLATFORM_LIN
+        , sendBatchFunc(sendmmsg)
+#endif
+    {
+
+    }
+
+    // Bind with SO_REUSEPORT so that several servers can share the port (see ShardedServer). Only supported on Linux.
+    bool reusePort;
+
+    // Max datagrams received per wakeup with recvmmsg, and queued sends flushed with sendmmsg. Only supported on Linux.
+    size_t batchSize;
+
+    // Sessions that haven't received anything for this long are removed
+    size_t idleTimeoutMS;
+
+    // Sessions that haven't finished the crypto handshake within this long are removed
+    size_t handshakeTimeoutMS;
+
+    // Datagrams that would create a new session are dropped while this many sessions are mid-handshake.
+    // The admit handler still sees them, so its stateless replies keep going out
+    size_t maxHalfOpenSessions;
+
+#ifdef PSEMU_PLATFORM_LIN
+    // Sends a batch of datagrams, as sendmmsg does. Only replaced by tests, such as to simulate a full send buffer
+    int(*sendBatchFunc)(int fd, mmsghdr* msgs, unsigned int count, int flags);
+#endif
+};
+
+#ifdef PSEMU_PLATFORM_LIN
+/**
+ * A set of datagram buffers and message headers for use with recvmmsg/sendmmsg.
+ */
+class DatagramBatch {
+public:
+    /**
+     * Send batches don't own buffers, and instead point each message at a pooled buffer as it's queued.
+     */
+    void resize(size_t count, bool ownBufs);
+
+    std::vector<std::array<uint8_t, 2048>> bufs;
+    std::vector<sockaddr_storage> addrs;
+    std::vector<iovec> iovecs;
+    std::vector<mmsghdr> msgs;
+};
+#endif
+
 /**
  * Represents a server listening on a particular port.
  * Automaticaly starts listening upon construction.
+ * All network and timer work is driven by the given io_service, so any number of servers can share one run loop.
  */
 class Server {
 public:
-    Server(short port, void(*recvHandler)(Server&, std::vector<uint8_t>&, std::shared_ptr<Session> session)) :
-        serverSocket(ioService, udp::endpoint(udp::v4(), port)),
-        recvHandler(recvHandler) {
+    /**
+     * Called for every received datagram. The data points into the server's receive buffer,
+     * and is only valid until the handler returns.
+     */
+    typedef void(*RecvHandler)(Server& server, uint8_t* data, size_t size, Session& session);
+
+    /**
+     * Called for datagrams from endpoints without a session, before any session is allocated.
+     * May reply statelessly with sendTo.
+     * @return Whether to create a session for the endpoint and pass the datagram on to the receive handler
+     */
+    typedef bool(*AdmitHandler)(Server& server, uint8_t* data, size_t size, const udp::endpoint& endpoint);
+
+    /**
+     * Called by flush for each session that asked with deferFlush since the last flush, before the queued datagrams go out.
+     * Lets a protocol hold a session's outgoing messages back and send them together.
+     */
+    typedef void(*FlushHandler)(Server& server, Session& session);
+
+    /**
+     * If there is no admit handler, every datagram from a new endpoint creates a session.
+     */
+    Server(asio::io_service& ioService, short port, RecvHandler recvHandler, AdmitHandler admitHandler = nullptr, const ServerConfig& config = ServerConfig()) :
+        ioService(ioService),
+        serverSocket(ioService),
+        config(config),
+        sessionTimeouts(250, 256),
+        numHalfOpenSessions(0),
+        recvHandler(recvHandler),
+        admitHandler(admitHandler),
+        flushHandler(nullptr) {
+        open(port);
         receive();
+
+        repeat(sessionTimeouts.getTickMS(), [](Server& server) {
+            server.expireSessions();
+        });
     }
 
     /**
-     * Checks for any received data and passes the data to the receive handler.
+     * Calls a handler every intervalMS milliseconds from the server's io_service.
+     */
+    void repeat(size_t intervalMS, void(*handler)(Server&));
+
+    /**
+     * Sends a buffer to a session's endpoint, then returns the buffer to the pool.
+     * In batched mode the buffer itself is queued in the send batch, and goes out on the next flush.
+     */
+    void send(PacketBufferHandle buf, const Session& session);
+
+    /**
+     * Sends a buffer to an endpoint that may not have a session.
+     */
+    void sendTo(PacketBufferHandle buf, const udp::endpoint& endpoint);
+
+    /**
+     * Sets the handler that flushes sessions which called deferFlush.
+     */
+    void setFlushHandler(FlushHandler handler);
+
+    /**
+     * Has the flush handler called for the session on the next flush. Calling it again before then does nothing.
      */
-    void poll();
+    void deferFlush(Session& session);
 
     /**
-     * Sends data to a session's endpoint.
+     * Flushes deferred sessions, then sends any queued datagrams. Called automatically after each receive batch and timer handler.
      */
-    void send(std::vector<uint8_t>& data, std::shared_ptr<Session> session);
+    void flush();
 
     /**
      * @return The port the server is listening on.
@@ -36,25 +156,147 @@ public:
     unsigned short getPort() const;
 
     /**
-     * @return A map of all sessions that the server knows about.
+     * @return All sessions that the server knows about.
      */
-    const std::map<asio::ip::address, std::shared_ptr<Session>>& getSessionMap() const;
+    SessionTable& getSessions();
+
+    /**
+     * Removes a session once the current handler returns.
+     */
+    void closeSession(Session& session);
+
+    /**
+     * Calls a function with a session from the server's io_service, if the session still exists by then.
+     * Safe to call from any thread, so it is how work done elsewhere gets back to the session's thread.
+     */
+    template<typename Func>
+    void postToSession(SessionHandle handle, Func func) {
+        ioService.post([this, handle, func]() {
+            Session* session = sessions.get(handle);
+            if (session == nullptr) {
+                return;
+            }
+
+            func(*session);
+
+            updateHalfOpen(*session);
+            flush();
+            reapSessions();
+        });
+    }
 
 private:
     /**
-     * @return An existing session with the endpoint's address, or a new session if there isn't one.
+     * Opens and binds the server socket.
+     */
+    void open(short port);
+
+    /**
+     * @return An existing session with the endpoint's address and port, a new session if the admit handler
+     * accepts the datagram, or nullptr if it doesn't or there are too many half-open sessions to make a new one.
+     */
+    Session* getOrMakeSession(const udp::endpoint& endpoint, uint8_t* data, size_t size);
+
+    /**
+     * Passes a received datagram to the receive handler.
+     */
+    void dispatch(const udp::endpoint& endpoint, uint8_t* data, size_t size);
+
+    /**
+     * Stops counting a session as half-open once its handshake is finished.
+     */
+    void updateHalfOpen(Session& session);
+
+    /**
+     * Removes sessions that have timed out.
+     */
+    void expireSessions();
+
+    /**
+     * Removes sessions that were closed during the last handler.
      */
-    std::shared_ptr<Session> getOrMakeSession(udp::endpoint endpoint);
+    void reapSessions();
+
+    /**
+     * Removes a session immediately.
+     */
+    void removeSession(Session& session);
 
     /**
      * Creates a new async receive request.
      */
     void receive();
 
-    asio::io_service ioService;
+#ifdef PSEMU_PLATFORM_LIN
+    /**
+     * Waits for the socket to be readable, then drains up to a batch of datagrams with a single recvmmsg.
+     */
+    void receiveBatch();
+#endif
+
+    /**
+     * Sends the queued datagrams with as few syscalls as possible.
+     * Whatever doesn't fit in the socket's send buffer is kept, and sent once the socket is writable again.
+     */
+    void flushSends();
+
+#ifdef PSEMU_PLATFORM_LIN
+    /**
+     * Adds a datagram to the send batch, which must have room for it.
+     */
+    void queueSend(PacketBufferHandle buf, const udp::endpoint& endpoint);
+
+    /**
+     * Holds a datagram back until the socket is writable again, dropping it if too many are already held back.
+     */
+    void queueBlockedSend(PacketBufferHandle buf, const udp::endpoint& endpoint);
+
+    /**
+     * Waits for the socket to be writable, then sends the datagrams held back until it blocks again or they're all out.
+     */
+    void waitWritable();
+#endif
+
+    /**
+     * Arms a repeating timer to fire one interval after its previous expiry.
+     */
+    void scheduleTimer(asio::steady_timer& timer, size_t intervalMS, void(*handler)(Server&));
+
+    asio::io_service& ioService;
     udp::socket serverSocket;
+    ServerConfig config;
     udp::endpoint clientEndpoint;
     std::array<uint8_t, 2048> recvBuf;
-    std::map<asio::ip::address, std::shared_ptr<Session>> sessions;
-    void(*recvHandler)(Server&, std::vector<uint8_t>&, std::shared_ptr<Session> session);
+    SessionTable sessions;
+    TimerWheel sessionTimeouts;
+    std::vector<SessionHandle> expiredSessions;
+    std::vector<SessionHandle> closingSessions;
+    size_t numHalfOpenSessions;
+    std::vector<std::unique_ptr<asio::steady_timer>> timers;
+    RecvHandler recvHandler;
+    AdmitHandler admitHandler;
+    FlushHandler flushHandler;
+    std::vector<SessionHandle> deferredFlushes;
+
+#ifdef PSEMU_PLATFORM_LIN
+    DatagramBatch recvBatch;
+    DatagramBatch sendBatch;
+    // Keeps the queued buffers alive until they're flushed
+    std::vector<PacketBufferHandle> queuedSendBufs;
+    size_t numQueuedSends;
+
+    class BlockedSend {
+    public:
+        PacketBufferHandle buf;
+        udp::endpoint endpoint;
+    };
+
+    // Most datagrams held back while the socket's send buffer is full. More than that and the client is better off resending
+    static const size_t MAX_BLOCKED_SENDS = 4096;
+
+    // Set while waiting for the socket to be writable, during which sends go to blockedSends
+    bool sendBlocked;
+    std::deque<BlockedSend> blockedSends;
+    size_t numDroppedSends;
+#endif
 };
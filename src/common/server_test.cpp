@@ -0,0 +1,126 @@
+#include <algorithm>
+#include <cerrno>
+#include <vector>
+#include "asio.hpp"
+#include "bench.h"
+#include "packet_buffer.h"
+#include "server.h"
+#include "server_test.h"
+#include "test.h"
+
+#ifdef PSEMU_PLATFORM_LIN
+// How many more datagrams the fake socket takes before its send buffer is full
+static size_t fakeSendRoom;
+
+// The first byte of each datagram the fake socket sent, in order
+static std::vector<uint8_t> fakeSent;
+
+static int fakeSendmmsg(int fd, mmsghdr* msgs, unsigned int count, int flags) {
+    if (fakeSendRoom == 0) {
+        errno = EAGAIN;
+        return -1;
+    }
+
+    unsigned int numSent = (unsigned int)std::min<size_t>(count, fakeSendRoom);
+    for (unsigned int i = 0; i < numSent; ++i) {
+        fakeSent.push_back(((uint8_t*)msgs[i].msg_hdr.msg_iov->iov_base)[0]);
+    }
+    fakeSendRoom -= numSent;
+    return (int)numSent;
+}
+
+static void sendTestDatagram(Server& server, const udp::endpoint& endpoint, uint8_t value) {
+    PacketBufferHandle buf = PacketBufferPool::acquire();
+    buf->getData()[0] = value;
+    buf->setSize(1);
+    server.sendTo(std::move(buf), endpoint);
+}
+
+/**
+ * Runs handlers until the fake socket has sent a number of datagrams, or gives up.
+ */
+static void pollUntilSent(asio::io_service& ioService, size_t count) {
+    for (size_t i = 0; i < 1000 && fakeSent.size() < count; ++i) {
+        ioService.poll();
+    }
+}
+#endif
+
+void testServer() {
+#ifdef PSEMU_PLATFORM_LIN
+    asio::io_service ioService;
+    ServerConfig config;
+    config.batchSize = 4;
+    config.sendBatchFunc = fakeSendmmsg;
+    Server server(ioService, 0, [](Server&, uint8_t*, size_t, Session&) {}, nullptr, config);
+    udp::endpoint endpoint(asio::ip::address_v4::loopback(), server.getPort());
+
+    // The socket blocks partway through the first batch, so the rest of it and everything after is held back
+    fakeSent.clear();
+    fakeSendRoom = 3;
+    for (size_t i = 0; i < 10; ++i) {
+        sendTestDatagram(server, endpoint, (uint8_t)i);
+    }
+    server.flush();
+    assertEqual(fakeSent.size(), (size_t)3);
+
+    // Once there's room again, the held back datagrams go out in the order they were sent
+    fakeSendRoom = 100;
+    pollUntilSent(ioService, 10);
+    assertEqual(fakeSent.size(), (size_t)10);
+    for (size_t i = 0; i < fakeSent.size(); ++i) {
+        assertEqual((size_t)fakeSent[i], i);
+    }
+
+    // Blocking again later works the same way
+    fakeSent.clear();
+    fakeSendRoom = 0;
+    for (size_t i = 0; i < 6; ++i) {
+        sendTestDatagram(server, endpoint, (uint8_t)i);
+    }
+    server.flush();
+    assertEqual(fakeSent.size(), (size_t)0);
+
+    fakeSendRoom = 100;
+    pollUntilSent(ioService, 6);
+    assertEqual(fakeSent.size(), (size_t)6);
+    for (size_t i = 0; i < fakeSent.size(); ++i) {
+        assertEqual((size_t)fakeSent[i], i);
+    }
+
+    // The held back datagrams are capped, including those requeued from a blocked batch
+    fakeSent.clear();
+    fakeSendRoom = 0;
+    for (size_t i = 0; i < 5000; ++i) {
+        sendTestDatagram(server, endpoint, (uint8_t)i);
+    }
+    server.flush();
+
+    fakeSendRoom = 10000;
+    pollUntilSent(ioService, 5000);
+    assertEqual(fakeSent.size(), (size_t)4096);
+    for (size_t i = 0; i < fakeSent.size(); ++i) {
+        assertEqual((size_t)fakeSent[i], i % 256);
+    }
+#endif
+}
+
+void benchServer() {
+#ifdef PSEMU_PLATFORM_LIN
+    asio::io_service ioService;
+    ServerConfig config;
+    config.batchSize = 32;
+    config.sendBatchFunc = fakeSendmmsg;
+    Server server(ioService, 0, [](Server&, uint8_t*, size_t, Session&) {}, nullptr, config);
+    udp::endpoint endpoint(asio::ip::address_v4::loopback(), server.getPort());
+
+    fakeSendRoom = (size_t)-1;
+    benchmark("  Server::sendTo (batched, fake sendmmsg)", 1000000, {
+        sendTestDatagram(server, endpoint, (uint8_t)benchIter);
+        if (fakeSent.size() > 4096) {
+            fakeSent.clear();
+        }
+    });
+    server.flush();
+#endif
+}
@@ -1,7 +1,7 @@
 #pragma once
 
 #include <array>
-#include <iostream>
+#include <cstring>
 #include <vector>
 #include "bitstream.h"
 #include "dh.h"
@@ -18,13 +18,30 @@ const std::string strServerExpansion = "server expansion";
 const std::string strClientFinished = "client finished";
 const std::string strServerFinished = "server finished";
 
-void Session::generateCrypto1(uint32_t clientTime, const std::array<uint8_t, 12>& clientChallenge, const CryptoPP::Integer& p, const CryptoPP::Integer& g) {
-    // Generate server keys
-    CryptoPP::AutoSeededRandomPool rnd;
+void Session::generateKeyPair(const CryptoPP::Integer& p, const CryptoPP::Integer& g, std::vector<uint8_t>& privKey, std::vector<uint8_t>& pubKey) {
+    // Seeding a pool is expensive, so keep one per thread
+    thread_local CryptoPP::AutoSeededRandomPool rnd;
+
+    CryptoPP::DH dh;
     dh.AccessGroupParameters().Initialize(p, g);
-    serverPrivKey.resize(dh.PrivateKeyLength());
-    serverPubKey.resize(dh.PublicKeyLength());
-    dh.GenerateKeyPair(rnd, serverPrivKey.data(), serverPubKey.data());
+    privKey.resize(dh.PrivateKeyLength());
+    pubKey.resize(dh.PublicKeyLength());
+    dh.GenerateKeyPair(rnd, privKey.data(), pubKey.data());
+}
+
+bool Session::agreeKey(const CryptoPP::Integer& p, const CryptoPP::Integer& g, const std::vector<uint8_t>& privKey, const std::array<uint8_t, 16>& clientPubKey, std::vector<uint8_t>& agreedValue) {
+    CryptoPP::DH dh;
+    dh.AccessGroupParameters().Initialize(p, g);
+    agreedValue.resize(dh.AgreedValueLength());
+    return dh.Agree(agreedValue.data(), privKey.data(), clientPubKey.data());
+}
+
+void Session::generateCrypto1(uint32_t clientTime, const std::array<uint8_t, 12>& clientChallenge, const CryptoPP::Integer& p, const CryptoPP::Integer& g,
+    const std::vector<uint8_t>& privKey, const std::vector<uint8_t>& pubKey) {
+    dhP = p;
+    dhG = g;
+    serverPrivKey = privKey;
+    serverPubKey = pubKey;
 
     storedClientTime = clientTime;
     storedClientChallenge = clientChallenge;
@@ -37,20 +54,10 @@ void Session::generateCrypto1(uint32_t clientTime, const std::array<uint8_t, 12>
     cryptoState = CS_Challenge;
 };
 
-void Session::generateCrypto2(const std::array<uint8_t, 16>& clientPubKey, const std::array<uint8_t, 12>& clientChallengeResult) {
-    std::cout << "macBuffer:" << strHex(macBuffer) << std::endl;
-
-    // Make sure the keys agree
-    std::vector<uint8_t> agreedValue(dh.AgreedValueLength());
-    bool agreed = dh.Agree(agreedValue.data(), serverPrivKey.data(), clientPubKey.data());
+void Session::generateCrypto2(const std::vector<uint8_t>& agreedValue, const std::array<uint8_t, 12>& clientChallengeResult) {
+    LOG(LC_Session, LL_Trace) << "macBuffer:" << hexDump(macBuffer);
 
-    if (!agreed) {
-        // TODO: Need to terminate session
-        std::cout << "Did not agree on crypto keys!" << std::endl;
-        return;
-    }
-
-    std::cout << "Agreed with:" << strHex(agreedValue) << std::endl;
+    LOG(LC_Session, LL_Trace) << "Agreed with:" << hexDump(agreedValue);
 
     // Generate the master secret
     std::vector<byte> agreedMessage;
@@ -65,7 +72,7 @@ void Session::generateCrypto2(const std::array<uint8_t, 16>& clientPubKey, const
     std::vector<uint8_t> masterSecret(20);
     calcMD5MAC(agreedValue, agreedMessage, masterSecret);
 
-    std::cout << "masterSecret:" << strHex(masterSecret) << std::endl;
+    LOG(LC_Session, LL_Trace) << "masterSecret:" << hexDump(masterSecret);
 
     // TODO: Perhaps this is currently not working in scala codebase either
     // Seems that the MD5MAC does not match the client's challenge; for now just ignore it and let them through
@@ -82,9 +89,9 @@ void Session::generateCrypto2(const std::array<uint8_t, 16>& clientPubKey, const
     std::vector<uint8_t> clientChallengeCheck(12);
     calcMD5MAC(masterSecret, clientChallengeCheckBuffer, clientChallengeCheck);
 
-    std::cout << "clientCheckResult:" << strHex(clientChallengeCheck) << std::endl;
-    std::cout << "clientChallengeResult:" << strHex(clientChallengeResult) << std::endl;
-    std::cout << "storedClientChallenge:" << strHex(storedClientChallenge) << std::endl;
+    LOG(LC_Session, LL_Trace) << "clientCheckResult:" << hexDump(clientChallengeCheck);
+    LOG(LC_Session, LL_Trace) << "clientChallengeResult:" << hexDump(clientChallengeResult);
+    LOG(LC_Session, LL_Trace) << "storedClientChallenge:" << hexDump(storedClientChallenge);
     */
 
     // Generate RC% and MAC encryption keys
@@ -101,24 +108,24 @@ void Session::generateCrypto2(const std::array<uint8_t, 16>& clientPubKey, const
     decExpansionBuffer.insert(decExpansionBuffer.end(), 2, 0x00);
     decExpansionBuffer.insert(decExpansionBuffer.end(), switchedServerClientChallenges.begin(), switchedServerClientChallenges.end());
 
-    std::cout << "decExpansionBuffer:" << strHex(decExpansionBuffer) << std::endl;
+    LOG(LC_Session, LL_Trace) << "decExpansionBuffer:" << hexDump(decExpansionBuffer);
 
     std::vector<uint8_t> encExpansionBuffer;
     encExpansionBuffer.insert(encExpansionBuffer.end(), strServerExpansion.begin(), strServerExpansion.end());
     encExpansionBuffer.insert(encExpansionBuffer.end(), 2, 0x00);
     encExpansionBuffer.insert(encExpansionBuffer.end(), switchedServerClientChallenges.begin(), switchedServerClientChallenges.end());
 
-    std::cout << "encExpansionBuffer:" << strHex(encExpansionBuffer) << std::endl;
+    LOG(LC_Session, LL_Trace) << "encExpansionBuffer:" << hexDump(encExpansionBuffer);
 
     std::vector<uint8_t> expandedDecKey(64);
     calcMD5MAC(masterSecret, decExpansionBuffer, expandedDecKey);
 
-    std::cout << "expandedDecKey:" << strHex(expandedDecKey) << std::endl;
+    LOG(LC_Session, LL_Trace) << "expandedDecKey:" << hexDump(expandedDecKey);
 
     std::vector<uint8_t> expandedEncKey(64);
     calcMD5MAC(masterSecret, encExpansionBuffer, expandedEncKey);
 
-    std::cout << "expandedEncKey:" << strHex(expandedEncKey) << std::endl;
+    LOG(LC_Session, LL_Trace) << "expandedEncKey:" << hexDump(expandedEncKey);
 
     std::array<uint8_t, 20> decKey;
     std::copy(expandedDecKey.begin(), expandedDecKey.begin() + 20, decKey.begin());
@@ -130,13 +137,17 @@ void Session::generateCrypto2(const std::array<uint8_t, 16>& clientPubKey, const
 
     encMACKey.assign(expandedEncKey.begin() + 20, expandedEncKey.begin() + 20 + 16);
 
-    std::cout << "decKey:" << strHex(decKey.begin(), decKey.end()) << std::endl;
-    std::cout << "decMACKey:" << strHex(decMACKey) << std::endl;
-    std::cout << "encKey:" << strHex(encKey.begin(), encKey.end()) << std::endl;
-    std::cout << "encMACKey:" << strHex(encMACKey) << std::endl;
+    LOG(LC_Session, LL_Trace) << "decKey:" << hexDump(decKey);
+    LOG(LC_Session, LL_Trace) << "decMACKey:" << hexDump(decMACKey);
+    LOG(LC_Session, LL_Trace) << "encKey:" << hexDump(encKey);
+    LOG(LC_Session, LL_Trace) << "encMACKey:" << hexDump(encMACKey);
+
+    decRC5.setKey(decKey.data(), decKey.size());
+    encRC5.setKey(encKey.data(), encKey.size());
 
-    decRC5.SetKey(decKey.data(), decKey.size());
-    encRC5.SetKey(encKey.data(), encKey.size());
+    // Key the MACs once here, rather than for every packet
+    decMAC.SetKey(decMACKey.data(), decMACKey.size());
+    encMAC.SetKey(encMACKey.data(), encMACKey.size());
 
     // Generate server challenge result
     std::vector<uint8_t> serverChallengeResultBuffer;
@@ -147,7 +158,7 @@ void Session::generateCrypto2(const std::array<uint8_t, 16>& clientPubKey, const
     serverChallengeResult.resize(12);
     calcMD5MAC(masterSecret, serverChallengeResultBuffer, serverChallengeResult);
 
-    std::cout << "serverChallengeResult:" << strHex(serverChallengeResult) << std::endl;
+    LOG(LC_Session, LL_Trace) << "serverChallengeResult:" << hexDump(serverChallengeResult);
 
     // MAC buffer no longer needed
     macBuffer.clear();
@@ -155,68 +166,80 @@ void Session::generateCrypto2(const std::array<uint8_t, 16>& clientPubKey, const
     cryptoState = CS_Finished;
 }
 
-bool Session::decryptPacket(BitStream& bitStream, std::vector<uint8_t>& outBuf) const {
+bool Session::decryptPacket(uint8_t* data, size_t& size) const {
     if (cryptoState != CS_Finished) {
-        std::cout << "Tried to decrypt with unfinished crypto session!" << std::endl;
+        LOG(LC_Session, LL_Warning) << "Tried to decrypt with unfinished crypto session!";
         return false;
     }
 
-    outBuf.assign(bitStream.getHeadIterator(), bitStream.buf.end());
-    decryptRC5(decRC5, outBuf, outBuf);
+    if (!decryptRC5(decRC5, data, size, data, size) || size == 0) {
+        return false;
+    }
 
-    std::cout << "Full post-decryption:" << strHex(outBuf) << std::endl;
+    LOG(LC_Session, LL_Trace) << "Full post-decryption:" << hexDump(data, size);
 
     // Remove RC5 padding
-    uint8_t paddingLen = outBuf.back();
-    if (paddingLen > outBuf.size() - 1) {
-        std::cout << "Padding " << paddingLen << " too big for packet size " << outBuf.size() << "!" << std::endl;
+    uint8_t paddingLen = data[size - 1];
+    if (paddingLen > size - 1) {
+        LOG(LC_Session, LL_Warning) << "Padding " << paddingLen << " too big for packet size " << size << "!";
         return false;
     }
     // +1 to get rid of padding size byte
-    outBuf.resize(outBuf.size() - (paddingLen + 1));
+    size -= paddingLen + 1;
 
     // Remove the MAC
-    if (outBuf.size() < 16) {
-        std::cout << "Packet size " << outBuf.size() << " not large enough for 16-byte MAC!" << std::endl;
+    if (size < 16) {
+        LOG(LC_Session, LL_Warning) << "Packet size " << size << " not large enough for 16-byte MAC!";
         return false;
     }
 
-    std::vector<uint8_t> mac(outBuf.end() - 16, outBuf.end());
-    outBuf.resize(outBuf.size() - 16);
+    size -= 16;
+    const uint8_t* mac = data + size;
 
     // Make sure MAC matches
-    std::vector<uint8_t> calculatedMac(16);
-    calcMD5MAC(decMACKey, outBuf, calculatedMac);
+    std::array<uint8_t, 16> calculatedMac;
+    calcMD5MAC(decMAC, data, size, calculatedMac.data(), calculatedMac.size());
 
-    if (mac != calculatedMac) {
-        std::cout << "MAC mismatch!" << std::endl
-            << "Got:" << strHex(mac) << std::endl
-            << "Expected:" << strHex(calculatedMac) << std::endl;
+    if (!std::equal(calculatedMac.begin(), calculatedMac.end(), mac)) {
+        LOG(LC_Session, LL_Warning) << "MAC mismatch! Got:" << hexDump(mac, 16) << ", expected:" << hexDump(calculatedMac);
         return false;
     }
 
     return true;
 }
 
-bool Session::encryptPacket(std::vector<uint8_t>& data) const {
+bool Session::encryptPacket(PacketBuffer& buf, size_t offset) const {
     if (cryptoState != CS_Finished) {
-        std::cout << "Tried to encrypt with unfinished crypto session!" << std::endl;
+        LOG(LC_Session, LL_Warning) << "Tried to encrypt with unfinished crypto session!";
         return false;
     }
 
-    std::vector<uint8_t> calculatedMac(16);
-    calcMD5MAC(encMACKey, data, calculatedMac);
-
-    data.insert(data.end(), calculatedMac.begin(), calculatedMac.end());
+    if (offset > buf.getSize()) {
+        LOG(LC_Session, LL_Warning) << "Encryption offset " << offset << " past end of buffer size " << buf.getSize() << "!";
+        return false;
+    }
 
+    // Room for the MAC and padding
     // -1 since also writes the padding count
-    uint8_t requiredPadding = CryptoPP::RC5::BLOCKSIZE - (data.size() % CryptoPP::RC5::BLOCKSIZE) - 1;
-    data.insert(data.end(), requiredPadding, 0x00);
-    data.push_back(requiredPadding);
+    size_t msgSize = buf.getSize() - offset;
+    uint8_t requiredPadding = CryptoPP::RC5::BLOCKSIZE - ((msgSize + 16) % CryptoPP::RC5::BLOCKSIZE) - 1;
+    size_t encryptedSize = msgSize + 16 + requiredPadding + 1;
+    if (offset + encryptedSize > PacketBuffer::CAPACITY) {
+        LOG(LC_Session, LL_Warning) << "Encrypted packet of " << (offset + encryptedSize) << " bytes too big for buffer!";
+        return false;
+    }
+    buf.setSize(offset + encryptedSize);
 
-    std::cout << "Full pre-encryption:" << strHex(data) << std::endl;
+    uint8_t* data = buf.getData() + offset;
 
-    encryptRC5(encRC5, data, data);
+    // Write the MAC straight onto the end of the packet
+    calcMD5MAC(encMAC, data, msgSize, data + msgSize, 16);
 
-    return true;
+    // Pooled buffers hold whatever they last sent, so zero the padding
+    memset(data + msgSize + 16, 0, requiredPadding);
+    data[encryptedSize - 1] = requiredPadding;
+
+    LOG(LC_Session, LL_Trace) << "Full pre-encryption:" << hexDump(data, encryptedSize);
+
+    return encryptRC5(encRC5, data, encryptedSize, data, encryptedSize);
 }
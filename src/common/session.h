@@ -4,8 +4,25 @@
 #include <vector>
 #include "asio.hpp"
 #include "bitstream.h"
+#include "packet_buffer.h"
+#include "packet_coalescer.h"
+#include "reliable_channel.h"
+#include "sequence_window.h"
+#include "split_packet.h"
 #include "dh.h"
 #include "rc5.h"
+#include "crypto/md5mac.h"
+#include "crypto/rc5_blocks.h"
+
+/**
+ * Identifies a session within its server's SessionTable.
+ * Unlike a Session reference, a handle can be held onto, and simply stops resolving once the session is removed.
+ */
+class SessionHandle {
+public:
+    uint32_t index;
+    uint32_t generation;
+};
 
 /**
  * Represents a session between a server and a client.
@@ -15,38 +32,61 @@ public:
     enum CryptoState {
         CS_Init,
         CS_Challenge,
-        CS_Finished
+        CS_Finished,
+        // Waiting on handshake math from a worker thread, so crypto packets are ignored
+        CS_Pending
     };
 
     Session(asio::ip::udp::endpoint clientEndpoint) :
         clientEndpoint(clientEndpoint),
-        cryptoState(CS_Init) {
+        cryptoState(CS_Init),
+        lastPokeMS(0),
+        lastRecvMS(0),
+        halfOpen(false),
+        flushDeferred(false),
+        nextSendSeq(0) {
 
     }
 
     /**
-     * Generates the first stage of crypto values.
+     * Generates a DH key pair in the given group.
+     * This is the expensive part of the first stage, and touches no session state, so it can run on any thread.
+     */
+    static void generateKeyPair(const CryptoPP::Integer& p, const CryptoPP::Integer& g, std::vector<uint8_t>& privKey, std::vector<uint8_t>& pubKey);
+
+    /**
+     * Computes the DH agreed value from our private key and the client's public key.
+     * This is the expensive part of the second stage, and touches no session state, so it can run on any thread.
+     * @return Whether the keys agree. If not, the session should be closed.
+     */
+    static bool agreeKey(const CryptoPP::Integer& p, const CryptoPP::Integer& g, const std::vector<uint8_t>& privKey, const std::array<uint8_t, 16>& clientPubKey, std::vector<uint8_t>& agreedValue);
+
+    /**
+     * Generates the first stage of crypto values, using a key pair from generateKeyPair.
      */
-    void generateCrypto1(uint32_t clientTime, const std::array<uint8_t, 12>& clientChallenge, const CryptoPP::Integer& p, const CryptoPP::Integer& g);
+    void generateCrypto1(uint32_t clientTime, const std::array<uint8_t, 12>& clientChallenge, const CryptoPP::Integer& p, const CryptoPP::Integer& g,
+        const std::vector<uint8_t>& privKey, const std::vector<uint8_t>& pubKey);
 
     /**
-     * Generates the second stage of crypto values.
+     * Generates the second stage of crypto values, using an agreed value from agreeKey.
      */
-    void generateCrypto2(const std::array<uint8_t, 16>& pubKey, const std::array<uint8_t, 12>& clientChallengeResult);
+    void generateCrypto2(const std::vector<uint8_t>& agreedValue, const std::array<uint8_t, 12>& clientChallengeResult);
 
     /**
-     * Decrypts packet data using pre-established crypto values.
-     * Also checks for MAC match and removes MAC and padding.
+     * Decrypts packet data in-place using pre-established crypto values.
+     * Also checks for MAC match, and shrinks size to exclude the MAC and padding.
      */
-    bool decryptPacket(BitStream& bitStream, std::vector<uint8_t>& outBuf) const;
+    bool decryptPacket(uint8_t* data, size_t& size) const;
 
     /**
      * Encrypts packet data in-place using pre-established crypto values.
-     * Also adds MAC and appropriate padding.
+     * Only the bytes from offset onwards are encrypted, so a header can be written first.
+     * Also adds MAC and appropriate padding, which must fit in the buffer's capacity.
      */
-    bool encryptPacket(std::vector<uint8_t>& data) const;
+    bool encryptPacket(PacketBuffer& buf, size_t offset = 0) const;
 
     asio::ip::udp::endpoint clientEndpoint;
+    SessionHandle handle;
     int cryptoState;
 
     std::vector<uint8_t> macBuffer;
@@ -59,6 +99,8 @@ public:
     uint32_t storedServerTime;
     std::array<uint8_t, 12> storedServerChallenge;
 
+    CryptoPP::Integer dhP;
+    CryptoPP::Integer dhG;
     std::vector<uint8_t> serverPrivKey;
     std::vector<uint8_t> serverPubKey;
 
@@ -67,9 +109,36 @@ public:
 
     size_t lastPokeMS;
 
+    // When the last datagram from the client was received
+    size_t lastRecvMS;
+
+    // Whether the server is counting this session against its half-open session cap
+    bool halfOpen;
+
+    // Whether the server will call its flush handler for this session on the next flush (see Server::deferFlush)
+    bool flushDeferred;
+
+    // Sequence numbers of encrypted datagrams from the client, to drop duplicates before decrypting them (not replays, see SequenceWindow)
+    SequenceWindow recvSeqs;
+
+    // Sequence number for the next datagram sent with a header
+    uint16_t nextSendSeq;
+
+    // Encrypted packets waiting to go out together on the next flush
+    PacketCoalescer outbound;
+
+    // Delivery of game packets sent and received in slot 0, and of split messages in slot 4
+    ReliableChannel reliable;
+
+    // Fragments of split messages from the client, waiting for the rest of their message
+    SplitPacketReassembler splitPackets;
+
 private:
-    CryptoPP::RC5::Decryption decRC5;
-    CryptoPP::RC5::Encryption encRC5;
-    
-    CryptoPP::DH dh;
+    RC5Blocks decRC5;
+    RC5Blocks encRC5;
+
+    // Keyed once the handshake finishes. Mutable since a MAC calculation only passes through
+    // scratch state, which Final resets back to the keyed state
+    mutable CryptoPP::MD5MAC decMAC;
+    mutable CryptoPP::MD5MAC encMAC;
 };
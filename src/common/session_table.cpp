@@ -0,0 +1,134 @@
+#include <memory>
+#include <vector>
+#include "asio.hpp"
+#include "session_table.h"
+
+SessionTable::SessionTable(size_t initialCapacity) :
+    numSessions(0) {
+    // Keep the bucket count a power of two, at no more than half full
+    size_t numBuckets = 16;
+    bucketShift = 60;
+    while (numBuckets < initialCapacity * 2) {
+        numBuckets *= 2;
+        bucketShift--;
+    }
+
+    Bucket emptyBucket = { 0, EMPTY_BUCKET };
+    buckets.assign(numBuckets, emptyBucket);
+}
+
+Session* SessionTable::find(const asio::ip::udp::endpoint& endpoint) const {
+    const Bucket& bucket = buckets[findBucket(makeKey(endpoint))];
+    if (bucket.sessionIndex == EMPTY_BUCKET) {
+        return nullptr;
+    }
+
+    return sessions[bucket.sessionIndex].get();
+}
+
+Session* SessionTable::get(SessionHandle handle) const {
+    if (handle.index >= sessions.size() || generations[handle.index] != handle.generation) {
+        return nullptr;
+    }
+
+    return sessions[handle.index].get();
+}
+
+Session& SessionTable::insert(const asio::ip::udp::endpoint& endpoint) {
+    if ((numSessions + 1) * 2 > buckets.size()) {
+        grow();
+    }
+
+    uint32_t index;
+    if (!freeIndices.empty()) {
+        index = freeIndices.back();
+        freeIndices.pop_back();
+    } else {
+        index = (uint32_t)sessions.size();
+        sessions.emplace_back();
+        generations.push_back(0);
+    }
+
+    sessions[index].reset(new Session(endpoint));
+    sessions[index]->handle.index = index;
+    sessions[index]->handle.generation = generations[index];
+
+    uint64_t key = makeKey(endpoint);
+    Bucket& bucket = buckets[findBucket(key)];
+    bucket.key = key;
+    bucket.sessionIndex = index;
+
+    numSessions++;
+
+    return *sessions[index];
+}
+
+void SessionTable::remove(SessionHandle handle) {
+    Session* session = get(handle);
+    if (session == nullptr) {
+        return;
+    }
+
+    size_t mask = buckets.size() - 1;
+    size_t hole = findBucket(makeKey(session->clientEndpoint));
+
+    // Backward-shift deletion: pull later entries of the probe run into the hole, so no tombstones are needed
+    size_t next = (hole + 1) & mask;
+    while (buckets[next].sessionIndex != EMPTY_BUCKET) {
+        size_t home = homeBucket(buckets[next].key);
+
+        // Only move the entry if the hole lies between its home bucket and where it is now
+        if (((next - home) & mask) >= ((next - hole) & mask)) {
+            buckets[hole] = buckets[next];
+            hole = next;
+        }
+
+        next = (next + 1) & mask;
+    }
+
+    buckets[hole].sessionIndex = EMPTY_BUCKET;
+
+    sessions[handle.index].reset();
+    generations[handle.index]++;
+    freeIndices.push_back(handle.index);
+    numSessions--;
+}
+
+size_t SessionTable::size() const {
+    return numSessions;
+}
+
+uint64_t SessionTable::makeKey(const asio::ip::udp::endpoint& endpoint) {
+    return ((uint64_t)endpoint.address().to_v4().to_ulong() << 16) | endpoint.port();
+}
+
+size_t SessionTable::homeBucket(uint64_t key) const {
+    // Fibonacci hashing, which spreads out the sequential addresses and ports well
+    return (size_t)((key * 0x9E3779B97F4A7C15ull) >> bucketShift);
+}
+
+size_t SessionTable::findBucket(uint64_t key) const {
+    size_t mask = buckets.size() - 1;
+    size_t i = homeBucket(key);
+
+    while (buckets[i].sessionIndex != EMPTY_BUCKET && buckets[i].key != key) {
+        i = (i + 1) & mask;
+    }
+
+    return i;
+}
+
+void SessionTable::grow() {
+    std::vector<Bucket> oldBuckets;
+    oldBuckets.swap(buckets);
+
+    Bucket emptyBucket = { 0, EMPTY_BUCKET };
+    buckets.assign(oldBuckets.size() * 2, emptyBucket);
+    bucketShift--;
+
+    for (auto& oldBucket : oldBuckets) {
+        if (oldBucket.sessionIndex != EMPTY_BUCKET) {
+            buckets[findBucket(oldBucket.key)] = oldBucket;
+        }
+    }
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+#include "asio.hpp"
+#include "session.h"
+
+/**
+ * Maps client endpoints (address + port) to sessions.
+ *
+ * Uses a flat open-addressing hash table with linear probing, so a lookup is usually a single cache line.
+ * Sessions are allocated separately and never move, so a Session reference stays valid until the session is removed.
+ * Only IPv4 endpoints are supported, since that is all the server listens on.
+ */
+class SessionTable {
+public:
+    SessionTable(size_t initialCapacity = 1024);
+
+    /**
+     * @return The session with the given endpoint, or nullptr if there isn't one.
+     */
+    Session* find(const asio::ip::udp::endpoint& endpoint) const;
+
+    /**
+     * @return The session with the given handle, or nullptr if it has since been removed.
+     */
+    Session* get(SessionHandle handle) const;
+
+    /**
+     * Creates a new session for an endpoint that must not already have one.
+     */
+    Session& insert(const asio::ip::udp::endpoint& endpoint);
+
+    /**
+     * Removes and destroys a session. Any references to it become invalid, and its handle becomes stale.
+     */
+    void remove(SessionHandle handle);
+
+    /**
+     * @return The number of sessions.
+     */
+    size_t size() const;
+
+    /**
+     * Calls a function with every session.
+     */
+    template<typename Func>
+    void forEach(Func func) {
+        for (auto& session : sessions) {
+            if (session) {
+                func(*session);
+            }
+        }
+    }
+
+private:
+    static const uint32_t EMPTY_BUCKET = 0xFFFFFFFF;
+
+    class Bucket {
+    public:
+        uint64_t key;
+        uint32_t sessionIndex;
+    };
+
+    /**
+     * @return The packed address and port of an endpoint.
+     */
+    static uint64_t makeKey(const asio::ip::udp::endpoint& endpoint);
+
+    /**
+     * @return The bucket a key would ideally be in.
+     */
+    size_t homeBucket(uint64_t key) const;
+
+    /**
+     * @return The index of the bucket holding the key, or the empty bucket where it would be inserted.
+     */
+    size_t findBucket(uint64_t key) const;
+
+    /**
+     * Doubles the number of buckets and reinserts every session.
+     */
+    void grow();
+
+    std::vector<Bucket> buckets;
+    size_t bucketShift;
+    std::vector<std::unique_ptr<Session>> sessions;
+    std::vector<uint32_t> generations;
+    std::vector<uint32_t> freeIndices;
+    size_t numSessions;
+};
@@ -0,0 +1,93 @@
+#include <algorithm>
+#include <map>
+#include <random>
+#include <vector>
+#include "asio.hpp"
+#include "bench.h"
+#include "session_table.h"
+#include "session_table_test.h"
+#include "test.h"
+
+using asio::ip::udp;
+
+std::vector<udp::endpoint> makeTestEndpoints(size_t count) {
+    std::mt19937 generator(1234);
+    std::uniform_int_distribution<uint32_t> addrDistribution;
+
+    std::vector<udp::endpoint> endpoints;
+    endpoints.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+        // Plenty of clients share an address (NAT), so keep some endpoints apart by port only
+        uint32_t addr = (i % 4 == 0 && i > 0) ? endpoints[i - 1].address().to_v4().to_ulong() : addrDistribution(generator);
+        endpoints.emplace_back(asio::ip::address_v4(addr), (unsigned short)(1024 + i % 60000));
+    }
+
+    return endpoints;
+}
+
+void testSessionTable() {
+    SessionTable table(4);
+    std::vector<udp::endpoint> endpoints = makeTestEndpoints(1000);
+
+    std::vector<SessionHandle> handles;
+    for (auto& endpoint : endpoints) {
+        handles.push_back(table.insert(endpoint).handle);
+    }
+    assertEqual(table.size(), endpoints.size());
+
+    // Same address, different port must be a different session
+    udp::endpoint natEndpoint(endpoints[0].address(), endpoints[0].port() + 1);
+    assertEqual((void*)table.find(natEndpoint), (void*)nullptr);
+
+    // Remove every other session, which exercises the backward-shift deletion
+    for (size_t i = 0; i < endpoints.size(); i += 2) {
+        table.remove(handles[i]);
+    }
+    assertEqual(table.size(), endpoints.size() / 2);
+
+    for (size_t i = 0; i < endpoints.size(); ++i) {
+        Session* session = table.find(endpoints[i]);
+        if (i % 2 == 0) {
+            assertEqual((void*)session, (void*)nullptr);
+            assertEqual((void*)table.get(handles[i]), (void*)nullptr);
+        } else {
+            bool foundEndpoint = session != nullptr && session->clientEndpoint == endpoints[i];
+            assertEqual((void*)session, (void*)table.get(handles[i]));
+            assertEqual(foundEndpoint, true);
+        }
+    }
+
+    // Reused slots must not resolve through stale handles
+    Session& reinserted = table.insert(endpoints[0]);
+    SessionHandle staleHandle = handles[reinserted.handle.index];
+    assertEqual(staleHandle.index, reinserted.handle.index);
+    assertEqual((void*)table.get(staleHandle), (void*)nullptr);
+    assertEqual((void*)table.get(reinserted.handle), (void*)&reinserted);
+}
+
+void benchSessionTableSize(size_t numSessions) {
+    std::vector<udp::endpoint> endpoints = makeTestEndpoints(numSessions);
+
+    SessionTable table;
+    std::map<asio::ip::address, Session*> addressMap;
+    for (auto& endpoint : endpoints) {
+        Session& session = table.insert(endpoint);
+        addressMap.emplace(endpoint.address(), &session);
+    }
+
+    // Look up in a random order so that the caches don't hide the pointer chasing
+    std::vector<udp::endpoint> lookups(endpoints);
+    std::shuffle(lookups.begin(), lookups.end(), std::mt19937(5678));
+
+    size_t numLookups = 1000000;
+    std::cout << numSessions << " sessions" << std::endl;
+    benchmark("  SessionTable::find", numLookups,
+        benchKeep(table.find(lookups[benchIter % lookups.size()])));
+    benchmark("  std::map<address>::find (old)", numLookups,
+        benchKeep(addressMap.find(lookups[benchIter % lookups.size()].address())->second));
+}
+
+void benchSessionTable() {
+    benchSessionTableSize(10000);
+    benchSessionTableSize(100000);
+}
@@ -0,0 +1,67 @@
+#include <memory>
+#include <thread>
+#include <vector>
+#include "asio.hpp"
+#include "log.h"
+#include "sharded_server.h"
+
+ShardedServer::ShardedServer(short port, Server::RecvHandler recvHandler, Server::AdmitHandler admitHandler, size_t numShards, ServerConfig config) {
+#ifndef PSEMU_PLATFORM_LIN
+    if (numShards > 1) {
+        LOG(LC_Server, LL_Warning) << "Sharding requires SO_REUSEPORT, falling back to 1 shard";
+        numShards = 1;
+    }
+#endif
+
+    if (numShards == 0) {
+        numShards = 1;
+    }
+
+    config.reusePort = numShards > 1;
+
+    for (size_t i = 0; i < numShards; ++i) {
+        ioServices.emplace_back(new asio::io_service(1));
+        shards.emplace_back(new Server(*ioServices.back(), port, recvHandler, admitHandler, config));
+    }
+}
+
+ShardedServer::~ShardedServer() {
+    stop();
+}
+
+void ShardedServer::repeat(size_t intervalMS, void(*handler)(Server&)) {
+    for (auto& shard : shards) {
+        shard->repeat(intervalMS, handler);
+    }
+}
+
+void ShardedServer::setFlushHandler(Server::FlushHandler handler) {
+    for (auto& shard : shards) {
+        shard->setFlushHandler(handler);
+    }
+}
+
+void ShardedServer::start() {
+    for (auto& ioService : ioServices) {
+        asio::io_service* ioServicePtr = ioService.get();
+        threads.emplace_back([ioServicePtr]() {
+            ioServicePtr->run();
+        });
+    }
+}
+
+void ShardedServer::stop() {
+    for (auto& ioService : ioServices) {
+        ioService->stop();
+    }
+
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    threads.clear();
+}
+
+size_t ShardedServer::getNumShards() const {
+    return shards.size();
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <memory>
+#include <thread>
+#include <vector>
+#include "asio.hpp"
+#include "server.h"
+
+/**
+ * Runs several Servers on the same port, each with its own socket, io_service thread and session map.
+ * The sockets are bound with SO_REUSEPORT, so the kernel spreads clients across the shards by source address hash,
+ * and a client always lands on the same shard.
+ * On platforms without SO_REUSEPORT load balancing, only a single shard is created.
+ */
+class ShardedServer {
+public:
+    ShardedServer(short port, Server::RecvHandler recvHandler, Server::AdmitHandler admitHandler, size_t numShards, ServerConfig config = ServerConfig());
+
+    ~ShardedServer();
+
+    /**
+     * Calls a handler every intervalMS milliseconds on every shard, from that shard's thread.
+     */
+    void repeat(size_t intervalMS, void(*handler)(Server&));
+
+    /**
+     * Sets the flush handler of every shard. Must be called before start.
+     */
+    void setFlushHandler(Server::FlushHandler handler);
+
+    /**
+     * Starts one thread per shard running the shard's io_service.
+     */
+    void start();
+
+    /**
+     * Stops all shards and waits for their threads to finish.
+     */
+    void stop();
+
+    /**
+     * @return The number of shards.
+     */
+    size_t getNumShards() const;
+
+private:
+    std::vector<std::unique_ptr<asio::io_service>> ioServices;
+    std::vector<std::unique_ptr<Server>> shards;
+    std::vector<std::thread> threads;
+};
@@ -0,0 +1,120 @@
+#include <algorithm>
+#include "split_packet.h"
+
+SplitPacketReassembler::SplitPacketReassembler(uint16_t firstSubslot) :
+    numFragments(0),
+    nextSubslot(firstSubslot),
+    inMessage(false),
+    messageSize(0) {
+    for (Entry& entry : entries) {
+        entry.present = false;
+        entry.subslot = 0;
+    }
+}
+
+bool SplitPacketReassembler::canAdd(uint16_t subslot) const {
+    return (uint16_t)(subslot - nextSubslot) < MAX_FRAGMENTS;
+}
+
+bool SplitPacketReassembler::add(uint16_t subslot, const uint8_t* data, size_t size) {
+    if (size > PacketBuffer::CAPACITY) {
+        return false;
+    }
+
+    Entry* entry = store(subslot);
+    if (entry == nullptr) {
+        return false;
+    }
+
+    entry->data = PacketBufferPool::acquire();
+    memcpy(entry->data->getData(), data, size);
+    entry->data->setSize(size);
+    numFragments++;
+    return true;
+}
+
+void SplitPacketReassembler::addOther(uint16_t subslot) {
+    store(subslot);
+}
+
+bool SplitPacketReassembler::take(std::vector<uint8_t>& message) {
+    while (true) {
+        Entry& entry = entries[nextSubslot % MAX_FRAGMENTS];
+        if (!entry.present || entry.subslot != nextSubslot) {
+            return false;
+        }
+
+        if (!entry.data) {
+            // Messages are split into consecutive subslots, so another packet in the middle of one cuts it off
+            inMessage = false;
+            advance(entry);
+            continue;
+        }
+
+        const PacketBuffer& fragment = *entry.data;
+        if (!inMessage) {
+            if (!readHeader(fragment, messageSize)) {
+                advance(entry);
+                continue;
+            }
+
+            inMessage = true;
+            partialMessage.clear();
+            partialMessage.reserve(messageSize);
+            partialMessage.insert(partialMessage.end(), fragment.getData() + SplitPacket::HEADER_SIZE, fragment.getData() + fragment.getSize());
+        } else {
+            partialMessage.insert(partialMessage.end(), fragment.getData(), fragment.getData() + fragment.getSize());
+        }
+
+        advance(entry);
+
+        if (partialMessage.size() >= messageSize) {
+            inMessage = false;
+
+            // Sizes that don't add up mean the fragments can never make a message
+            if (partialMessage.size() == messageSize) {
+                message.swap(partialMessage);
+                return true;
+            }
+        }
+    }
+
+    return false;
+}
+
+SplitPacketReassembler::Entry* SplitPacketReassembler::store(uint16_t subslot) {
+    if (!canAdd(subslot)) {
+        return nullptr;
+    }
+
+    Entry& entry = entries[subslot % MAX_FRAGMENTS];
+    if (entry.present) {
+        return nullptr;
+    }
+
+    entry.present = true;
+    entry.subslot = subslot;
+    return &entry;
+}
+
+void SplitPacketReassembler::advance(Entry& entry) {
+    if (entry.data) {
+        entry.data.reset();
+        numFragments--;
+    }
+
+    entry.present = false;
+    nextSubslot++;
+}
+
+bool SplitPacketReassembler::readHeader(const PacketBuffer& fragment, size_t& messageSize) {
+    const uint8_t* data = fragment.getData();
+    if (fragment.getSize() < SplitPacket::HEADER_SIZE || data[0] != 0x00 || data[1] != OP_HandleGamePacket) {
+        return false;
+    }
+
+    uint16_t messageSize16;
+    memcpy(&messageSize16, data + 2, sizeof(messageSize16));
+    messageSize = messageSize16;
+    return true;
+}
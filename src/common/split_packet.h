@@ -0,0 +1,140 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include "packet_buffer.h"
+#include "packet/opcodes.h"
+
+/**
+ * Messages too big for one slotted packet, split over slotted packets in consecutive subslots.
+ *
+ * The first fragment starts with a header of a zero byte, OP_HandleGamePacket and the size of the whole message,
+ * followed by as much of the message as fits. The rest of the fragments carry the following bytes as is.
+ * Since each fragment is its own slotted packet, a lost fragment is resent on its own rather than losing the whole
+ * message, which is what happens when an oversized datagram is left to IP fragmentation.
+ */
+class SplitPacket {
+public:
+    static const size_t HEADER_SIZE = 4;
+
+    // The size in the header is 16 bits
+    static const size_t MAX_MESSAGE_SIZE = 0xFFFF;
+
+    /**
+     * Splits a message into fragments of at most maxFragmentSize bytes, and calls func(PacketBufferHandle) with each in order.
+     * @return Whether the message could be split, which needs it to be at most MAX_MESSAGE_SIZE bytes
+     */
+    template<typename Func>
+    static bool split(const uint8_t* data, size_t size, size_t maxFragmentSize, Func func) {
+        if (size > MAX_MESSAGE_SIZE || maxFragmentSize <= HEADER_SIZE || maxFragmentSize > PacketBuffer::CAPACITY) {
+            return false;
+        }
+
+        PacketBufferHandle first = PacketBufferPool::acquire();
+        uint16_t messageSize = (uint16_t)size;
+        first->getData()[0] = 0x00;
+        first->getData()[1] = OP_HandleGamePacket;
+        memcpy(first->getData() + 2, &messageSize, sizeof(messageSize));
+
+        size_t firstSize = std::min(size, maxFragmentSize - HEADER_SIZE);
+        memcpy(first->getData() + HEADER_SIZE, data, firstSize);
+        first->setSize(HEADER_SIZE + firstSize);
+        func(std::move(first));
+
+        for (size_t offset = firstSize; offset < size; offset += maxFragmentSize) {
+            PacketBufferHandle fragment = PacketBufferPool::acquire();
+            size_t fragmentSize = std::min(size - offset, maxFragmentSize);
+            memcpy(fragment->getData(), data + offset, fragmentSize);
+            fragment->setSize(fragmentSize);
+            func(std::move(fragment));
+        }
+
+        return true;
+    }
+};
+
+/**
+ * Puts split messages from the client back together, whatever order their fragments arrive in.
+ *
+ * A fragment's bytes can't tell a header from a continuation that happens to start the same way, so fragments are
+ * only interpreted in subslot order: each one either starts a message, if none is in progress, or continues the
+ * current one. That needs every reliable subslot, so the other reliable packets are passed in with addOther to step
+ * over their subslots. Subslots are numbered from 0, as ReliableChannel numbers its own.
+ *
+ * Subslots arriving ahead of the next one due wait in a fixed ring indexed by subslot, so a session never holds more
+ * than MAX_FRAGMENTS of them. Ones too far ahead to fit should be left unacked (see canAdd), so that the client resends
+ * them once the ring has caught up, rather than being dropped for good.
+ */
+class SplitPacketReassembler {
+public:
+    static const size_t MAX_FRAGMENTS = 16;
+
+    explicit SplitPacketReassembler(uint16_t firstSubslot = 0);
+
+    /**
+     * @return Whether the ring has room for the subslot. Only false for ones too far ahead, or behind the next one due
+     */
+    bool canAdd(uint16_t subslot) const;
+
+    /**
+     * Adds a fragment that arrived in the given subslot. Call take afterwards for any messages it completed.
+     * @return Whether the fragment was kept. Duplicates, and fragments canAdd refuses, are dropped
+     */
+    bool add(uint16_t subslot, const uint8_t* data, size_t size);
+
+    /**
+     * Records that some other reliable packet arrived in the given subslot. Call take afterwards, as for add.
+     * As with add, the subslot is skipped if canAdd refuses it.
+     */
+    void addOther(uint16_t subslot);
+
+    /**
+     * Takes the next message whose fragments are all in, handling waiting subslots in order.
+     * @return Whether there was one, in which case it is written to message
+     */
+    bool take(std::vector<uint8_t>& message);
+
+    /**
+     * @return The number of fragments waiting for the subslots before them
+     */
+    size_t getNumFragments() const {
+        return numFragments;
+    }
+
+private:
+    class Entry {
+    public:
+        bool present;
+        // Empty for other packets
+        PacketBufferHandle data;
+        uint16_t subslot;
+    };
+
+    /**
+     * Makes room for a subslot in the ring.
+     * @return Its entry, or nullptr if it's a duplicate or canAdd refuses it
+     */
+    Entry* store(uint16_t subslot);
+
+    /**
+     * Frees an entry, and moves on to the next subslot.
+     */
+    void advance(Entry& entry);
+
+    /**
+     * @return Whether the fragment starts with a valid header, and if so the size of its message
+     */
+    static bool readHeader(const PacketBuffer& fragment, size_t& messageSize);
+
+    std::array<Entry, MAX_FRAGMENTS> entries;
+    size_t numFragments;
+    uint16_t nextSubslot;
+
+    // The message in progress, if any
+    bool inMessage;
+    size_t messageSize;
+    std::vector<uint8_t> partialMessage;
+};
@@ -0,0 +1,202 @@
+#include <vector>
+#include "bench.h"
+#include "log.h"
+#include "split_packet.h"
+#include "split_packet_test.h"
+#include "test.h"
+
+std::vector<uint8_t> makeTestMessage(size_t size) {
+    std::vector<uint8_t> message(size);
+    for (size_t i = 0; i < size; ++i) {
+        message[i] = (uint8_t)(i * 7 + i / 256);
+    }
+
+    return message;
+}
+
+std::vector<PacketBufferHandle> splitTestMessage(const std::vector<uint8_t>& message, size_t maxFragmentSize) {
+    std::vector<PacketBufferHandle> fragments;
+    bool split = SplitPacket::split(message.data(), message.size(), maxFragmentSize, [&fragments](PacketBufferHandle fragment) {
+        fragments.push_back(std::move(fragment));
+    });
+    assertEqual(split, true);
+    return fragments;
+}
+
+void testSplitPacketSplit() {
+    std::vector<uint8_t> message = makeTestMessage(250);
+    std::vector<PacketBufferHandle> fragments = splitTestMessage(message, 100);
+
+    // 96 bytes after the header, then 100, then the last 54
+    assertEqual(fragments.size(), 3);
+    assertEqual(fragments[0]->getSize(), 100);
+    assertEqual(fragments[1]->getSize(), 100);
+    assertEqual(fragments[2]->getSize(), 54);
+    std::vector<uint8_t> header(fragments[0]->getData(), fragments[0]->getData() + SplitPacket::HEADER_SIZE);
+    assertBuffersEqual(header, std::vector<uint8_t>({ 0x00, 0x00, 0xFA, 0x00 }));
+    assertEqual(fragments[1]->getData()[0], message[96]);
+    assertEqual(fragments[2]->getData()[53], message[249]);
+
+    std::vector<uint8_t> tooBig(SplitPacket::MAX_MESSAGE_SIZE + 1);
+    bool split = SplitPacket::split(tooBig.data(), tooBig.size(), 1000, [](PacketBufferHandle fragment) {});
+    assertEqual(split, false);
+}
+
+/**
+ * Adds a fragment, and takes the message it completes if any.
+ * @return Whether it completed one
+ */
+bool addAndTake(SplitPacketReassembler& reassembler, uint16_t subslot, const PacketBuffer& fragment, std::vector<uint8_t>& reassembled) {
+    reassembler.add(subslot, fragment.getData(), fragment.getSize());
+    bool complete = reassembler.take(reassembled);
+    assertEqual(reassembler.take(reassembled), false);
+    return complete;
+}
+
+void testSplitPacketReassemble() {
+    std::vector<uint8_t> message = makeTestMessage(1000);
+    std::vector<PacketBufferHandle> fragments = splitTestMessage(message, 150);
+
+    // Out of order, with a duplicate, and wrapping around
+    uint16_t firstSubslot = 0xFFFD;
+    SplitPacketReassembler reassembler(firstSubslot);
+    std::vector<uint8_t> reassembled;
+    size_t order[] = { 3, 0, 6, 1, 1, 4, 2, 5 };
+    for (size_t i = 0; i < sizeof(order) / sizeof(order[0]); ++i) {
+        bool complete = addAndTake(reassembler, (uint16_t)(firstSubslot + order[i]), *fragments[order[i]], reassembled);
+        assertEqual(complete, (i == 7));
+    }
+
+    assertBuffersEqual(reassembled, message);
+    assertEqual(reassembler.getNumFragments(), 0);
+}
+
+void testSplitPacketReassembleHeaderLike() {
+    // A continuation fragment that starts with what looks like a header, as zero-heavy messages easily do
+    std::vector<uint8_t> message = makeTestMessage(250);
+    message[196] = 0x00;
+    message[197] = 0x00;
+    message[198] = 0x10;
+    message[199] = 0x00;
+    std::vector<PacketBufferHandle> fragments = splitTestMessage(message, 100);
+    assertEqual(fragments[2]->getData()[2], 0x10);
+
+    size_t orders[][3] = { { 0, 1, 2 }, { 0, 2, 1 }, { 1, 0, 2 } };
+    for (size_t i = 0; i < sizeof(orders) / sizeof(orders[0]); ++i) {
+        SplitPacketReassembler reassembler(9);
+        std::vector<uint8_t> reassembled;
+        reassembler.addOther(9);
+
+        for (size_t j = 0; j < 3; ++j) {
+            bool complete = addAndTake(reassembler, (uint16_t)(10 + orders[i][j]), *fragments[orders[i][j]], reassembled);
+            assertEqual(complete, (j == 2));
+        }
+
+        assertBuffersEqual(reassembled, message);
+        assertEqual(reassembler.getNumFragments(), 0);
+    }
+}
+
+void testSplitPacketReassembleInterleaved() {
+    std::vector<uint8_t> message1 = makeTestMessage(300);
+    std::vector<uint8_t> message2 = makeTestMessage(200);
+    std::vector<PacketBufferHandle> fragments1 = splitTestMessage(message1, 150);
+    std::vector<PacketBufferHandle> fragments2 = splitTestMessage(message2, 150);
+
+    // Subslots 0-2 are the first message, 3 another packet, and 4-5 the second message, with the gap filled last
+    SplitPacketReassembler reassembler;
+    std::vector<uint8_t> reassembled;
+    reassembler.add(0, fragments1[0]->getData(), fragments1[0]->getSize());
+    reassembler.add(1, fragments1[1]->getData(), fragments1[1]->getSize());
+    reassembler.addOther(3);
+    reassembler.add(4, fragments2[0]->getData(), fragments2[0]->getSize());
+    reassembler.add(5, fragments2[1]->getData(), fragments2[1]->getSize());
+    assertEqual(reassembler.take(reassembled), false);
+
+    reassembler.add(2, fragments1[2]->getData(), fragments1[2]->getSize());
+    assertEqual(reassembler.take(reassembled), true);
+    assertBuffersEqual(reassembled, message1);
+    assertEqual(reassembler.take(reassembled), true);
+    assertBuffersEqual(reassembled, message2);
+    assertEqual(reassembler.take(reassembled), false);
+    assertEqual(reassembler.getNumFragments(), 0);
+
+    // Anything behind what was already handled is dropped
+    assertEqual(reassembler.add(1, fragments1[1]->getData(), fragments1[1]->getSize()), false);
+}
+
+void testSplitPacketReassembleBounded() {
+    std::vector<uint8_t> message = makeTestMessage(2000);
+    std::vector<PacketBufferHandle> fragments = splitTestMessage(message, 100);
+    assertEqual((fragments.size() > SplitPacketReassembler::MAX_FRAGMENTS), true);
+
+    // The first fragment is lost, and the ring only has room for the ones right after it. The server leaves the rest unacked
+    SplitPacketReassembler reassembler;
+    std::vector<uint8_t> reassembled;
+    std::vector<size_t> unacked;
+    for (size_t i = 1; i < fragments.size(); ++i) {
+        if (!reassembler.canAdd((uint16_t)i)) {
+            assertEqual(reassembler.add((uint16_t)i, fragments[i]->getData(), fragments[i]->getSize()), false);
+            unacked.push_back(i);
+            continue;
+        }
+
+        assertEqual(addAndTake(reassembler, (uint16_t)i, *fragments[i], reassembled), false);
+    }
+    assertEqual(unacked.size(), fragments.size() - SplitPacketReassembler::MAX_FRAGMENTS);
+    assertEqual(reassembler.getNumFragments(), SplitPacketReassembler::MAX_FRAGMENTS - 1);
+
+    // Then the client resends the lost one, and the unacked ones after it
+    assertEqual(addAndTake(reassembler, 0, *fragments[0], reassembled), false);
+    for (size_t j = 0; j < unacked.size(); ++j) {
+        assertEqual(reassembler.canAdd((uint16_t)unacked[j]), true);
+        bool complete = addAndTake(reassembler, (uint16_t)unacked[j], *fragments[unacked[j]], reassembled);
+        assertEqual(complete, (j == unacked.size() - 1));
+    }
+
+    assertBuffersEqual(reassembled, message);
+    assertEqual(reassembler.getNumFragments(), 0);
+
+    // Anything behind what was already handled is refused
+    assertEqual(reassembler.canAdd(0), false);
+
+    // Messages with sizes that don't add up don't pile up either
+    SplitPacketReassembler badReassembler(5);
+    std::vector<uint8_t> badFirst = { 0x00, 0x00, 0x05, 0x00, 0x01, 0x02 };
+    std::vector<uint8_t> badRest(10, 0x22);
+    badReassembler.add(5, badFirst.data(), badFirst.size());
+    badReassembler.add(6, badRest.data(), badRest.size());
+    assertEqual(badReassembler.take(reassembled), false);
+    assertEqual(badReassembler.getNumFragments(), 0);
+}
+
+void testSplitPacket() {
+    testSplitPacketSplit();
+    testSplitPacketReassemble();
+    testSplitPacketReassembleHeaderLike();
+    testSplitPacketReassembleInterleaved();
+    testSplitPacketReassembleBounded();
+}
+
+void benchSplitPacket() {
+    size_t numIters = 100000;
+    size_t bytesReassembled = 0;
+
+    // A zone entry sized message
+    std::vector<uint8_t> message = makeTestMessage(5000);
+    std::vector<uint8_t> reassembled;
+    SplitPacketReassembler reassembler;
+    uint16_t subslot = 0;
+
+    std::cout << "SplitPacket" << std::endl;
+    benchmark("  split + reassemble 5000 bytes", numIters, {
+        SplitPacket::split(message.data(), message.size(), 1400, [&](PacketBufferHandle fragment) {
+            reassembler.add(subslot++, fragment->getData(), fragment->getSize());
+            if (reassembler.take(reassembled)) {
+                bytesReassembled += reassembled.size();
+            }
+        });
+    });
+
+    benchKeep(bytesReassembled);
+}
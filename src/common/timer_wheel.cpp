@@ -0,0 +1,55 @@
+#include <algorithm>
+#include <vector>
+#include "timer_wheel.h"
+
+TimerWheel::TimerWheel(size_t tickMS, size_t numSlots) :
+    tickMS(tickMS),
+    curTick(0),
+    slots(numSlots) {
+
+}
+
+void TimerWheel::schedule(SessionHandle handle, size_t deadlineMS) {
+    size_t deadlineTick = deadlineMS / tickMS;
+
+    // Never schedule into a slot that has already been passed this revolution
+    if (deadlineTick < curTick) {
+        deadlineTick = curTick;
+    }
+
+    Entry entry;
+    entry.handle = handle;
+    entry.deadlineMS = deadlineMS;
+    slots[deadlineTick % slots.size()].push_back(entry);
+}
+
+void TimerWheel::advance(size_t nowMS, std::vector<SessionHandle>& expired) {
+    size_t nowTick = nowMS / tickMS;
+
+    if (curTick == 0) {
+        curTick = nowTick;
+    }
+
+    // No need to visit a slot more than once, even after a long stall
+    size_t lastTick = std::min(nowTick, curTick + slots.size() - 1);
+
+    for (; curTick <= lastTick; ++curTick) {
+        std::vector<Entry>& slot = slots[curTick % slots.size()];
+
+        for (size_t i = 0; i < slot.size();) {
+            if (slot[i].deadlineMS <= nowMS) {
+                expired.push_back(slot[i].handle);
+                slot[i] = slot.back();
+                slot.pop_back();
+            } else {
+                ++i;
+            }
+        }
+    }
+
+    curTick = nowTick;
+}
+
+size_t TimerWheel::getTickMS() const {
+    return tickMS;
+}
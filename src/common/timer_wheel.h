@@ -0,0 +1,42 @@
+#pragma once
+
+#include <vector>
+#include "session.h"
+
+/**
+ * A hashed timer wheel of session deadlines.
+ *
+ * Scheduling and expiring are O(1) per entry no matter how many sessions there are, at the cost of
+ * deadlines only being checked with a resolution of one tick. Deadlines further out than one revolution
+ * of the wheel simply stay in their slot for extra revolutions.
+ */
+class TimerWheel {
+public:
+    TimerWheel(size_t tickMS, size_t numSlots);
+
+    /**
+     * Schedules a session to expire at the given time.
+     */
+    void schedule(SessionHandle handle, size_t deadlineMS);
+
+    /**
+     * Advances the wheel to the given time, collecting every entry whose deadline has passed.
+     */
+    void advance(size_t nowMS, std::vector<SessionHandle>& expired);
+
+    /**
+     * @return The resolution of the wheel.
+     */
+    size_t getTickMS() const;
+
+private:
+    class Entry {
+    public:
+        SessionHandle handle;
+        size_t deadlineMS;
+    };
+
+    size_t tickMS;
+    size_t curTick;
+    std::vector<std::vector<Entry>> slots;
+};
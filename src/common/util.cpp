@@ -55,27 +55,47 @@ int hexCharToInt(char c) {
     return -1;
 }
 
-std::vector<uint8_t> hexToBytes(std::string hexStr) {
-    std::vector<uint8_t> bytes;
+/**
+ * Maps each char to its hex digit value, or -1 for anything that isn't a hex digit.
+ */
+struct HexCharTable {
+    HexCharTable() {
+        for (int c = 0; c < 256; ++c) {
+            values[c] = (int8_t)hexCharToInt((char)c);
+        }
+    }
 
-    uint8_t curValue = 0;
-    bool firstDigitFilled = false;
-    for (auto c : hexStr) {
-        int charValue = hexCharToInt(c);
+    int8_t values[256];
+};
 
-        if (charValue != -1) {
-            if (!firstDigitFilled) {
-                curValue = 16 * charValue;
+size_t hexToBytes(const char* hex, size_t hexLen, uint8_t* outBuf, size_t outLen) {
+    static const HexCharTable table;
 
-                firstDigitFilled = true;
-            } else {
-                bytes.push_back(curValue + charValue);
+    size_t numBytes = 0;
+    int firstDigit = -1;
+    for (size_t i = 0; i < hexLen && numBytes < outLen; ++i) {
+        int charValue = table.values[(uint8_t)hex[i]];
+
+        // Skip anything that isn't a digit (such as the spaces from strHex)
+        if (charValue == -1) {
+            continue;
+        }
 
-                firstDigitFilled = false;
-                curValue = 0;
-            }
+        if (firstDigit == -1) {
+            firstDigit = charValue;
+        } else {
+            outBuf[numBytes++] = (uint8_t)(firstDigit * 16 + charValue);
+            firstDigit = -1;
         }
     }
 
+    return numBytes;
+}
+
+std::vector<uint8_t> hexToBytes(std::string hexStr) {
+    // Sized for the worst case up front, then trimmed
+    std::vector<uint8_t> bytes(hexStr.size() / 2);
+    bytes.resize(hexToBytes(hexStr.data(), hexStr.size(), bytes.data(), bytes.size()));
+
     return bytes;
 }
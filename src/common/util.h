@@ -13,3 +13,9 @@ std::size_t getTimeNanoseconds();
 void utilSleep(size_t ms);
 
 std::vector<uint8_t> hexToBytes(std::string hexStr);
+
+/**
+ * Parses hex digits into outBuf, skipping anything that isn't a hex digit.
+ * @return The number of bytes written, which stops at outLen.
+ */
+size_t hexToBytes(const char* hex, size_t hexLen, uint8_t* outBuf, size_t outLen);
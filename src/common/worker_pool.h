@@ -0,0 +1,36 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * A fixed set of threads running posted tasks in FIFO order.
+ * Used to keep expensive work (such as handshake crypto) off of the network threads.
+ */
+class WorkerPool {
+public:
+    WorkerPool(size_t numThreads);
+
+    ~WorkerPool();
+
+    /**
+     * Queues a task to run on one of the worker threads.
+     */
+    void post(std::function<void()> task);
+
+private:
+    /**
+     * Runs tasks until the pool is destroyed.
+     */
+    void work();
+
+    std::mutex mutex;
+    std::condition_variable taskAvailable;
+    std::deque<std::function<void()>> tasks;
+    std::vector<std::thread> threads;
+    bool stopping;
+};
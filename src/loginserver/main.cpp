@@ -1,7 +1,26 @@
+#include <cstdio>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
 #include "server.h"
+#include "common/log.h"
+#include "common/log_sink.h"
+#include "common/sharded_server.h"
 #include "common/util.h"
 #include "common/packet/pkt_test.h"
 #include "common/bitstream_test.h"
+#include "common/log_test.h"
+#include "common/opcode_table_test.h"
+#include "common/packet_buffer_test.h"
+#include "common/packet_cache_test.h"
+#include "common/packet_coalescer_test.h"
+#include "common/reliable_channel_test.h"
+#include "common/sequence_window_test.h"
+#include "common/server_test.h"
+#include "common/session_table_test.h"
+#include "common/split_packet_test.h"
+#include "common/crypto/crypto_test.h"
 
 int main(int argc, char* argv[]) {
     /*if (argc != 2) {
@@ -12,25 +31,80 @@ int main(int argc, char* argv[]) {
     testPacketCodingControl();
     testPacketCodingCrypto();
     testPacketCodingGame();
+    testPacketSchema();
     testBitstream();
+    testSessionTable();
+    testCrypto();
+    testLog();
+    testOpcodeTable();
+    testPacketBufferPool();
+    testReliableChannel();
+    testSequenceWindow();
+    testPacketCoalescer();
+    testSplitPacket();
+    testPacketCache();
+    testServer();
 
-    // Just creating both servers in one process for now...
-    const char* port = "51000";//argv[1]
-    Server loginServer(std::atoi(port), serverRecvHandler);
+    if (argc > 1 && std::string(argv[1]) == "--bench") {
+        benchBitstream();
+        benchPacketCoding();
+        benchSessionTable();
+        benchCrypto();
+        benchLog();
+        benchOpcodeTable();
+        benchPacketBufferPool();
+        benchReliableChannel();
+        benchSequenceWindow();
+        benchPacketCoalescer();
+        benchSplitPacket();
+        benchPacketCache();
+        benchServer();
+        return 0;
+    }
 
-    port = "51001";
-    Server worldServer(std::atoi(port), serverRecvHandler);
+    std::unique_ptr<LogSink> logFileSink;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
 
-    while (true) {
-        loginServer.poll();
-        utilSleep(50);
+        // Per-packet logging is off by default, since it costs more than handling the packets
+        if (arg == "--verbose") {
+            setLogLevel(LL_Trace);
+        }
 
-        worldServer.poll();
-        utilSleep(50);
+        // Log from a background thread, rather than blocking the network threads on the terminal
+        if (arg == "--log-file" && i + 1 < argc) {
+            FILE* logFile = fopen(argv[++i], "a");
+            if (logFile == nullptr) {
+                std::cerr << "Couldn't open log file " << argv[i] << std::endl;
+                return 1;
+            }
 
-        keepSessionsAlive(worldServer);
+            logFileSink.reset(new LogSink(logFile, 4096));
+            setLogSink(logFileSink.get());
+        }
     }
 
+    // Just creating both servers in one process for now...
+    asio::io_service ioService;
+
+    const char* port = "51000";//argv[1]
+    Server loginServer(ioService, std::atoi(port), loginRecvHandler, serverAdmitHandler);
+    loginServer.setFlushHandler(flushOutbound);
+    loginServer.repeat(60000, logPacketCounts);
+
+    // The world server carries most of the traffic, so spread its clients across all cores
+    port = "51001";
+    ServerConfig worldConfig;
+    worldConfig.batchSize = 64;
+    ShardedServer worldServer(std::atoi(port), worldRecvHandler, serverAdmitHandler, std::thread::hardware_concurrency(), worldConfig);
+    worldServer.setFlushHandler(flushOutbound);
+    worldServer.repeat(100, keepSessionsAlive);
+    worldServer.repeat(50, retransmitReliable);
+    worldServer.start();
+
+    // Blocks, waking only when a socket has data or a timer expires
+    ioService.run();
+
     return 0;
 }
 
@@ -1,502 +1,930 @@
-#include <iostream>
 #include <memory>
+#include <thread>
 #include <vector>
 #include "common/enums.h"
+#include "common/dh_key_pool.h"
 #include "common/log.h"
+#include "common/opcode_table.h"
+#include "common/packet_cache.h"
 #include "common/server.h"
 #include "common/session.h"
 #include "common/util.h"
+#include "common/worker_pool.h"
 #include "common/crypto/crypto.h"
 #include "common/crypto/md5mac.h"
 #include "common/packet/pkt_all.h"
 
 // TODO: A bunch of this (mainly sending funcs and crypto/control packet handling) should be moved into common so it can be shared
 
-uint16_t curSeqNum;
-std::vector<uint8_t> sendBuf;
+typedef void(*PacketHandler)(Server& server, BitStream& bitStream, Session& session, uint8_t opcode);
+typedef OpcodeTable<PacketHandler> PacketTable;
 
-void handlePacket(Server& server, BitStream& bitStream, std::shared_ptr<Session> session);
-void handleNormalPacket(Server& server, BitStream& bitStream, std::shared_ptr<Session> session);
+/**
+ * The packets one kind of server answers. Both roles share the control handlers, and differ in their game handlers.
+ */
+class ServerRole {
+public:
+    ServerRole(const char* name, void(*registerGameHandlers)(PacketTable&));
 
-void encodeHeaderCrypto(BitStream& bitStream) {
+    const char* name;
+    PacketTable controlTable;
+    PacketTable gameTable;
+};
+
+// The role of the server whose packet this thread is handling, set by its recv handler
+thread_local ServerRole* curRole;
+
+void handlePacket(Server& server, BitStream& bitStream, Session& session);
+void handleNormalPacket(Server& server, BitStream& bitStream, Session& session);
+
+/**
+ * Encodes the header of a crypto packet with the session's next sequence number,
+ * first sizing the buffer for the whole packet so the payload fields don't grow it one by one.
+ */
+void encodeHeaderCrypto(BitStream& bitStream, size_t payloadBits, Session& session) {
     PacketHeader header;
     header.packetType = PT_Crypto;
     header.unused = false;
     header.secured = false;
     header.advanced = true;
     header.lenSpecified = false;
-    header.seqNum = 0;
+    header.seqNum = session.nextSendSeq++;
 
+    bitStream.reserve(header.maxEncodedBits() + payloadBits);
     header.encode(bitStream);
 }
 
-void encodeHeaderEncrypted(BitStream& bitStream) {
+/**
+ * Encodes the header of an encrypted packet plus its padding byte, numbering and reserving room as encodeHeaderCrypto does.
+ */
+void encodeHeaderEncrypted(BitStream& bitStream, size_t payloadBits, Session& session) {
     PacketHeader header;
     header.packetType = PT_Normal;
     header.unused = false;
     header.secured = true;
     header.advanced = true;
     header.lenSpecified = false;
-    header.seqNum = 0;
-
-    header.encode(bitStream);
+    header.seqNum = session.nextSendSeq++;
 
     uint8_t paddingForEncryptAlign = 0x00;
+    bitStream.reserve(header.maxEncodedBits() + BitStream::maxEncodedBits(paddingForEncryptAlign) + payloadBits);
+    header.encode(bitStream);
     bitStream.write(paddingForEncryptAlign);
 }
 
-void encryptAndSend(Server& server, std::vector<uint8_t>& data, std::shared_ptr<Session> session) {
-    // TODO: Need better flow for constructing encrypted packets to prevent copies: allow encryption to be applied
-    // to a subset of a buffer so that the header can be written first, yet only packet content gets encrypted
-    std::cout << "Sending encrypted (minus header+MAC+padding):" << strHex(data) << std::endl;
+/**
+ * Starts encoding into a fresh pooled buffer.
+ */
+BitStream makeSendStream(PacketBuffer& buf) {
+    return BitStream(buf.getData(), PacketBuffer::CAPACITY);
+}
 
-    if (!session->encryptPacket(data)) {
-        return;
+/**
+ * Sets the buffer's size to what was encoded into it.
+ * @return Whether the packet fit in the buffer
+ */
+bool finishSendStream(BitStream& sendStream, PacketBuffer& buf) {
+    if (sendStream.getLastError() != BitStream::Error::NONE) {
+        LOG(LC_Packet, LL_Warning) << "Packet too big for send buffer! (" << static_cast<int>(sendStream.getLastError()) << ")";
+        return false;
     }
 
-    std::vector<uint8_t> sendBufFinal;
-    BitStream sendStreamFinal(sendBufFinal);
+    // Pooled buffers hold whatever they last sent, so clear the unused bits of a partial last byte
+    size_t extraBits = sendStream.getPos() & 0x7;
+    if (extraBits != 0) {
+        *sendStream.getHeadBytePtr() &= (uint8_t)(0xFF00 >> extraBits);
+    }
 
-    encodeHeaderEncrypted(sendStreamFinal);
-    sendStreamFinal.write(data);
+    buf.setSize(BITS_TO_BYTES(sendStream.getPos()));
+    return true;
+}
 
-    std::cout << "Encrypted:" << strHex(sendBufFinal) << std::endl;
+/**
+ * Encrypts everything in buf after the header in-place, then hands buf over to the server to send.
+ */
+void encryptAndSendBuffer(Server& server, PacketBufferHandle buf, size_t payloadStart, Session& session) {
+    LOG(LC_Packet, LL_Trace) << "Sending encrypted (minus header+MAC+padding):" << hexDump(buf->getData() + payloadStart, buf->getSize() - payloadStart);
 
-    server.send(sendBufFinal, session);
+    if (!session.encryptPacket(*buf, payloadStart)) {
+        return;
+    }
+
+    LOG(LC_Packet, LL_Trace) << "Encrypted:" << hexDump(buf->getData(), buf->getSize());
+
+    server.send(std::move(buf), session);
 }
 
-void handleCryptoPacket(Server& server, BitStream& bitStream, std::shared_ptr<Session> session) {
-    std::cout << "---- CryptoPacket, state: ";
+/**
+ * Encrypts and sends the packets the session has waiting, as one datagram.
+ */
+void flushOutbound(Server& server, Session& session) {
+    if (session.outbound.getNumPackets() == 0) {
+        return;
+    }
 
-    // Note: No opcodes in crypto packets, so the state of the crypto exchange is tracked
-    switch (session->cryptoState) {
-    case Session::CS_Init: {
-        std::cout << "OP_ClientChallengeXchg" << std::endl;
+    PacketBufferHandle buf = PacketBufferPool::acquire();
+    BitStream sendStream = makeSendStream(*buf);
+    encodeHeaderEncrypted(sendStream, session.outbound.getFrameSize() * 8, session);
+    size_t payloadStart = sendStream.getPos() / 8;
+    session.outbound.take(sendStream);
+    if (!finishSendStream(sendStream, *buf)) {
+        return;
+    }
 
-        session->macBuffer.insert(session->macBuffer.end(), bitStream.getHeadIterator(), bitStream.buf.end());
+    encryptAndSendBuffer(server, std::move(buf), payloadStart, session);
+}
 
-        ClientChallengeXchg clientChallengePacket = ClientChallengeXchg::decode(bitStream);
+/**
+ * Queues an encoded packet to be encrypted and sent with the session's others on the next flush.
+ * The pending ones go out first if it doesn't fit alongside them.
+ */
+void queueEncrypted(Server& server, const uint8_t* data, size_t size, Session& session) {
+    if (!session.outbound.fits(size)) {
+        flushOutbound(server, session);
 
-        if (bitStream.getLastError() != BitStream::Error::NONE) {
-            std::cout << "Bitstream error reading packet! (" << static_cast<int>(bitStream.getLastError()) << ")" << std::endl;
+        if (!session.outbound.fits(size)) {
+            LOG(LC_Packet, LL_Warning) << "Packet of " << size << " bytes too big to send!";
             return;
         }
+    }
 
-        CryptoPP::Integer p(clientChallengePacket.p.data(), clientChallengePacket.p.size());
-        CryptoPP::Integer g(clientChallengePacket.g.data(), clientChallengePacket.g.size());
-
-        session->generateCrypto1(clientChallengePacket.clientTime, clientChallengePacket.challenge, p, g);
-
-        ServerChallengeXchg response;
-        response.unk0 = 2;
-        response.unk1 = 1;
-        response.serverTime = session->storedServerTime;
-        response.challenge = session->storedServerChallenge;
-        response.unkChallengeEnd = 0;
-        response.unkObjects = 1;
-        response.unk2 = { 0x03, 0x07, 0x00, 0x00, 0x00, 0x0C, 0x00 };
-        response.pubKeyLen = 16;
-        std::copy(session->serverPubKey.begin(), session->serverPubKey.end(), response.pubKey.begin());
-        response.unk3 = 14;
-
-        sendBuf.clear();
-        BitStream sendStream(sendBuf);
-        encodeHeaderCrypto(sendStream);
-        response.encode(sendStream);
+    session.outbound.add(data, size);
+    server.deferFlush(session);
+}
 
-        // +3 to skip header
-        session->macBuffer.insert(session->macBuffer.end(), sendBuf.begin() + 3, sendBuf.end());
+/**
+ * Encodes a packet, and queues it to be encrypted and sent with the session's others on the next flush.
+ */
+template<typename Packet>
+void encryptAndSend(Server& server, Packet& packet, Session& session) {
+    PacketBufferHandle encodedBuf = PacketBufferPool::acquire();
+    BitStream encodedStream = makeSendStream(*encodedBuf);
+    packet.encode(encodedStream);
+    if (!finishSendStream(encodedStream, *encodedBuf)) {
+        return;
+    }
 
-        std::cout << "Sending crypto:" << strHex(sendBuf) << std::endl;
+    queueEncrypted(server, encodedBuf->getData(), encodedBuf->getSize(), session);
+}
 
-        server.send(sendBuf, session);
+/**
+ * The slot that game packets are sent reliably in. The client acks it with OP_RelatedB0 and nacks it with OP_RelatedA0.
+ */
+const uint8_t RELIABLE_SLOT = 0;
+
+/**
+ * The slot that fragments of split messages are sent in (see SplitPacket).
+ * Its acks also arrive as OP_RelatedB0, so it shares the reliable slot's subslots.
+ */
+const uint8_t SPLIT_SLOT = 4;
+
+// Largest inner packet of a slotted packet, so that it still fits in a multi packet alongside its slotted header and size
+const size_t MAX_SLOTTED_PAYLOAD = PacketCoalescer::MAX_FRAME_SIZE - 2 - 3 - 4;
+
+/**
+ * Sends whatever the session's reliable channel has due, closing the session if the client stopped acking.
+ */
+void pollReliable(Server& server, Session& session) {
+    bool keepGoing = session.reliable.poll(getTimeMilliseconds(), [&server, &session](uint8_t slot, uint16_t subslot, const PacketBuffer& payload) {
+        SlottedMetaPacket packet;
+        packet.slot = slot;
+        packet.subslot = subslot;
+        packet.rest = payload.getData();
+        packet.restSize = payload.getSize();
+
+        encryptAndSend(server, packet, session);
+    });
+
+    if (!keepGoing) {
+        LOG(LC_Packet, LL_Warning) << "Client " << session.clientEndpoint << " stopped acking slotted packets, closing session";
+        server.closeSession(session);
+    }
+}
 
-        break;
+/**
+ * Queues an encoded packet on the session's reliable channel, split over several slotted packets if it's too big for one.
+ */
+void queueReliable(const uint8_t* data, size_t size, Session& session) {
+    if (size <= MAX_SLOTTED_PAYLOAD) {
+        PacketBufferHandle payload = PacketBufferPool::acquire();
+        memcpy(payload->getData(), data, size);
+        payload->setSize(size);
+        session.reliable.queue(std::move(payload), RELIABLE_SLOT);
+        return;
     }
-    case Session::CS_Challenge: {
-        std::cout << "OP_ClientFinished" << std::endl;
 
-        session->macBuffer.insert(session->macBuffer.end(), bitStream.getHeadIterator(), bitStream.buf.end());
+    bool split = SplitPacket::split(data, size, MAX_SLOTTED_PAYLOAD, [&session](PacketBufferHandle fragment) {
+        session.reliable.queue(std::move(fragment), SPLIT_SLOT);
+    });
 
-        ClientFinished packet = ClientFinished::decode(bitStream);
+    if (!split) {
+        LOG(LC_Packet, LL_Warning) << "Packet of " << size << " bytes too big to split!";
+    }
+}
 
-        if (bitStream.getLastError() != BitStream::Error::NONE) {
-            std::cout << "Bitstream error reading packet! (" << static_cast<int>(bitStream.getLastError()) << ")" << std::endl;
+/**
+ * Encodes a packet on its own, and sends it in a slotted packet that is resent until the client acks it.
+ * Packets too big for one slotted packet are split.
+ */
+template<typename Packet>
+void sendReliable(Server& server, Packet& packet, Session& session) {
+    if (BITS_TO_BYTES(packet.maxEncodedBits()) <= MAX_SLOTTED_PAYLOAD) {
+        PacketBufferHandle payload = PacketBufferPool::acquire();
+        BitStream payloadStream = makeSendStream(*payload);
+        packet.encode(payloadStream);
+        if (!finishSendStream(payloadStream, *payload)) {
             return;
         }
 
-        session->generateCrypto2(packet.pubKey, packet.challengeResult);
-
-        ServerFinished response;
-        response.unk0 = 0x1401;
-        std::copy(session->serverChallengeResult.begin(), session->serverChallengeResult.end(), response.challengeResult.begin());
+        session.reliable.queue(std::move(payload), RELIABLE_SLOT);
+    } else {
+        std::vector<uint8_t> encoded;
+        BitStream encodedStream(encoded);
+        encodedStream.reserve(packet.maxEncodedBits());
+        packet.encode(encodedStream);
+        encodedStream.trimToPos();
 
-        sendBuf.clear();
-        BitStream sendStream(sendBuf);
-        encodeHeaderCrypto(sendStream);
-        response.encode(sendStream);
+        queueReliable(encoded.data(), encoded.size(), session);
+    }
 
-        std::cout << "Sending crypto:" << strHex(sendBuf) << std::endl;
+    pollReliable(server, session);
+}
 
-        server.send(sendBuf, session);
+/**
+ * Sends an already encoded packet reliably, as sendReliable does.
+ */
+void sendReliableBytes(Server& server, const std::vector<uint8_t>& data, Session& session) {
+    queueReliable(data.data(), data.size(), session);
+    pollReliable(server, session);
+}
 
-        break;
-    }
-    default: {
-        std::cout << "Unknown " << session->cryptoState << std::endl;
-        break;
-    }
+/**
+ * Queues a cached packet to be encrypted and sent, as encryptAndSend does but without encoding it again.
+ * Does nothing if the packet failed to encode.
+ */
+void encryptAndSendCached(Server& server, const PacketCache::EntryHandle& entry, Session& session) {
+    if (!entry) {
+        LOG(LC_Packet, LL_Warning) << "Cached packet failed to encode!";
+        return;
     }
-}
 
-void handleControlPacket(Server& server, BitStream& bitStream, std::shared_ptr<Session> session) {
-    // Skip over the first byte - always zero in control packets
-    bitStream.deltaPos(8 * sizeof(uint8_t));
+    queueEncrypted(server, entry->data.data(), entry->data.size(), session);
+}
 
-    uint8_t opcode;
-    bitStream.read(opcode);
+/**
+ * Sends a cached packet reliably, as sendReliable does but without encoding it again.
+ * Does nothing if the packet failed to encode.
+ */
+void sendReliableCached(Server& server, const PacketCache::EntryHandle& entry, Session& session) {
+    if (!entry) {
+        LOG(LC_Packet, LL_Warning) << "Cached packet failed to encode!";
+        return;
+    }
 
-    std::cout << "---- ControlPacket, op: " << std::hex << std::uppercase << (unsigned)opcode << std::dec << std::nouppercase << ", type: ";
+    queueReliable(entry->data.data(), entry->data.size(), session);
+    pollReliable(server, session);
+}
 
-    switch (opcode) {
-    case OP_ClientStart: {
-        std::cout << "OP_ClientStart" << std::endl;
+/**
+ * @return The pool that runs handshake math, shared by every server.
+ */
+WorkerPool& getCryptoWorkers() {
+    static WorkerPool cryptoWorkers(std::thread::hardware_concurrency());
+    return cryptoWorkers;
+}
 
-        ClientStart packet = ClientStart::decode(bitStream);
+/**
+ * @return The pool of ready key pairs for handshakes, shared by every server.
+ */
+DHKeyPool& getDHKeyPool() {
+    // The group every stock client sends in ClientChallengeXchg. Odd clients with any other group generate their own keys
+    static const uint8_t stockP[] = { 0xF5, 0x75, 0x11, 0xEB, 0x8E, 0x5D, 0x1E, 0xFB, 0x8B, 0x7F, 0x32, 0x87, 0xD5, 0xA1, 0x8B, 0x17 };
+    static const uint8_t stockG[] = { 0x02 };
+    static DHKeyPool dhKeyPool(CryptoPP::Integer(stockP, sizeof(stockP)), CryptoPP::Integer(stockG, sizeof(stockG)), 1024);
+    return dhKeyPool;
+}
 
-        if (bitStream.getLastError() != BitStream::Error::NONE) {
-            std::cout << "Bitstream error reading packet! (" << static_cast<int>(bitStream.getLastError()) << ")" << std::endl;
-            return;
-        }
+void sendServerChallengeXchg(Server& server, Session& session) {
+    ServerChallengeXchg response;
+    response.unk0 = 2;
+    response.unk1 = 1;
+    response.serverTime = session.storedServerTime;
+    response.challenge = session.storedServerChallenge;
+    response.unkChallengeEnd = 0;
+    response.unkObjects = 1;
+    response.unk2 = { 0x03, 0x07, 0x00, 0x00, 0x00, 0x0C, 0x00 };
+    response.pubKeyLen = 16;
+    std::copy(session.serverPubKey.begin(), session.serverPubKey.end(), response.pubKey.begin());
+    response.unk3 = 14;
+
+    PacketBufferHandle buf = PacketBufferPool::acquire();
+    BitStream sendStream = makeSendStream(*buf);
+    encodeHeaderCrypto(sendStream, response.maxEncodedBits(), session);
+    response.encode(sendStream);
+    if (!finishSendStream(sendStream, *buf)) {
+        return;
+    }
 
-        ServerStart response;
-        response.clientNonce = packet.clientNonce;
-        response.serverNonce = randomUnsignedInt();
-        response.unk0 = { 0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0xD3, 0x00, 0x00, 0x00, 0x02 };
+    // +3 to skip header
+    session.macBuffer.insert(session.macBuffer.end(), buf->getData() + 3, buf->getData() + buf->getSize());
 
-        sendBuf.clear();
-        BitStream sendStream(sendBuf);
-        response.encode(sendStream);
+    LOG(LC_Packet, LL_Trace) << "Sending crypto:" << hexDump(buf->getData(), buf->getSize());
 
-        // This is a control packet, but no crypto established yet so send without header/crypto
-        std::cout << "Sending raw:" << strHex(sendBuf) << std::endl;
+    server.send(std::move(buf), session);
+}
 
-        server.send(sendBuf, session);
+void sendServerFinished(Server& server, Session& session) {
+    ServerFinished response;
+    response.unk0 = 0x1401;
+    std::copy(session.serverChallengeResult.begin(), session.serverChallengeResult.end(), response.challengeResult.begin());
 
-        break;
+    PacketBufferHandle buf = PacketBufferPool::acquire();
+    BitStream sendStream = makeSendStream(*buf);
+    encodeHeaderCrypto(sendStream, response.maxEncodedBits(), session);
+    response.encode(sendStream);
+    if (!finishSendStream(sendStream, *buf)) {
+        return;
     }
-    case OP_ControlSync: {
-        std::cout << "OP_ControlSync" << std::endl;
 
-        ControlSync packet = ControlSync::decode(bitStream);
+    LOG(LC_Packet, LL_Trace) << "Sending crypto:" << hexDump(buf->getData(), buf->getSize());
 
-        if (bitStream.getLastError() != BitStream::Error::NONE) {
-            std::cout << "Bitstream error reading packet! (" << static_cast<int>(bitStream.getLastError()) << ")" << std::endl;
-            return;
-        }
-
-        ControlSyncResp response;
-        response.timeDiff = packet.timeDiff;
-        response.serverTick = getTimeNanoseconds();
-        response.field1 = packet.field64A;
-        response.field2 = packet.field64B;
-        response.field3 = packet.field64B;
-        response.field4 = packet.field64A;
-
-        sendBuf.clear();
-        BitStream sendStream(sendBuf);
-        response.encode(sendStream);
+    server.send(std::move(buf), session);
+}
 
-        encryptAndSend(server, sendBuf, session);
+void handleCryptoPacket(Server& server, BitStream& bitStream, Session& session) {
+    // Note: No opcodes in crypto packets, so the state of the crypto exchange is tracked
+    switch (session.cryptoState) {
+    case Session::CS_Init: {
+        LOG(LC_Packet, LL_Debug) << "---- CryptoPacket: OP_ClientChallengeXchg";
 
-        break;
-    }
-    case OP_SlottedMetaPacket0:
-    case OP_SlottedMetaPacket1:
-    case OP_SlottedMetaPacket2:
-    case OP_SlottedMetaPacket3:
-    case OP_SlottedMetaPacket4:
-    case OP_SlottedMetaPacket5:
-    case OP_SlottedMetaPacket6:
-    case OP_SlottedMetaPacket7: {
-        std::cout << "OP_SlottedMetaPacket" << std::endl;
+        session.macBuffer.insert(session.macBuffer.end(), bitStream.getHeadBytePtr(), bitStream.getEndBytePtr());
 
-        SlottedMetaPacket packet = SlottedMetaPacket::decode(bitStream, opcode - OP_SlottedMetaPacket0);
+        ClientChallengeXchg clientChallengePacket = ClientChallengeXchg::decode(bitStream);
 
         if (bitStream.getLastError() != BitStream::Error::NONE) {
-            std::cout << "Bitstream error reading packet! (" << static_cast<int>(bitStream.getLastError()) << ")" << std::endl;
+            LOG(LC_Packet, LL_Warning) << "Bitstream error reading packet! (" << static_cast<int>(bitStream.getLastError()) << ")";
             return;
         }
 
-        // TODO: This needs to actually follow the slotting mechanism, and not just immediately process the inner packet
+        CryptoPP::Integer p(clientChallengePacket.p.data(), clientChallengePacket.p.size());
+        CryptoPP::Integer g(clientChallengePacket.g.data(), clientChallengePacket.g.size());
 
-        // Send ack
-        SlottedMetaAck response;
-        response.slot = packet.slot;
-        response.subslot = packet.subslot;
+        // Use a pre-generated key pair if there's one ready for this group
+        std::vector<uint8_t> privKey;
+        std::vector<uint8_t> pubKey;
+        if (getDHKeyPool().take(p, g, privKey, pubKey)) {
+            session.generateCrypto1(clientChallengePacket.clientTime, clientChallengePacket.challenge, p, g, privKey, pubKey);
+            sendServerChallengeXchg(server, session);
+            break;
+        }
 
-        sendBuf.clear();
-        BitStream sendStream(sendBuf);
-        response.encode(sendStream);
+        // Otherwise generating the key pair is slow, so do it on a worker and reply once it's done
+        session.cryptoState = Session::CS_Pending;
 
-        encryptAndSend(server, sendBuf, session);
+        Server* serverPtr = &server;
+        SessionHandle handle = session.handle;
+        getCryptoWorkers().post([serverPtr, handle, clientChallengePacket, p, g]() {
+            std::vector<uint8_t> privKey;
+            std::vector<uint8_t> pubKey;
+            Session::generateKeyPair(p, g, privKey, pubKey);
 
-        // Handle the inner packet
-        BitStream innerPacketBitStream(packet.rest);
-        handleNormalPacket(server, innerPacketBitStream, session);
+            serverPtr->postToSession(handle, [serverPtr, clientChallengePacket, p, g, privKey, pubKey](Session& session) {
+                session.generateCrypto1(clientChallengePacket.clientTime, clientChallengePacket.challenge, p, g, privKey, pubKey);
+                sendServerChallengeXchg(*serverPtr, session);
+            });
+        });
 
         break;
     }
-    case OP_MultiPacket: {
-        std::cout << "OP_MultiPacket" << std::endl;
+    case Session::CS_Challenge: {
+        LOG(LC_Packet, LL_Debug) << "---- CryptoPacket: OP_ClientFinished";
 
-        // Handle all inner packets
-        uint8_t packetsSize;
-        bitStream.read(packetsSize);
+        session.macBuffer.insert(session.macBuffer.end(), bitStream.getHeadBytePtr(), bitStream.getEndBytePtr());
 
-        size_t packetsBitSize = (size_t)packetsSize * 8;
-        size_t initialPos = bitStream.getPos();
-        while (bitStream.getRemainingBits() > 0 && bitStream.getPos() - initialPos < packetsBitSize) {
-            handlePacket(server, bitStream, session);
+        ClientFinished packet = ClientFinished::decode(bitStream);
+
+        if (bitStream.getLastError() != BitStream::Error::NONE) {
+            LOG(LC_Packet, LL_Warning) << "Bitstream error reading packet! (" << static_cast<int>(bitStream.getLastError()) << ")";
+            return;
         }
 
+        // Key agreement is slow, so do it on a worker and reply once it's done
+        session.cryptoState = Session::CS_Pending;
+
+        Server* serverPtr = &server;
+        SessionHandle handle = session.handle;
+        CryptoPP::Integer p = session.dhP;
+        CryptoPP::Integer g = session.dhG;
+        std::vector<uint8_t> privKey = session.serverPrivKey;
+        getCryptoWorkers().post([serverPtr, handle, packet, p, g, privKey]() {
+            std::vector<uint8_t> agreedValue;
+            bool agreed = Session::agreeKey(p, g, privKey, packet.pubKey, agreedValue);
+
+            serverPtr->postToSession(handle, [serverPtr, packet, agreed, agreedValue](Session& session) {
+                if (!agreed) {
+                    LOG(LC_Packet, LL_Warning) << "Did not agree on crypto keys!";
+                    serverPtr->closeSession(session);
+                    return;
+                }
+
+                session.generateCrypto2(agreedValue, packet.challengeResult);
+                sendServerFinished(*serverPtr, session);
+            });
+        });
+
         break;
     }
-    case OP_ConnectionClose: {
-        std::cout << "OP_ConnectionClose" << std::endl;
-        // TODO: Kill session
+    case Session::CS_Pending: {
+        LOG(LC_Packet, LL_Debug) << "---- CryptoPacket: ignored, handshake in progress";
         break;
     }
     default: {
-        std::cout << "Unknown" << std::endl;
+        LOG(LC_Packet, LL_Warning) << "---- CryptoPacket: unknown state " << session.cryptoState;
         break;
     }
     }
 }
 
-void generateToken(const std::string username, const std::string password, std::array<uint8_t, 16>& token) {
-    token = { 'T', 'H', 'I', 'S', 'I', 'S', 'M', 'Y', 'T', 'O', 'K', 'E', 'N', 'Y', 'E', 'S' };
+/**
+ * Derives the server nonce for a client from a keyed hash of its endpoint and nonce, so that it can be
+ * sent without storing anything, and is the same for retransmitted ClientStarts.
+ */
+uint32_t generateServerNonce(const udp::endpoint& endpoint, uint32_t clientNonce) {
+    static const std::vector<uint8_t> nonceKey = []() {
+        std::vector<uint8_t> key(16);
+        for (auto& keyByte : key) {
+            keyByte = randomUnsignedChar();
+        }
+        return key;
+    }();
+
+    std::array<uint8_t, 10> nonceInput;
+    uint32_t addr = endpoint.address().to_v4().to_ulong();
+    uint16_t port = endpoint.port();
+    memcpy(nonceInput.data(), &addr, sizeof(addr));
+    memcpy(nonceInput.data() + 4, &port, sizeof(port));
+    memcpy(nonceInput.data() + 6, &clientNonce, sizeof(clientNonce));
+
+    uint32_t serverNonce;
+    calcMD5MAC(nonceKey, nonceInput.data(), nonceInput.size(), (uint8_t*)&serverNonce, sizeof(serverNonce));
+    return serverNonce;
 }
 
-void handleGamePacketLogin(Server& server, BitStream& bitStream, std::shared_ptr<Session> session) {
-    uint8_t opcode;
-    bitStream.read(opcode);
+void handleClientStart(Server& server, BitStream& bitStream, const udp::endpoint& endpoint) {
+    ClientStart packet = ClientStart::decode(bitStream);
 
-    std::cout << "---- GamePacket, op: " << std::hex << std::uppercase << (unsigned)opcode << std::dec << std::nouppercase << ", type: ";
+    if (bitStream.getLastError() != BitStream::Error::NONE) {
+        LOG(LC_Packet, LL_Warning) << "Bitstream error reading packet! (" << static_cast<int>(bitStream.getLastError()) << ")";
+        return;
+    }
 
-    switch (opcode) {
-    case OP_LoginMessage: {
-        std::cout << "OP_LoginMessage" << std::endl;
+    ServerStart response;
+    response.clientNonce = packet.clientNonce;
+    response.serverNonce = generateServerNonce(endpoint, packet.clientNonce);
+    response.unk0 = { 0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0xD3, 0x00, 0x00, 0x00, 0x02 };
 
-        LoginMessage packet = LoginMessage::decode(bitStream);
+    PacketBufferHandle buf = PacketBufferPool::acquire();
+    BitStream sendStream = makeSendStream(*buf);
+    response.encode(sendStream);
+    if (!finishSendStream(sendStream, *buf)) {
+        return;
+    }
 
-        if (bitStream.getLastError() != BitStream::Error::NONE) {
-            std::cout << "Bitstream error reading packet! (" << static_cast<int>(bitStream.getLastError()) << ")" << std::endl;
-            return;
-        }
+    // This is a control packet, but no crypto established yet so send without header/crypto
+    LOG(LC_Packet, LL_Trace) << "Sending raw:" << hexDump(buf->getData(), buf->getSize());
 
-        std::cout << "Connecting user with v" << packet.majorVersion << "." << packet.minorVersion << " built on " << packet.buildDate << " revision " << packet.revision << std::endl;
-        std::cout << "Username: " << packet.username << ", Password: " << packet.password << " built on " << packet.buildDate << std::endl;
+    server.sendTo(std::move(buf), endpoint);
+}
 
-        LoginRespMessage response;
-        generateToken(packet.username, packet.password, response.token);
-        response.unk0 = { 0x00, 0x00, 0x00, 0x00, 0x18, 0xFA, 0xBE, 0x0C, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 };
-        response.error = 0;
-        response.stationError = 1;
-        response.subscriptionStatus = 2;
-        response.unk1 = 685276011;
-        response.username = packet.username;
-        response.privilege = 10001;
+void handleClientStartPacket(Server& server, BitStream& bitStream, Session& session, uint8_t opcode) {
+    handleClientStart(server, bitStream, session.clientEndpoint);
+}
 
-        sendBuf.clear();
-        BitStream sendStream(sendBuf);
-        response.encode(sendStream);
+void handleControlSync(Server& server, BitStream& bitStream, Session& session, uint8_t opcode) {
+    ControlSync packet = ControlSync::decode(bitStream);
 
-        encryptAndSend(server, sendBuf, session);
+    if (bitStream.getLastError() != BitStream::Error::NONE) {
+        LOG(LC_Packet, LL_Warning) << "Bitstream error reading packet! (" << static_cast<int>(bitStream.getLastError()) << ")";
+        return;
+    }
 
-        // TODO: Add delay before sending world status packet?
-        VNLWorldStatusMessage::WorldInfo world1;
-        world1.name = "hello_c++";
-        world1.status2 = VNLWorldStatusMessage::WS_Up;
-        world1.serverType = VNLWorldStatusMessage::ST_Released;
-        world1.status1 = VNLWorldStatusMessage::WS_Up;
-        world1.empireNeed = EM_NC;
+    ControlSyncResp response;
+    response.timeDiff = packet.timeDiff;
+    response.serverTick = getTimeNanoseconds();
+    response.field1 = packet.field64A;
+    response.field2 = packet.field64B;
+    response.field3 = packet.field64B;
+    response.field4 = packet.field64A;
 
-        VNLWorldStatusMessage response2;
-        response2.welcomeMessage = L"ASDF";
-        response2.worlds.push_back(world1);
+    encryptAndSend(server, response, session);
+}
 
-        sendBuf.clear();
-        BitStream sendStream2(sendBuf);
-        response2.encode(sendStream2);
+/**
+ * Handles whichever split messages from the client are now complete.
+ */
+void handleSplitPackets(Server& server, Session& session) {
+    std::vector<uint8_t> message;
+    while (session.splitPackets.take(message)) {
+        BitStream messageBitStream(message);
+        handleNormalPacket(server, messageBitStream, session);
+    }
+}
 
-        encryptAndSend(server, sendBuf, session);
+void handleSlottedMetaPacket(Server& server, BitStream& bitStream, Session& session, uint8_t opcode) {
+    SlottedMetaPacket packet = SlottedMetaPacket::decode(bitStream, opcode - OP_SlottedMetaPacket0);
 
-        break;
+    if (bitStream.getLastError() != BitStream::Error::NONE) {
+        LOG(LC_Packet, LL_Warning) << "Bitstream error reading packet! (" << static_cast<int>(bitStream.getLastError()) << ")";
+        return;
     }
-    case OP_ConnectToWorldRequestMessage: {
-        std::cout << "OP_ConnectToWorldRequestMessage" << std::endl;
 
-        ConnectToWorldRequestMessage packet = ConnectToWorldRequestMessage::decode(bitStream);
+    bool isReliable = packet.slot == RELIABLE_SLOT || packet.slot == SPLIT_SLOT;
+    if (isReliable && session.reliable.isNew(packet.subslot) && !session.splitPackets.canAdd(packet.subslot)) {
+        // Too far ahead of a missing subslot to hold in order yet, so leave it unacked for the client to resend later
+        LOG(LC_Packet, LL_Debug) << "Leaving slotted packet " << packet.subslot << " unacked until earlier ones arrive";
+        return;
+    }
 
-        if (bitStream.getLastError() != BitStream::Error::NONE) {
-            std::cout << "Bitstream error reading packet! (" << static_cast<int>(bitStream.getLastError()) << ")" << std::endl;
-            return;
-        }
+    // Always ack, even duplicates, since the client resends when an earlier ack was lost
+    SlottedMetaAck response;
+    response.slot = packet.slot;
+    response.subslot = packet.subslot;
 
-        ConnectToWorldMessage response;
-        response.serverName = "psemu";
-        response.serverAddress = "127.0.0.1";
-        response.serverPort = 51001;
+    encryptAndSend(server, response, session);
 
-        sendBuf.clear();
-        BitStream sendStream(sendBuf);
-        response.encode(sendStream);
+    if (isReliable && !session.reliable.receive(packet.subslot)) {
+        LOG(LC_Packet, LL_Debug) << "Dropping duplicate slotted packet " << packet.subslot;
+        return;
+    }
 
-        encryptAndSend(server, sendBuf, session);
+    if (packet.slot == SPLIT_SLOT) {
+        // Handled once all of the message's fragments are in
+        session.splitPackets.add(packet.subslot, packet.rest, packet.restSize);
+        handleSplitPackets(server, session);
+        return;
+    }
 
-        break;
+    if (isReliable) {
+        // Fragments are told apart by subslot order, so the reassembler needs to see every reliable subslot
+        session.splitPackets.addOther(packet.subslot);
+        handleSplitPackets(server, session);
     }
-    default: {
-        std::cout << "Unknown" << std::endl;
-        break;
+
+    // Handle the inner packet, which is the end of the datagram, through a view of the datagram's own stream
+    BitStream innerPacketBitStream(bitStream.getData() + bitStream.getPos() / 8 - packet.restSize, packet.restSize);
+    handleNormalPacket(server, innerPacketBitStream, session);
+}
+
+void handleMultiPacket(Server& server, BitStream& bitStream, Session& session, uint8_t opcode) {
+    // Handle all inner packets
+    uint8_t packetsSize;
+    bitStream.read(packetsSize);
+
+    size_t packetsBitSize = (size_t)packetsSize * 8;
+    size_t initialPos = bitStream.getPos();
+    while (bitStream.getRemainingBits() > 0 && bitStream.getPos() - initialPos < packetsBitSize) {
+        handlePacket(server, bitStream, session);
+    }
+}
+
+void handleMultiPacketEx(Server& server, BitStream& bitStream, Session& session, uint8_t opcode) {
+    MultiPacketEx packet = MultiPacketEx::decode(bitStream);
+
+    if (bitStream.getLastError() != BitStream::Error::NONE) {
+        LOG(LC_Packet, LL_Warning) << "Bitstream error reading packet! (" << static_cast<int>(bitStream.getLastError()) << ")";
+        return;
     }
+
+    for (auto& innerPacket : packet.packets) {
+        BitStream innerPacketBitStream(innerPacket.data, innerPacket.size);
+        handleNormalPacket(server, innerPacketBitStream, session);
     }
 }
 
-std::vector<uint8_t> objectHex = { 0x18, 0x57, 0x0C, 0x00, 0x00, 0xBC, 0x84, 0xB0, 0x06, 0xC2, 0xD7, 0x65, 0x53, 0x5C, 0xA1, 0x60, 0x00, 0x01, 0x34, 0x40, 0x00, 0x09, 0x70, 0x49, 0x00, 0x6C, 0x00, 0x6C, 0x00, 0x6C, 0x00, 0x49, 0x00, 0x49, 0x00, 0x49, 0x00, 0x6C, 0x00, 0x6C, 0x00, 0x6C, 0x00, 0x49, 0x00, 0x6C, 0x00, 0x49, 0x00, 0x6C, 0x00, 0x6C, 0x00, 0x49, 0x00, 0x6C, 0x00, 0x6C, 0x00, 0x6C, 0x00, 0x49, 0x00, 0x6C, 0x00, 0x6C, 0x00, 0x49, 0x00, 0x84, 0x52, 0x70, 0x76, 0x1E, 0x80, 0x80, 0x00, 0x00, 0x00, 0x00, 0x00, 0x3F, 0xFF, 0xC0, 0x00, 0x00, 0x00, 0x20, 0x00, 0x00, 0x0F, 0xF6, 0xA7, 0x03, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFD, 0x90, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x90, 0x01, 0x90, 0x00, 0x64, 0x00, 0x00, 0x01, 0x00, 0x7E, 0xC8, 0x00, 0xC8, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0xC0, 0x00, 0x42, 0xC5, 0x46, 0x86, 0xC7, 0x00, 0x00, 0x00, 0x80, 0x00, 0x00, 0x12, 0x40, 0x78, 0x70, 0x65, 0x5F, 0x73, 0x61, 0x6E, 0x63, 0x74, 0x75, 0x61, 0x72, 0x79, 0x5F, 0x68, 0x65, 0x6C, 0x70, 0x90, 0x78, 0x70, 0x65, 0x5F, 0x74, 0x68, 0x5F, 0x66, 0x69, 0x72, 0x65, 0x6D, 0x6F, 0x64, 0x65, 0x73, 0x8B, 0x75, 0x73, 0x65, 0x64, 0x5F, 0x62, 0x65, 0x61, 0x6D, 0x65, 0x72, 0x85, 0x6D, 0x61, 0x70, 0x31, 0x33, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x0A, 0x23, 0x02, 0x60, 0x04, 0x04, 0x40, 0x00, 0x00, 0x10, 0x00, 0x06, 0x02, 0x08, 0x14, 0xD0, 0x08, 0x0C, 0x80, 0x00, 0x02, 0x00, 0x02, 0x6B, 0x4E, 0x00, 0x82, 0x88, 0x00, 0x00, 0x02, 0x00, 0x00, 0xC0, 0x41, 0xC0, 0x9E, 0x01, 0x01, 0x90, 0x00, 0x00, 0x64, 0x00, 0x44, 0x2A, 0x00, 0x10, 0x91, 0x00, 0x00, 0x00, 0x40, 0x00, 0x18, 0x08, 0x38, 0x94, 0x40, 0x20, 0x32, 0x00, 0x00, 0x00, 0x80, 0x19, 0x05, 0x48, 0x02, 0x17, 0x20, 0x00, 0x00, 0x08, 0x00, 0x70, 0x29, 0x80, 0x43, 0x64, 0x00, 0x00, 0x32, 0x00, 0x0E, 0x05, 0x40, 0x08, 0x9C, 0x80, 0x00, 0x06, 0x40, 0x01, 0xC0, 0xAA, 0x01, 0x19, 0x90, 0x00, 0x00, 0xC8, 0x00, 0x3A, 0x15, 0x80, 0x28, 0x72, 0x00, 0x00, 0x19, 0x00, 0x04, 0x0A, 0xB8, 0x05, 0x26, 0x40, 0x00, 0x03, 0x20, 0x06, 0xC2, 0x58, 0x00, 0xA7, 0x88, 0x00, 0x00, 0x02, 0x00, 0x00, 0x80, 0x00, 0x00 };
+void handleSlottedMetaAck(Server& server, BitStream& bitStream, Session& session, uint8_t opcode) {
+    SlottedMetaAck packet = SlottedMetaAck::decode(bitStream, opcode - OP_RelatedB0);
 
-void handleGamePacketWorld(Server& server, BitStream& bitStream, std::shared_ptr<Session> session) {
-    uint8_t opcode;
-    bitStream.read(opcode);
+    if (bitStream.getLastError() != BitStream::Error::NONE) {
+        LOG(LC_Packet, LL_Warning) << "Bitstream error reading packet! (" << static_cast<int>(bitStream.getLastError()) << ")";
+        return;
+    }
 
-    std::cout << "---- GamePacket, op: " << std::hex << std::uppercase << (unsigned)opcode << std::dec << std::nouppercase << ", type: ";
+    if (packet.slot != RELIABLE_SLOT) {
+        return;
+    }
 
-    switch (opcode) {
-    case OP_KeepAliveMessage: {
-        std::cout << "OP_KeepAliveMessage" << std::endl;
+    // The ack may have made room in the send window
+    session.reliable.ack(packet.subslot, getTimeMilliseconds());
+    pollReliable(server, session);
+}
 
-        KeepAliveMessage packet = KeepAliveMessage::decode(bitStream);
+void handleSlottedMetaNack(Server& server, BitStream& bitStream, Session& session, uint8_t opcode) {
+    SlottedMetaNack packet = SlottedMetaNack::decode(bitStream, opcode - OP_RelatedA0);
 
-        if (bitStream.getLastError() != BitStream::Error::NONE) {
-            std::cout << "Bitstream error reading packet! (" << static_cast<int>(bitStream.getLastError()) << ")" << std::endl;
-            return;
-        }
+    if (bitStream.getLastError() != BitStream::Error::NONE) {
+        LOG(LC_Packet, LL_Warning) << "Bitstream error reading packet! (" << static_cast<int>(bitStream.getLastError()) << ")";
+        return;
+    }
 
-        KeepAliveMessage response;
-        response.keepAliveCode = packet.keepAliveCode;
+    if (packet.slot != RELIABLE_SLOT) {
+        return;
+    }
 
-        sendBuf.clear();
-        BitStream sendStream(sendBuf);
-        response.encode(sendStream);
+    session.reliable.nack(packet.subslot);
+    pollReliable(server, session);
+}
 
-        encryptAndSend(server, sendBuf, session);
+/**
+ * Handles both OP_TeardownConnection and OP_ConnectionClose.
+ */
+void handleConnectionClose(Server& server, BitStream& bitStream, Session& session, uint8_t opcode) {
+    server.closeSession(session);
+}
 
-        break;
+void generateToken(const std::string username, const std::string password, std::array<uint8_t, 16>& token) {
+    token = { 'T', 'H', 'I', 'S', 'I', 'S', 'M', 'Y', 'T', 'O', 'K', 'E', 'N', 'Y', 'E', 'S' };
+}
+
+/**
+ * @return The world list sent to every client on login, shared by both servers.
+ */
+PacketCache& getWorldStatusCache() {
+    static PacketCache worldStatusCache;
+    return worldStatusCache;
+}
+
+void encodeWorldStatus(BitStream& bitStream) {
+    VNLWorldStatusMessage::WorldInfo world1;
+    world1.name = "hello_c++";
+    world1.status2 = VNLWorldStatusMessage::WS_Up;
+    world1.serverType = VNLWorldStatusMessage::ST_Released;
+    world1.status1 = VNLWorldStatusMessage::WS_Up;
+    world1.empireNeed = EM_NC;
+
+    VNLWorldStatusMessage packet;
+    packet.welcomeMessage = L"ASDF";
+    packet.worlds.push_back(world1);
+
+    bitStream.reserve(packet.maxEncodedBits());
+    packet.encode(bitStream);
+}
+
+void worldStatusChanged() {
+    getWorldStatusCache().invalidate();
+}
+
+void handleLoginMessage(Server& server, BitStream& bitStream, Session& session, uint8_t opcode) {
+    LoginMessage packet = LoginMessage::decode(bitStream);
+
+    if (bitStream.getLastError() != BitStream::Error::NONE) {
+        LOG(LC_Packet, LL_Warning) << "Bitstream error reading packet! (" << static_cast<int>(bitStream.getLastError()) << ")";
+        return;
     }
-    case OP_ConnectToWorldRequestMessage: {
-        std::cout << "OP_ConnectToWorldRequestMessage" << std::endl;
 
-        ConnectToWorldRequestMessage packet = ConnectToWorldRequestMessage::decode(bitStream);
+    LOG(LC_Packet, LL_Debug) << "Connecting user with v" << packet.majorVersion << "." << packet.minorVersion << " built on " << packet.buildDate << " revision " << packet.revision;
+    LOG(LC_Packet, LL_Debug) << "Username: " << packet.username << ", Password: " << packet.password << " built on " << packet.buildDate;
 
-        if (bitStream.getLastError() != BitStream::Error::NONE) {
-            std::cout << "Bitstream error reading packet! (" << static_cast<int>(bitStream.getLastError()) << ")" << std::endl;
-            return;
-        }
+    LoginRespMessage response;
+    generateToken(packet.username, packet.password, response.token);
+    response.unk0 = { 0x00, 0x00, 0x00, 0x00, 0x18, 0xFA, 0xBE, 0x0C, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 };
+    response.error = 0;
+    response.stationError = 1;
+    response.subscriptionStatus = 2;
+    response.unk1 = 685276011;
+    response.username = packet.username;
+    response.privilege = 10001;
 
-        std::vector<uint8_t> objectHexCopy = objectHex;
-        encryptAndSend(server, objectHexCopy, session);
+    encryptAndSend(server, response, session);
 
-        std::vector<uint8_t> hardcodedStuff = { 0x14, 0x0F, 0x00, 0x00, 0x00, 0x10, 0x27, 0x00, 0x00, 0xC1, 0xD8, 0x7A, 0x02, 0x4B, 0x00, 0x26, 0x5C, 0xB0, 0x80, 0x00 };
-        encryptAndSend(server, hardcodedStuff, session);
+    // TODO: Add delay before sending world status packet?
+    PacketCache::EntryHandle worldStatus = getWorldStatusCache().get(encodeWorldStatus);
+    encryptAndSendCached(server, worldStatus, session);
+}
 
-        CharacterInfoMessage response;
-        response.unknown = 0;
-        response.zoneId = 1;
-        response.charId = 0;
-        response.charGUID = 0;
-        response.finished = true;
-        response.secondsSinceLastLogin = 0;
+/**
+ * Points the client at the world server.
+ */
+void handleConnectToWorldRequestLogin(Server& server, BitStream& bitStream, Session& session, uint8_t opcode) {
+    ConnectToWorldRequestMessage packet = ConnectToWorldRequestMessage::decode(bitStream);
 
-        sendBuf.clear();
-        BitStream sendStream(sendBuf);
-        response.encode(sendStream);
+    if (bitStream.getLastError() != BitStream::Error::NONE) {
+        LOG(LC_Packet, LL_Warning) << "Bitstream error reading packet! (" << static_cast<int>(bitStream.getLastError()) << ")";
+        return;
+    }
 
-        encryptAndSend(server, sendBuf, session);
+    ConnectToWorldMessage response;
+    response.serverName = "psemu";
+    response.serverAddress = "127.0.0.1";
+    response.serverPort = 51001;
 
-        break;
+    encryptAndSend(server, response, session);
+}
+
+std::vector<uint8_t> objectHex = { 0x18, 0x57, 0x0C, 0x00, 0x00, 0xBC, 0x84, 0xB0, 0x06, 0xC2, 0xD7, 0x65, 0x53, 0x5C, 0xA1, 0x60, 0x00, 0x01, 0x34, 0x40, 0x00, 0x09, 0x70, 0x49, 0x00, 0x6C, 0x00, 0x6C, 0x00, 0x6C, 0x00, 0x49, 0x00, 0x49, 0x00, 0x49, 0x00, 0x6C, 0x00, 0x6C, 0x00, 0x6C, 0x00, 0x49, 0x00, 0x6C, 0x00, 0x49, 0x00, 0x6C, 0x00, 0x6C, 0x00, 0x49, 0x00, 0x6C, 0x00, 0x6C, 0x00, 0x6C, 0x00, 0x49, 0x00, 0x6C, 0x00, 0x6C, 0x00, 0x49, 0x00, 0x84, 0x52, 0x70, 0x76, 0x1E, 0x80, 0x80, 0x00, 0x00, 0x00, 0x00, 0x00, 0x3F, 0xFF, 0xC0, 0x00, 0x00, 0x00, 0x20, 0x00, 0x00, 0x0F, 0xF6, 0xA7, 0x03, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFD, 0x90, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x90, 0x01, 0x90, 0x00, 0x64, 0x00, 0x00, 0x01, 0x00, 0x7E, 0xC8, 0x00, 0xC8, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0xC0, 0x00, 0x42, 0xC5, 0x46, 0x86, 0xC7, 0x00, 0x00, 0x00, 0x80, 0x00, 0x00, 0x12, 0x40, 0x78, 0x70, 0x65, 0x5F, 0x73, 0x61, 0x6E, 0x63, 0x74, 0x75, 0x61, 0x72, 0x79, 0x5F, 0x68, 0x65, 0x6C, 0x70, 0x90, 0x78, 0x70, 0x65, 0x5F, 0x74, 0x68, 0x5F, 0x66, 0x69, 0x72, 0x65, 0x6D, 0x6F, 0x64, 0x65, 0x73, 0x8B, 0x75, 0x73, 0x65, 0x64, 0x5F, 0x62, 0x65, 0x61, 0x6D, 0x65, 0x72, 0x85, 0x6D, 0x61, 0x70, 0x31, 0x33, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x0A, 0x23, 0x02, 0x60, 0x04, 0x04, 0x40, 0x00, 0x00, 0x10, 0x00, 0x06, 0x02, 0x08, 0x14, 0xD0, 0x08, 0x0C, 0x80, 0x00, 0x02, 0x00, 0x02, 0x6B, 0x4E, 0x00, 0x82, 0x88, 0x00, 0x00, 0x02, 0x00, 0x00, 0xC0, 0x41, 0xC0, 0x9E, 0x01, 0x01, 0x90, 0x00, 0x00, 0x64, 0x00, 0x44, 0x2A, 0x00, 0x10, 0x91, 0x00, 0x00, 0x00, 0x40, 0x00, 0x18, 0x08, 0x38, 0x94, 0x40, 0x20, 0x32, 0x00, 0x00, 0x00, 0x80, 0x19, 0x05, 0x48, 0x02, 0x17, 0x20, 0x00, 0x00, 0x08, 0x00, 0x70, 0x29, 0x80, 0x43, 0x64, 0x00, 0x00, 0x32, 0x00, 0x0E, 0x05, 0x40, 0x08, 0x9C, 0x80, 0x00, 0x06, 0x40, 0x01, 0xC0, 0xAA, 0x01, 0x19, 0x90, 0x00, 0x00, 0xC8, 0x00, 0x3A, 0x15, 0x80, 0x28, 0x72, 0x00, 0x00, 0x19, 0x00, 0x04, 0x0A, 0xB8, 0x05, 0x26, 0x40, 0x00, 0x03, 0x20, 0x06, 0xC2, 0x58, 0x00, 0xA7, 0x88, 0x00, 0x00, 0x02, 0x00, 0x00, 0x80, 0x00, 0x00 };
+
+/**
+ * @return The avatar's ObjectCreateMessage, sent on reaching the world server and again on selecting the character.
+ */
+PacketCache& getAvatarObjectCache() {
+    static PacketCache avatarObjectCache;
+    return avatarObjectCache;
+}
+
+/**
+ * @return The SetCurrentAvatarMessage for the avatar in getAvatarObjectCache.
+ */
+PacketCache& getCurrentAvatarCache() {
+    static PacketCache currentAvatarCache;
+    return currentAvatarCache;
+}
+
+void encodeAvatarObject(BitStream& bitStream) {
+    bitStream.writeBytes(objectHex.data(), objectHex.size());
+}
+
+void encodeCurrentAvatar(BitStream& bitStream) {
+    BitStream objectHexBitStream(objectHex);
+    // Get rid of the opcode
+    objectHexBitStream.deltaPos(8 * sizeof(uint8_t));
+    ObjectCreateMessage objectHexDecoded = ObjectCreateMessage::decode(objectHexBitStream);
+    if (objectHexBitStream.getLastError() != BitStream::Error::NONE) {
+        // Fails the encode, so the cache doesn't keep a packet with a bogus GUID
+        bitStream.setError(objectHexBitStream.getLastError());
+        return;
     }
-    case OP_CharacterRequestMessage: {
-        std::cout << "OP_CharacterRequestMessage" << std::endl;
 
-        CharacterRequestMessage packet = CharacterRequestMessage::decode(bitStream);
+    SetCurrentAvatarMessage packet;
+    packet.guid = objectHexDecoded.guid;
+    packet.unk1 = 0;
+    packet.unk2 = 0;
 
-        if (bitStream.getLastError() != BitStream::Error::NONE) {
-            std::cout << "Bitstream error reading packet! (" << static_cast<int>(bitStream.getLastError()) << ")" << std::endl;
-            return;
-        }
+    bitStream.reserve(packet.maxEncodedBits());
+    packet.encode(bitStream);
+}
+
+void avatarTemplatesChanged() {
+    getAvatarObjectCache().invalidate();
+    getCurrentAvatarCache().invalidate();
+}
 
-        switch (packet.action) {
-        case CharacterRequestMessage::CRA_Select: {
-            LoadMapMessage loadMapResponse;
-            loadMapResponse.mapName = "map13";
-            loadMapResponse.navMapName = "home3";
-            loadMapResponse.unk1 = 40100;
-            loadMapResponse.unk2 = 25;
-            loadMapResponse.weaponsUnlocked = true;
-            loadMapResponse.checksum = 3770441820;
+void handleKeepAlive(Server& server, BitStream& bitStream, Session& session, uint8_t opcode) {
+    KeepAliveMessage packet = KeepAliveMessage::decode(bitStream);
 
-            sendBuf.clear();
-            BitStream loadMapSendStream(sendBuf);
-            loadMapResponse.encode(loadMapSendStream);
+    if (bitStream.getLastError() != BitStream::Error::NONE) {
+        LOG(LC_Packet, LL_Warning) << "Bitstream error reading packet! (" << static_cast<int>(bitStream.getLastError()) << ")";
+        return;
+    }
 
-            encryptAndSend(server, sendBuf, session);
+    KeepAliveMessage response;
+    response.keepAliveCode = packet.keepAliveCode;
 
-            std::vector<uint8_t> objectHexCopy = objectHex;
-            encryptAndSend(server, objectHexCopy, session);
+    encryptAndSend(server, response, session);
+}
 
-            BitStream objectHexBitStream(objectHex);
-            // Get rid of the opcode
-            objectHexBitStream.deltaPos(8 * sizeof(uint8_t));
-            ObjectCreateMessage objectHexDecoded = ObjectCreateMessage::decode(objectHexBitStream);
+/**
+ * Sends the character list once the client has arrived at the world server.
+ */
+void handleConnectToWorldRequestWorld(Server& server, BitStream& bitStream, Session& session, uint8_t opcode) {
+    ConnectToWorldRequestMessage packet = ConnectToWorldRequestMessage::decode(bitStream);
 
-            SetCurrentAvatarMessage setCurAvatarResponse;
-            setCurAvatarResponse.guid = objectHexDecoded.guid;
-            setCurAvatarResponse.unk1 = 0;
-            setCurAvatarResponse.unk2 = 0;
+    if (bitStream.getLastError() != BitStream::Error::NONE) {
+        LOG(LC_Packet, LL_Warning) << "Bitstream error reading packet! (" << static_cast<int>(bitStream.getLastError()) << ")";
+        return;
+    }
 
-            sendBuf.clear();
-            BitStream setCurAvatarSendStream(sendBuf);
-            setCurAvatarResponse.encode(setCurAvatarSendStream);
+    PacketCache::EntryHandle avatarObject = getAvatarObjectCache().get(encodeAvatarObject);
+    sendReliableCached(server, avatarObject, session);
 
-            encryptAndSend(server, sendBuf, session);
+    std::vector<uint8_t> hardcodedStuff = { 0x14, 0x0F, 0x00, 0x00, 0x00, 0x10, 0x27, 0x00, 0x00, 0xC1, 0xD8, 0x7A, 0x02, 0x4B, 0x00, 0x26, 0x5C, 0xB0, 0x80, 0x00 };
+    sendReliableBytes(server, hardcodedStuff, session);
 
-            break;
-        }
-        default: {
-            std::cout << "Unhandled character action " << packet.action << std::endl;
-            break;
-        }
-        }
+    CharacterInfoMessage response;
+    response.unknown = 0;
+    response.zoneId = 1;
+    response.charId = 0;
+    response.charGUID = 0;
+    response.finished = true;
+    response.secondsSinceLastLogin = 0;
+
+    sendReliable(server, response, session);
+}
+
+void handleCharacterRequest(Server& server, BitStream& bitStream, Session& session, uint8_t opcode) {
+    CharacterRequestMessage packet = CharacterRequestMessage::decode(bitStream);
+
+    if (bitStream.getLastError() != BitStream::Error::NONE) {
+        LOG(LC_Packet, LL_Warning) << "Bitstream error reading packet! (" << static_cast<int>(bitStream.getLastError()) << ")";
+        return;
+    }
+
+    switch (packet.action) {
+    case CharacterRequestMessage::CRA_Select: {
+        LoadMapMessage loadMapResponse;
+        loadMapResponse.mapName = "map13";
+        loadMapResponse.navMapName = "home3";
+        loadMapResponse.unk1 = 40100;
+        loadMapResponse.unk2 = 25;
+        loadMapResponse.weaponsUnlocked = true;
+        loadMapResponse.checksum = 3770441820;
+
+        sendReliable(server, loadMapResponse, session);
+
+        PacketCache::EntryHandle avatarObject = getAvatarObjectCache().get(encodeAvatarObject);
+        sendReliableCached(server, avatarObject, session);
+
+        PacketCache::EntryHandle currentAvatar = getCurrentAvatarCache().get(encodeCurrentAvatar);
+        sendReliableCached(server, currentAvatar, session);
 
         break;
     }
     default: {
-        std::cout << "Unknown" << std::endl;
+        LOG(LC_Packet, LL_Warning) << "Unhandled character action " << packet.action;
         break;
     }
     }
 }
 
-void handleGamePacket(Server& server, BitStream& bitStream, std::shared_ptr<Session> session) {
-    if (server.getPort() == 51000) {
-        handleGamePacketLogin(server, bitStream, session);
-    } else {
-        handleGamePacketWorld(server, bitStream, session);
+void registerControlHandlers(PacketTable& table) {
+    OPCODE_TABLE_ADD(table, OP_ClientStart, handleClientStartPacket);
+    OPCODE_TABLE_ADD(table, OP_ControlSync, handleControlSync);
+    OPCODE_TABLE_ADD(table, OP_SlottedMetaPacket0, handleSlottedMetaPacket);
+    OPCODE_TABLE_ADD(table, OP_SlottedMetaPacket1, handleSlottedMetaPacket);
+    OPCODE_TABLE_ADD(table, OP_SlottedMetaPacket2, handleSlottedMetaPacket);
+    OPCODE_TABLE_ADD(table, OP_SlottedMetaPacket3, handleSlottedMetaPacket);
+    OPCODE_TABLE_ADD(table, OP_SlottedMetaPacket4, handleSlottedMetaPacket);
+    OPCODE_TABLE_ADD(table, OP_SlottedMetaPacket5, handleSlottedMetaPacket);
+    OPCODE_TABLE_ADD(table, OP_SlottedMetaPacket6, handleSlottedMetaPacket);
+    OPCODE_TABLE_ADD(table, OP_SlottedMetaPacket7, handleSlottedMetaPacket);
+    OPCODE_TABLE_ADD(table, OP_RelatedA0, handleSlottedMetaNack);
+    OPCODE_TABLE_ADD(table, OP_RelatedA1, handleSlottedMetaNack);
+    OPCODE_TABLE_ADD(table, OP_RelatedA2, handleSlottedMetaNack);
+    OPCODE_TABLE_ADD(table, OP_RelatedA3, handleSlottedMetaNack);
+    OPCODE_TABLE_ADD(table, OP_RelatedB0, handleSlottedMetaAck);
+    OPCODE_TABLE_ADD(table, OP_RelatedB1, handleSlottedMetaAck);
+    OPCODE_TABLE_ADD(table, OP_RelatedB2, handleSlottedMetaAck);
+    OPCODE_TABLE_ADD(table, OP_RelatedB3, handleSlottedMetaAck);
+    OPCODE_TABLE_ADD(table, OP_MultiPacket, handleMultiPacket);
+    OPCODE_TABLE_ADD(table, OP_MultiPacketEx, handleMultiPacketEx);
+    OPCODE_TABLE_ADD(table, OP_TeardownConnection, handleConnectionClose);
+    OPCODE_TABLE_ADD(table, OP_ConnectionClose, handleConnectionClose);
+}
+
+void registerLoginHandlers(PacketTable& table) {
+    OPCODE_TABLE_ADD(table, OP_LoginMessage, handleLoginMessage);
+    OPCODE_TABLE_ADD(table, OP_ConnectToWorldRequestMessage, handleConnectToWorldRequestLogin);
+}
+
+void registerWorldHandlers(PacketTable& table) {
+    OPCODE_TABLE_ADD(table, OP_KeepAliveMessage, handleKeepAlive);
+    OPCODE_TABLE_ADD(table, OP_ConnectToWorldRequestMessage, handleConnectToWorldRequestWorld);
+    OPCODE_TABLE_ADD(table, OP_CharacterRequestMessage, handleCharacterRequest);
+}
+
+ServerRole::ServerRole(const char* name, void(*registerGameHandlers)(PacketTable&)) :
+    name(name) {
+    registerControlHandlers(controlTable);
+    registerGameHandlers(gameTable);
+}
+
+ServerRole& getLoginRole() {
+    static ServerRole loginRole("LOGIN", registerLoginHandlers);
+    return loginRole;
+}
+
+ServerRole& getWorldRole() {
+    static ServerRole worldRole("WORLD", registerWorldHandlers);
+    return worldRole;
+}
+
+/**
+ * Reads an opcode and hands the rest of the packet to its handler.
+ */
+void dispatchPacket(PacketTable& table, const char* packetKind, Server& server, BitStream& bitStream, Session& session) {
+    uint8_t opcode;
+    bitStream.read(opcode);
+
+    const char* opcodeName = table.getName(opcode);
+    if (opcodeName != nullptr) {
+        LOG(LC_Packet, LL_Debug) << "---- " << packetKind << ": " << opcodeName;
     }
+
+    if (!table.dispatch(opcode, server, bitStream, session, opcode)) {
+        LOG(LC_Packet, LL_Warning) << "---- " << packetKind << ": unknown op " << std::hex << std::uppercase << (unsigned)opcode;
+    }
+}
+
+void handleControlPacket(Server& server, BitStream& bitStream, Session& session) {
+    // Skip over the first byte - always zero in control packets
+    bitStream.deltaPos(8 * sizeof(uint8_t));
+
+    dispatchPacket(curRole->controlTable, "ControlPacket", server, bitStream, session);
 }
 
-void handleNormalPacket(Server& server, BitStream& bitStream, std::shared_ptr<Session> session) {
+void handleGamePacket(Server& server, BitStream& bitStream, Session& session) {
+    dispatchPacket(curRole->gameTable, "GamePacket", server, bitStream, session);
+}
+
+void handleNormalPacket(Server& server, BitStream& bitStream, Session& session) {
     uint8_t controlPacketType;
     bitStream.read(controlPacketType, true);
 
@@ -507,15 +935,30 @@ void handleNormalPacket(Server& server, BitStream& bitStream, std::shared_ptr<Se
     }
 }
 
-void handleEncryptedPacket(Server& server, BitStream& bitStream, std::shared_ptr<Session> session) {
-    std::vector<uint8_t> plaintext;
-    session->decryptPacket(bitStream, plaintext);
+void handleEncryptedPacket(Server& server, BitStream& bitStream, Session& session, uint16_t seqNum) {
+    // Skip the RC5 and MAC work for duplicates
+    if (!session.recvSeqs.check(seqNum)) {
+        LOG(LC_Packet, LL_Debug) << "Dropping duplicate or stale packet " << seqNum;
+        bitStream.deltaPos(bitStream.getRemainingBits());
+        return;
+    }
+
+    // Decrypt in-place, straight out of the receive buffer
+    uint8_t* plaintext = bitStream.getHeadBytePtr();
+    size_t plaintextSize = bitStream.getRemainingBytes();
+    if (!session.decryptPacket(plaintext, plaintextSize)) {
+        return;
+    }
+
+    // Only once the MAC matches, so garbage can't move the window. The header isn't covered by the MAC though,
+    // so a replayed datagram with a forged number still can, by up to SequenceWindow::MAX_AHEAD
+    session.recvSeqs.accept(seqNum);
 
-    BitStream plaintextBitStream(plaintext);
+    BitStream plaintextBitStream(plaintext, plaintextSize);
     handleNormalPacket(server, plaintextBitStream, session);
 }
 
-void handleNonControlPacket(Server& server, BitStream& bitStream, std::shared_ptr<Session> session) {
+void handleNonControlPacket(Server& server, BitStream& bitStream, Session& session) {
     PacketHeader header = PacketHeader::decode(bitStream);
 
     // Encrypted packets must be 4-byte aligned
@@ -524,28 +967,33 @@ void handleNonControlPacket(Server& server, BitStream& bitStream, std::shared_pt
     }
 
     if (bitStream.getLastError() != BitStream::Error::NONE) {
-        std::cout << "Bitstream error reading packet header! (" << static_cast<int>(bitStream.getLastError()) << ")" << std::endl;
+        LOG(LC_Packet, LL_Warning) << "Bitstream error reading packet header! (" << static_cast<int>(bitStream.getLastError()) << ")";
         return;
     }
 
-    curSeqNum = header.seqNum;
-
     switch (header.packetType) {
     case PT_Crypto:
         handleCryptoPacket(server, bitStream, session);
         break;
     case PT_Normal:
-        handleEncryptedPacket(server, bitStream, session);
+        handleEncryptedPacket(server, bitStream, session, header.seqNum);
+        break;
+    case PT_ResetSequence:
+        // The client is numbering its packets from scratch, which would otherwise look like duplicates of old ones.
+        // Anyone can send this, so it only takes effect once a packet with a matching MAC follows
+        LOG(LC_Packet, LL_Debug) << "Client " << session.clientEndpoint << " reset its sequence numbers";
+        session.recvSeqs.requestReset();
+        bitStream.deltaPos(bitStream.getRemainingBits());
         break;
     default:
-        std::cout << "Unhandled packet type " << header.packetType << "!" << std::endl;
+        LOG(LC_Packet, LL_Warning) << "Unhandled packet type " << header.packetType << "!";
         // Go to end of stream for now so that we don't try anything else with the packet (such as reading more if this is a MultiPacket)
         bitStream.deltaPos(bitStream.getRemainingBits());
         break;
     }
 }
 
-void handlePacket(Server& server, BitStream& bitStream, std::shared_ptr<Session> session) {
+void handlePacket(Server& server, BitStream& bitStream, Session& session) {
     uint8_t controlPacketType;
     bitStream.read(controlPacketType, true);
 
@@ -556,41 +1004,108 @@ void handlePacket(Server& server, BitStream& bitStream, std::shared_ptr<Session>
     }
 }
 
-void serverRecvHandler(Server& server, std::vector<uint8_t>& data, std::shared_ptr<Session> session) {
-    std::cout << (server.getPort() == 51000 ? "LOGIN: " : "WORLD: ") << "Received packet of " << data.size() << " bytes" << std::endl;
+void handleDatagram(ServerRole& role, Server& server, uint8_t* data, size_t size, Session& session) {
+    LOG(LC_Packet, LL_Debug) << role.name << ": Received packet of " << size << " bytes";
 
-    std::cout << "ASCII: " << strAscii(data) << std::endl;
-    std::cout << "HEX:" << strHex(data) << std::endl;
+    LOG(LC_Packet, LL_Trace) << "ASCII: " << asciiDump(data, size);
+    LOG(LC_Packet, LL_Trace) << "HEX:" << hexDump(data, size);
 
-    BitStream bitStream(data);
+    curRole = &role;
+
+    BitStream bitStream(data, size);
     handlePacket(server, bitStream, session);
+}
 
-    std::cout << std::endl;
+void loginRecvHandler(Server& server, uint8_t* data, size_t size, Session& session) {
+    handleDatagram(getLoginRole(), server, data, size, session);
 }
 
-void keepSessionsAlive(Server& server) {
-    auto& sessions = server.getSessionMap();
-    for (auto& sessionEntry : sessions) {
-        auto& session = sessionEntry.second;
+void worldRecvHandler(Server& server, uint8_t* data, size_t size, Session& session) {
+    handleDatagram(getWorldRole(), server, data, size, session);
+}
+
+bool serverAdmitHandler(Server& server, uint8_t* data, size_t size, const udp::endpoint& endpoint) {
+    BitStream bitStream(data, size);
+
+    uint8_t controlPacketType;
+    bitStream.read(controlPacketType, true);
+
+    if (controlPacketType == 0x00) {
+        // Skip over the first byte - always zero in control packets
+        bitStream.deltaPos(8 * sizeof(uint8_t));
+
+        uint8_t opcode;
+        bitStream.read(opcode);
+
+        if (opcode == OP_ClientStart) {
+            LOG(LC_Packet, LL_Debug) << "---- ControlPacket: OP_ClientStart (no session)";
+            handleClientStart(server, bitStream, endpoint);
+        }
+
+        return false;
+    }
+
+    // ClientChallengeXchg doesn't echo the server nonce, so the best that can be done is to only admit
+    // endpoints that send a well-formed one, which is the first packet that needs any server state
+    PacketHeader header = PacketHeader::decode(bitStream);
+    if (header.packetType != PT_Crypto || header.secured) {
+        return false;
+    }
+
+    // The schema also rejects p and g lengths other than the 16 bytes the packet has room for
+    ClientChallengeXchg::decode(bitStream);
+    return bitStream.getLastError() == BitStream::Error::NONE;
+}
+
+void retransmitReliable(Server& server) {
+    server.getSessions().forEach([&server](Session& session) {
+        if (session.cryptoState == Session::CS_Finished) {
+            pollReliable(server, session);
+        }
+    });
+}
 
-        if (session->cryptoState == Session::CS_Finished) {
-            size_t curTimeMS = getTimeMilliseconds();
-            if (curTimeMS - session->lastPokeMS > 500) {
-                session->lastPokeMS = curTimeMS;
+void keepSessionsAlive(Server& server) {
+    size_t curTimeMS = getTimeMilliseconds();
+    server.getSessions().forEach([&server, curTimeMS](Session& session) {
+        if (session.cryptoState == Session::CS_Finished) {
+            if (curTimeMS - session.lastPokeMS > 500) {
+                session.lastPokeMS = curTimeMS;
 
-                std::cout << "ClientPoke:" << std::endl;
+                LOG(LC_Packet, LL_Debug) << "ClientPoke:";
 
                 KeepAliveMessage response;
                 response.keepAliveCode = 0;
 
-                sendBuf.clear();
-                BitStream sendStream(sendBuf);
-                response.encode(sendStream);
+                encryptAndSend(server, response, session);
+            }
+        }
+    });
+}
 
-                encryptAndSend(server, sendBuf, session);
+/**
+ * Logs how many of each opcode one role's table has seen.
+ */
+void logPacketCounts(const ServerRole& role, const PacketTable& table, const char* packetKind) {
+    for (size_t opcode = 0; opcode < PacketTable::NUM_OPCODES; ++opcode) {
+        uint64_t count = table.getCount((uint8_t)opcode);
+        if (count == 0) {
+            continue;
+        }
 
-                std::cout << std::endl;
-            }
+        const char* opcodeName = table.getName((uint8_t)opcode);
+        if (opcodeName != nullptr) {
+            LOG(LC_Packet, LL_Debug) << role.name << " " << packetKind << " " << opcodeName << ": " << count;
+        } else {
+            LOG(LC_Packet, LL_Debug) << role.name << " " << packetKind << " unknown op " << std::hex << std::uppercase << opcode << std::dec << ": " << count;
         }
     }
 }
+
+void logPacketCounts(Server& server) {
+    const ServerRole* roles[] = { &getLoginRole(), &getWorldRole() };
+    for (const ServerRole* role : roles) {
+        logPacketCounts(*role, role->controlTable, "ControlPacket");
+        logPacketCounts(*role, role->gameTable, "GamePacket");
+    }
+}
@@ -6,11 +6,49 @@
 #include "common/session.h"
 
 /**
- * Top level handler for receiving network data from a server.
+ * Top level handler for receiving network data on the login server.
  */
-void serverRecvHandler(Server& server, std::vector<uint8_t>& data, std::shared_ptr<Session> session);
+void loginRecvHandler(Server& server, uint8_t* data, size_t size, Session& session);
+
+/**
+ * Top level handler for receiving network data on the world server.
+ */
+void worldRecvHandler(Server& server, uint8_t* data, size_t size, Session& session);
+
+/**
+ * Decides whether a datagram from an unknown endpoint should create a session.
+ * Answers OP_ClientStart statelessly, and only admits endpoints that start the crypto handshake.
+ */
+bool serverAdmitHandler(Server& server, uint8_t* data, size_t size, const udp::endpoint& endpoint);
+
+/**
+ * Encrypts and sends a session's queued packets together. The servers' flush handler.
+ */
+void flushOutbound(Server& server, Session& session);
 
 /**
  * Pokes all sessions that need it to keep them active.
  */
 void keepSessionsAlive(Server& server);
+
+/**
+ * Resends slotted packets that the client hasn't acked in time.
+ */
+void retransmitReliable(Server& server);
+
+/**
+ * Has the world list re-encoded for the next logins. Call whenever a world's status changes.
+ * The world list is hardcoded for now, so nothing calls this yet.
+ */
+void worldStatusChanged();
+
+/**
+ * Has the avatar packets re-encoded for the next clients to enter the world. Call whenever the avatar templates change.
+ * The templates are hardcoded for now, so nothing calls this yet.
+ */
+void avatarTemplatesChanged();
+
+/**
+ * Logs how many of each opcode both servers have received so far.
+ */
+void logPacketCounts(Server& server);